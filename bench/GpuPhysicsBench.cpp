@@ -0,0 +1,163 @@
+// Headless GPU soft body benchmark
+// Steps the same lattice with the CPU explicit solver and the compute shader solver and prints the timings and the
+// largest position difference as JSON, exits non zero when the two drift apart. Runs on any Vulkan device,
+// software ones such as lavapipe included (VK_ICD_FILENAMES=.../lvp_icd.x86_64.json)
+//
+// GpuPhysicsBench [--quick] [--out file]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "../source/physics/SBLattice.h"
+#include "../source/render/VkComputeContext.h"
+#include "../source/render/VkSoftBodyCompute.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const float c_step = 1.0f / 120.0f;
+static const float c_spacing = 0.1f;
+static const uint32_t c_steps = 120;
+// Steps recorded into one submission, as the app does per frame
+static const uint32_t c_stepsPerSubmit = 8;
+// Float sums run in a different order on the GPU, anything past this is a real divergence
+static const float c_tolerance = 1e-3f;
+
+struct Result
+{
+	std::string name;
+	uint32_t    particles;
+	uint32_t    steps;
+	double      cpuMsPerStep;
+	double      gpuMsPerStep;
+	double      gpuNsPerParticleStep;
+	float       maxError;
+};
+
+static SBLattice* MakeLattice(int size)
+{
+	std::vector<glm::vec3> positions(size * size);
+	for (int i = 0; i < size; ++i)
+	{
+		for (int j = 0; j < size; ++j)
+		{
+			float z = 0.02f * sinf(0.7f * j) * cosf(0.5f * i);
+			positions[i * size + j] = glm::vec3(j * c_spacing, i * c_spacing, z);
+		}
+	}
+
+	SBLattice* lattice = new SBLattice(positions, c_spacing, c_spacing, size, size, 25.0f, 0.75f);
+	lattice->SetSleepThresholds(0.0f, 0.0f);
+	lattice->SetNetForce(glm::vec3(0.3f, -0.2f, 0.1f));
+	return lattice;
+}
+
+static Result Run(VkComputeContext& context, int size)
+{
+	SBLattice* cpu = MakeLattice(size);
+	SBLattice* gpuSource = MakeLattice(size);
+
+	VkSoftBodyCompute gpu(context.GetDevice(), context.GetQueue());
+	gpu.Prepare(*gpuSource);
+
+	Clock::time_point start = Clock::now();
+	for (uint32_t s = 0; s < c_steps; ++s)
+	{
+		cpu->Update(c_step);
+	}
+	double cpuSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	start = Clock::now();
+	for (uint32_t s = 0; s < c_steps; s += c_stepsPerSubmit)
+	{
+		gpu.Step(c_step, std::min(c_stepsPerSubmit, c_steps - s));
+	}
+	gpu.Wait();
+	double gpuSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::vector<glm::vec4> positions;
+	gpu.ReadPositions(positions);
+
+	float maxError = 0.0f;
+	ParticleStore& particles = cpu->GetParticles();
+	for (uint32_t n = 0; n < particles.count; ++n)
+	{
+		maxError = std::max(maxError, glm::length(glm::vec3(positions[n]) - particles.GetPosition(n)));
+	}
+
+	Result result;
+	result.name = "size_" + std::to_string(size);
+	result.particles = cpu->GetNumBodies();
+	result.steps = c_steps;
+	result.cpuMsPerStep = cpuSeconds * 1e3 / c_steps;
+	result.gpuMsPerStep = gpuSeconds * 1e3 / c_steps;
+	result.gpuNsPerParticleStep = gpuSeconds * 1e9 / (static_cast<double>(c_steps) * result.particles);
+	result.maxError = maxError;
+
+	delete cpu;
+	delete gpuSource;
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	bool quick = false;
+	std::string outFile;
+	for (int a = 1; a < argc; ++a)
+	{
+		if (strcmp(argv[a], "--quick") == 0)
+			quick = true;
+		else if (strcmp(argv[a], "--out") == 0 && a + 1 < argc)
+			outFile = argv[++a];
+		else
+		{
+			fprintf(stderr, "usage: %s [--quick] [--out file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	VkComputeContext context;
+
+	std::vector<Result> results;
+	const int sizes[] = { 32, 128, 512 };
+	for (int size : sizes)
+	{
+		if (quick && size > 128)
+			break;
+		results.push_back(Run(context, size));
+	}
+
+	FILE* out = stdout;
+	if (!outFile.empty())
+	{
+		out = fopen(outFile.c_str(), "w");
+		if (out == nullptr)
+		{
+			fprintf(stderr, "failed to open %s\n", outFile.c_str());
+			return 1;
+		}
+	}
+
+	bool passed = true;
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"device\": \"%s\",\n", context.GetDeviceName());
+	fprintf(out, "\t\"step\": %g,\n", c_step);
+	fprintf(out, "\t\"scenarios\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const Result& result = results[r];
+		passed = passed && result.maxError <= c_tolerance;
+		fprintf(out, "\t\t{ \"name\": \"%s\", \"particles\": %u, \"steps\": %u, \"cpu_ms_per_step\": %.4f, \"gpu_ms_per_step\": %.4f, "
+			"\"gpu_ns_per_particle_step\": %.3f, \"max_error\": %g }%s\n",
+			result.name.c_str(), result.particles, result.steps, result.cpuMsPerStep, result.gpuMsPerStep,
+			result.gpuNsPerParticleStep, result.maxError, r + 1 == results.size() ? "" : ",");
+	}
+	fprintf(out, "\t],\n");
+	fprintf(out, "\t\"passed\": %s\n}\n", passed ? "true" : "false");
+
+	if (out != stdout)
+		fclose(out);
+	return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,1051 @@
+// Headless physics benchmark
+// Runs fixed scenarios against the physics sources only and prints the results as JSON,
+// every scenario starts from the same state so the checksums double as a regression check.
+// A failed correctness check is reported on stderr and turns the exit status to 1
+//
+// PhysicsBench [--quick] [--threads n] [--out file]
+
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "../source/physics/SBLattice.h"
+#include "../source/physics/PhysicsBackend.h"
+#include "../source/physics/SignedDistanceField.h"
+#include "../source/physics/WorkerPool.h"
+#include "../source/physics/TrajectoryRecorder.h"
+#include "../source/physics/TrajectoryPlayer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const float c_step = 1.0f / 120.0f;
+static const float c_spacing = 0.1f;
+// Particle steps measured per scenario, smaller lattices run more steps to reach it
+static const double c_particleStepBudget = 2.0e7;
+
+// Set by any correctness check that fails, the run still finishes so every failure gets reported
+static bool checksFailed = false;
+
+static void ReportFailure(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	checksFailed = true;
+}
+
+struct Options
+{
+	bool        quick = false;
+	uint32_t    maxThreads = 0;
+	std::string outFile;
+};
+
+struct Result
+{
+	std::string name;
+	std::string solver;
+	uint32_t    lattices;
+	uint32_t    particles;
+	uint32_t    steps;
+	uint32_t    threads;
+	float       stiffness;
+	double      msPerStep;
+	double      nsPerParticleStep;
+	double      particleStepsPerSecond;
+	double      speedup;
+	// Mean substeps per step, 1 unless the scenario plans substeps
+	double      substeps;
+	uint64_t    checksum;
+};
+
+// Row major grid in the xy plane with a fixed ripple so the springs start out loaded
+static std::vector<glm::vec3> MakeGrid(int x, int y)
+{
+	std::vector<glm::vec3> positions(x * y);
+	for (int i = 0; i < y; ++i)
+	{
+		for (int j = 0; j < x; ++j)
+		{
+			float z = 0.02f * sinf(0.7f * j) * cosf(0.5f * i);
+			positions[i * x + j] = glm::vec3(j * c_spacing, i * c_spacing, z);
+		}
+	}
+	return positions;
+}
+
+static SBLattice* MakeLattice(int size, float stiffness, SolverMode mode = SOLVER_EXPLICIT)
+{
+	SBLattice* lattice = new SBLattice(MakeGrid(size, size), c_spacing, c_spacing, size, size, stiffness, 0.75f);
+	lattice->SetSolverMode(mode);
+	// Sleeping would turn a settled scenario into a measurement of nothing
+	lattice->SetSleepThresholds(0.0f, 0.0f);
+	lattice->SetNetForce(glm::vec3(0.3f, -0.2f, 0.1f));
+	return lattice;
+}
+
+// The same grid as two triangles per cell, stepped through the edge list instead of the grid stencil
+static SBLattice* MakeMeshLattice(int size, float stiffness, SolverMode mode = SOLVER_EXPLICIT)
+{
+	std::vector<uint32_t> indices;
+	for (int i = 0; i + 1 < size; ++i)
+	{
+		for (int j = 0; j + 1 < size; ++j)
+		{
+			uint32_t n = i * size + j;
+			uint32_t quad[6] = { n, n + 1, n + size, n + 1, n + size + 1, n + size };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	std::vector<glm::vec3> rest = MakeGrid(size, size);
+	SpringTopology springs;
+	springs.BuildFromTriangles(rest, indices.data(), indices.size());
+
+	SBLattice* lattice = new SBLattice(rest, springs, stiffness, 0.75f);
+	lattice->SetSolverMode(mode);
+	lattice->SetSleepThresholds(0.0f, 0.0f);
+	lattice->SetNetForce(glm::vec3(0.3f, -0.2f, 0.1f));
+	return lattice;
+}
+
+// FNV-1a over the position streams
+static uint64_t HashPositions(const ParticleStore& particles, uint64_t hash)
+{
+	const float* streams[3] = { particles.px, particles.py, particles.pz };
+	for (const float* stream : streams)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(stream);
+		for (size_t b = 0; b < sizeof(float) * particles.count; ++b)
+		{
+			hash ^= bytes[b];
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+static uint32_t StepsFor(uint32_t particles, const Options& options)
+{
+	double budget = options.quick ? c_particleStepBudget / 20.0 : c_particleStepBudget;
+	double steps = budget / particles;
+	return static_cast<uint32_t>(glm::clamp(steps, 5.0, 2000.0));
+}
+
+static const char* IntegratorName(IntegratorType type)
+{
+	switch (type)
+	{
+	case INTEGRATOR_SYMPLECTIC_EULER: return "symplectic_euler";
+	case INTEGRATOR_VERLET:           return "verlet";
+	case INTEGRATOR_VELOCITY_VERLET:  return "velocity_verlet";
+	default:                          return "constant_acceleration";
+	}
+}
+
+static const char* SolverName(SolverMode mode)
+{
+	switch (mode)
+	{
+	case SOLVER_XPBD:     return "xpbd";
+	case SOLVER_IMPLICIT: return "implicit";
+	default:              return "explicit";
+	}
+}
+
+enum Contact
+{
+	CONTACT_NONE,
+	// End of step point test against the plane
+	CONTACT_PLANE,
+	// Swept tests against the plane and a sphere, a box and a tilted box under the lattice
+	CONTACT_SWEPT
+};
+
+// Steps every lattice through the shared scene step with the given contact
+static Result Run(const char* name, std::vector<SBLattice*>& lattices, uint32_t steps, uint32_t threads, float stiffness, Contact contact,
+	SolverMode mode = SOLVER_EXPLICIT, bool adaptive = false)
+{
+	PhysicsBackend physics;
+	physics.SetWorkerCount(threads);
+	physics.SetContinuousCollision(contact == CONTACT_SWEPT);
+
+	glm::vec3 planeOrigin(0, 0, -0.01f);
+	glm::vec3 planeNormal(0, 0, 1.0f);
+
+	Collider colliders[3];
+	if (contact == CONTACT_SWEPT)
+	{
+		colliders[0].SetSphere(glm::vec3(1.0f, 1.0f, -0.3f), 0.25f);
+		colliders[1].SetBox(glm::vec3(2.0f, 0.5f, -0.4f), glm::vec3(3.0f, 1.5f, -0.2f));
+		glm::mat3 tilt(glm::rotate(glm::mat4(1.0f), 0.6f, glm::vec3(1.0f, 1.0f, 0.0f)));
+		colliders[2].SetOrientedBox(glm::vec3(1.5f, 2.5f, -0.3f), glm::vec3(0.4f, 0.3f, 0.1f), tilt);
+		for (Collider& collider : colliders)
+			physics.AddCollider(&collider);
+		physics.UpdatePhysics(c_step);
+	}
+
+	auto stepScene = [&]()
+	{
+		for (SBLattice* lattice : lattices)
+		{
+			uint32_t substeps = adaptive ? physics.PlanSubsteps(*lattice, c_step) : 1;
+			ParticleStore& particles = lattice->GetParticles();
+			for (uint32_t s = 0; s < substeps; ++s)
+			{
+				if (contact == CONTACT_PLANE)
+				{
+					for (uint32_t i = 0; i < particles.count; ++i)
+					{
+						if (physics.TestPointPlane(particles.GetPosition(i), planeOrigin, planeNormal))
+							physics.ResolveCollision(particles, i, planeNormal);
+					}
+				}
+				lattice->Update(c_step / substeps, physics.GetWorkerPool());
+				if (contact == CONTACT_SWEPT)
+				{
+					physics.SweepParticlesColliders(particles);
+					physics.SweepParticlesPlane(particles, planeOrigin, planeNormal);
+				}
+			}
+		}
+	};
+
+	// One untimed step to fault in the worker threads and the particle pages
+	stepScene();
+	physics.ResetSubstepStats();
+
+	Clock::time_point start = Clock::now();
+	for (uint32_t s = 0; s < steps; ++s)
+	{
+		stepScene();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	Result result;
+	result.name = name;
+	result.solver = SolverName(mode);
+	result.lattices = static_cast<uint32_t>(lattices.size());
+	result.particles = 0;
+	result.checksum = 14695981039346656037ull;
+	for (SBLattice* lattice : lattices)
+	{
+		result.particles += lattice->GetNumBodies();
+		result.checksum = HashPositions(lattice->GetParticles(), result.checksum);
+	}
+	result.steps = steps;
+	result.threads = physics.GetWorkerPool()->GetNumThreads();
+	result.stiffness = stiffness;
+	result.msPerStep = seconds * 1e3 / steps;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(steps) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(steps) * result.particles / seconds;
+	result.speedup = 1.0;
+	const SubstepStats& stats = physics.GetSubstepStats();
+	result.substeps = stats.steps > 0 ? static_cast<double>(stats.totalSubsteps) / stats.steps : 1.0;
+	return result;
+}
+
+static Result RunSingle(const char* name, int size, float stiffness, uint32_t threads, Contact contact, const Options& options,
+	SolverMode mode = SOLVER_EXPLICIT, bool adaptive = false)
+{
+	std::vector<SBLattice*> lattices(1, MakeLattice(size, stiffness, mode));
+	Result result = Run(name, lattices, StepsFor(size * size, options), threads, stiffness, contact, mode, adaptive);
+	delete lattices[0];
+	return result;
+}
+
+// Grid of box towers on a static ground box, stepped by the contact solver at a handful of iterations
+// Warm started the towers stand, started cold the same iterations leave them sinking and toppling
+static Result RunRigidStack(const char* name, bool warmStarting, const Options& options)
+{
+	static const int c_towers = 8;
+	static const int c_height = 5;
+	static const uint32_t c_iterations = 4;
+
+	PhysicsBackend physics;
+	physics.SetGravity(glm::vec3(0, -9.81f, 0));
+	physics.GetContactSolver().SetIterations(c_iterations);
+	physics.GetContactSolver().SetWarmStarting(warmStarting);
+
+	Collider ground;
+	ground.SetBox(glm::vec3(-50, -1, -50), glm::vec3(50, 0, 50));
+	physics.AddCollider(&ground);
+
+	std::vector<RigidBody> bodies(c_towers * c_towers * c_height);
+	for (int x = 0; x < c_towers; ++x)
+	{
+		for (int z = 0; z < c_towers; ++z)
+		{
+			for (int y = 0; y < c_height; ++y)
+			{
+				RigidBody& body = bodies[(x * c_towers + z) * c_height + y];
+				body = RigidBody(glm::vec3(2.0f * x, 0.5f + y, 2.0f * z), glm::vec3(0), glm::vec3(0), 1.0f);
+				body.SetBox(glm::vec3(0.5f));
+			}
+		}
+	}
+	for (RigidBody& body : bodies)
+		physics.AddRigidBody(&body);
+
+	uint32_t steps = options.quick ? 240 : 1200;
+	Clock::time_point start = Clock::now();
+	for (uint32_t s = 0; s < steps; ++s)
+		physics.UpdatePhysics(c_step);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	Result result;
+	result.name = name;
+	result.solver = "sequential_impulse";
+	result.lattices = 0;
+	result.particles = static_cast<uint32_t>(bodies.size());
+	result.checksum = 14695981039346656037ull;
+	for (const RigidBody& body : bodies)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&body.position);
+		for (size_t b = 0; b < sizeof(body.position); ++b)
+		{
+			result.checksum ^= bytes[b];
+			result.checksum *= 1099511628211ull;
+		}
+	}
+	result.steps = steps;
+	result.threads = 1;
+	result.stiffness = 0.0f;
+	result.msPerStep = seconds * 1e3 / steps;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(steps) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(steps) * result.particles / seconds;
+	result.speedup = 1.0;
+	result.substeps = 1.0;
+	return result;
+}
+
+// A 100k particle lattice and a few box towers registered for snapshots, a frame saved every step. Then back to the
+// first frame and over the same steps again, which has to end in the same state. msPerStep is the time of one save
+static Result RunSnapshot(const char* name, const Options& options)
+{
+	static const int c_size = 320;
+	static const int c_towers = 2;
+	static const int c_height = 5;
+
+	PhysicsBackend physics;
+	physics.SetGravity(glm::vec3(0, -9.81f, 0));
+
+	Collider ground;
+	ground.SetBox(glm::vec3(-50, -1, -50), glm::vec3(50, 0, 50));
+	physics.AddCollider(&ground);
+
+	std::vector<RigidBody> bodies(c_towers * c_towers * c_height);
+	for (size_t b = 0; b < bodies.size(); ++b)
+	{
+		int tower = static_cast<int>(b) / c_height;
+		bodies[b] = RigidBody(glm::vec3(2.0f * (tower % c_towers), 0.5f + b % c_height, 2.0f * (tower / c_towers)), glm::vec3(0), glm::vec3(0), 1.0f);
+		bodies[b].SetBox(glm::vec3(0.5f));
+		physics.AddRigidBody(&bodies[b]);
+	}
+
+	SBLattice* lattice = MakeLattice(c_size, 25.0f);
+	physics.AddLattice(lattice);
+
+	uint32_t steps = options.quick ? 20 : 60;
+	physics.ReserveSnapshots(steps + 1);
+
+	auto stepScene = [&]() { physics.UpdatePhysics(c_step); };
+	auto hashScene = [&]()
+	{
+		uint64_t hash = HashPositions(lattice->GetParticles(), 14695981039346656037ull);
+		for (const RigidBody& body : bodies)
+			hash = HashBytes(&body.position, sizeof(body.position), hash);
+		return hash;
+	};
+
+	// Settle the towers into contact first, so the frames carry warm started manifolds
+	for (uint32_t s = 0; s < 10; ++s)
+		stepScene();
+	uint64_t first = physics.SaveSnapshot();
+
+	double seconds = 0.0;
+	for (uint32_t s = 0; s < steps; ++s)
+	{
+		stepScene();
+		Clock::time_point start = Clock::now();
+		physics.SaveSnapshot();
+		seconds += std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	uint64_t reference = hashScene();
+
+	physics.RestoreSnapshot(first);
+	for (uint32_t s = 0; s < steps; ++s)
+		stepScene();
+
+	Result result;
+	result.name = name;
+	result.solver = "snapshot";
+	result.lattices = 1;
+	result.particles = lattice->GetNumBodies() + static_cast<uint32_t>(bodies.size());
+	result.checksum = hashScene();
+	if (result.checksum != reference)
+		ReportFailure("%s: stepping on from the restored frame diverged from the first run\n", name);
+	result.steps = steps;
+	result.threads = 1;
+	result.stiffness = 25.0f;
+	result.msPerStep = seconds * 1e3 / steps;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(steps) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(steps) * result.particles / seconds;
+	result.speedup = 1.0;
+	result.substeps = 1.0;
+	delete lattice;
+	return result;
+}
+
+// Records every step of a lattice into a trajectory file and plays the last frame back through the mapping
+// msPerStep is what recording costs the stepping thread, the copy into the queue plus its share of waiting for the writer
+static Result RunTrajectory(const char* name, TrajectoryEncoding encoding, const Options& options)
+{
+	static const int c_size = 128;
+	static const float c_quantum = 1e-4f;
+	const char* path = "PhysicsBench.trajectory";
+
+	SBLattice* lattice = MakeLattice(c_size, 25.0f);
+	uint32_t steps = StepsFor(c_size * c_size, options);
+
+	TrajectoryRecorder recorder;
+	recorder.Open(path, *lattice, c_step, encoding, c_quantum);
+	double seconds = 0.0;
+	for (uint32_t s = 0; s < steps; ++s)
+	{
+		lattice->Update(c_step);
+		Clock::time_point start = Clock::now();
+		recorder.Record(*lattice);
+		seconds += std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	Clock::time_point start = Clock::now();
+	if (!recorder.Close())
+		ReportFailure("%s: failed to write %s\n", name, path);
+	seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+	// Raw frames come back exactly, encoded ones within half a quantum per step they were built from
+	std::vector<glm::vec4> expected(c_size * c_size);
+	std::vector<glm::vec4> played(c_size * c_size);
+	lattice->WriteDeformation(expected.data());
+	TrajectoryPlayer player;
+	player.Open(path);
+	player.WriteDeformation(player.GetFrameCount() - 1, played.data());
+	float tolerance = encoding == TRAJECTORY_RAW ? 0.0f : c_quantum;
+	float maxError = 0.0f;
+	for (size_t n = 0; n < played.size(); ++n)
+		maxError = std::max(maxError, glm::length(played[n] - expected[n]));
+	if (player.GetFrameCount() != steps || maxError > tolerance)
+		ReportFailure("%s: played back %llu frames, last one off by %g\n", name, static_cast<unsigned long long>(player.GetFrameCount()), maxError);
+
+	Result result;
+	result.name = name;
+	result.solver = SolverName(SOLVER_EXPLICIT);
+	result.lattices = 1;
+	result.particles = lattice->GetNumBodies();
+	result.checksum = HashBytes(played.data(), sizeof(glm::vec4) * played.size(), 14695981039346656037ull);
+	result.steps = steps;
+	result.threads = 1;
+	result.stiffness = 25.0f;
+	result.msPerStep = seconds * 1e3 / steps;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(steps) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(steps) * result.particles / seconds;
+	result.speedup = 1.0;
+	result.substeps = 1.0;
+
+	player.Close();
+	remove(path);
+	delete lattice;
+	return result;
+}
+
+// Rays down through a large lattice at spread out points, each against the particle broadphase and checked against
+// testing every particle. msPerStep is the time of one grid query
+static Result RunRaycast(const char* name, const Options& options)
+{
+	static const int c_size = 512;
+	static const float c_radius = 0.05f;
+
+	SBLattice* lattice = MakeLattice(c_size, 25.0f);
+	const ParticleStore& particles = lattice->GetParticles();
+	PhysicsBackend physics;
+	std::vector<const ParticleStore*> stores(1, &particles);
+	physics.BuildParticleBroadphase(stores, 2.0f * c_radius);
+
+	uint32_t queries = options.quick ? 200 : 2000;
+	glm::vec3 dir = glm::normalize(glm::vec3(0.1f, 0.05f, -1.0f));
+	std::vector<glm::vec3> origins(queries);
+	for (uint32_t q = 0; q < queries; ++q)
+	{
+		// Golden ratio spacing over the lattice, lifted off it along the ray
+		float u = fmodf(q * 0.618034f, 1.0f);
+		float v = (q + 0.5f) / queries;
+		origins[q] = glm::vec3(u, v, 0.0f) * (c_size * c_spacing) - dir * 2.0f;
+	}
+
+	std::vector<SpatialHash::Entry> hits(queries);
+	std::vector<float> depths(queries, -1.0f);
+	Clock::time_point start = Clock::now();
+	for (uint32_t q = 0; q < queries; ++q)
+	{
+		if (!physics.RaycastParticles(origins[q], dir, c_radius, 10.0f, hits[q], depths[q]))
+			depths[q] = -1.0f;
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	Result result;
+	result.name = name;
+	result.solver = "grid_raycast";
+	result.lattices = 1;
+	result.particles = particles.count;
+	result.checksum = 14695981039346656037ull;
+	uint32_t mismatches = 0;
+	for (uint32_t q = 0; q < queries; ++q)
+	{
+		// The first particle whose sphere the ray enters, over every particle
+		float best = 10.0f;
+		for (uint32_t n = 0; n < particles.count; ++n)
+		{
+			glm::vec3 m = particles.GetPosition(n) - origins[q];
+			float b = glm::dot(m, dir);
+			float disc = b * b - glm::dot(m, m) + c_radius * c_radius;
+			if (disc >= 0 && b + sqrtf(disc) >= 0)
+				best = std::min(best, std::max(b - sqrtf(disc), 0.0f));
+		}
+		float found = depths[q] < 0 ? 10.0f : depths[q];
+		if (fabsf(found - best) > 1e-5f)
+			++mismatches;
+		uint32_t index = depths[q] < 0 ? 0xffffffff : hits[q].index;
+		result.checksum = HashBytes(&index, sizeof(index), result.checksum);
+	}
+	if (mismatches > 0)
+		ReportFailure("%s: %u rays disagree with testing every particle\n", name, mismatches);
+
+	result.steps = queries;
+	result.threads = 1;
+	result.stiffness = 25.0f;
+	result.msPerStep = seconds * 1e3 / queries;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(queries) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(queries) * result.particles / seconds;
+	result.speedup = 1.0;
+	result.substeps = 1.0;
+	delete lattice;
+	return result;
+}
+
+// Closed UV sphere, rings of segments between the two poles, wound counterclockwise seen from outside
+static void MakeSphereMesh(glm::vec3 center, float radius, int rings, int segments, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+	positions.clear();
+	indices.clear();
+	positions.push_back(center - glm::vec3(0, 0, radius));
+	for (int r = 1; r < rings; ++r)
+	{
+		float polar = glm::pi<float>() * r / rings;
+		for (int s = 0; s < segments; ++s)
+		{
+			float azimuth = glm::two_pi<float>() * s / segments;
+			positions.push_back(center + radius * glm::vec3(sinf(polar) * cosf(azimuth), sinf(polar) * sinf(azimuth), -cosf(polar)));
+		}
+	}
+	positions.push_back(center + glm::vec3(0, 0, radius));
+
+	uint32_t top = static_cast<uint32_t>(positions.size() - 1);
+	for (int s = 0; s < segments; ++s)
+	{
+		uint32_t a = 1 + s;
+		uint32_t b = 1 + (s + 1) % segments;
+		uint32_t bottom[3] = { 0, b, a };
+		indices.insert(indices.end(), bottom, bottom + 3);
+		for (int r = 1; r + 1 < rings; ++r)
+		{
+			uint32_t quad[6] = { a, b, b + segments, a, b + segments, a + segments };
+			indices.insert(indices.end(), quad, quad + 6);
+			a += segments;
+			b += segments;
+		}
+		uint32_t cap[3] = { a, b, top };
+		indices.insert(indices.end(), cap, cap + 3);
+	}
+}
+
+static const glm::vec3 c_fieldCenter(6.35f, 6.35f, 1.2f);
+static const float c_fieldRadius = 1.0f;
+static const float c_fieldCell = 0.05f;
+static const float c_fieldBand = 0.2f;
+
+static void BakeSphereField(SignedDistanceField& field, WorkerPool* pool)
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	MakeSphereMesh(c_fieldCenter, c_fieldRadius, 64, 128, positions, indices);
+	field.Bake(positions, indices.data(), indices.size(), c_fieldCell, c_fieldBand, pool);
+}
+
+// Bakes the distance field of a sphere mesh, checks it against the sphere's own distance and round trips it through
+// the cache file. msPerStep is the time of one bake across the pool
+static Result RunFieldBake(const char* name, const Options& options)
+{
+	const char* path = "PhysicsBench.sdf";
+	// Chord error of the tessellation plus what trilinear interpolation loses on the curve
+	static const float c_tolerance = 5e-3f;
+
+	WorkerPool pool(options.maxThreads);
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	MakeSphereMesh(c_fieldCenter, c_fieldRadius, 64, 128, positions, indices);
+
+	SignedDistanceField field;
+	uint32_t bakes = options.quick ? 2 : 10;
+	Clock::time_point start = Clock::now();
+	for (uint32_t b = 0; b < bakes; ++b)
+		field.Bake(positions, indices.data(), indices.size(), c_fieldCell, c_fieldBand, &pool);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	// Points spread through the grid. Within a cell of the band's edge the interpolation blends in clamped samples, so
+	// only the sign is checked there and beyond
+	uint32_t points = 20000;
+	uint32_t mismatches = 0;
+	std::vector<float> distances(points);
+	for (uint32_t q = 0; q < points; ++q)
+	{
+		glm::vec3 f(fmodf(q * 0.618034f, 1.0f), fmodf(q * 0.754878f, 1.0f), (q + 0.5f) / points);
+		glm::vec3 p = field.GetMin() + f * (field.GetMax() - field.GetMin());
+		float exact = glm::length(p - c_fieldCenter) - c_fieldRadius;
+		distances[q] = field.Sample(p);
+		if (fabsf(exact) < c_fieldBand - c_fieldCell ? fabsf(distances[q] - exact) > c_tolerance : distances[q] * exact <= 0)
+			++mismatches;
+	}
+	if (mismatches > 0)
+		ReportFailure("%s: %u samples disagree with the sphere\n", name, mismatches);
+
+	// First call writes the cache, the second has to take it and sample the same
+	remove(path);
+	SignedDistanceField cached;
+	bool first = cached.BakeCached(path, positions, indices.data(), indices.size(), c_fieldCell, c_fieldBand, &pool);
+	bool second = cached.BakeCached(path, positions, indices.data(), indices.size(), c_fieldCell, c_fieldBand, &pool);
+	bool same = cached.GetNumBakedBricks() == field.GetNumBakedBricks();
+	for (uint32_t q = 0; q < points && same; q += 97)
+	{
+		glm::vec3 f(fmodf(q * 0.618034f, 1.0f), fmodf(q * 0.754878f, 1.0f), (q + 0.5f) / points);
+		glm::vec3 p = field.GetMin() + f * (field.GetMax() - field.GetMin());
+		same = cached.Sample(p) == distances[q];
+	}
+	if (first || !second || !same)
+		ReportFailure("%s: cache file %s was not written and reloaded as baked\n", name, path);
+	remove(path);
+
+	uint32_t samples = field.GetNumBakedBricks() * (SignedDistanceField::c_brickCells + 1) * (SignedDistanceField::c_brickCells + 1) * (SignedDistanceField::c_brickCells + 1);
+	Result result;
+	result.name = name;
+	result.solver = "sdf_bake";
+	result.lattices = 0;
+	result.particles = samples;
+	result.checksum = HashBytes(distances.data(), sizeof(float) * distances.size(), 14695981039346656037ull);
+	result.steps = bakes;
+	result.threads = pool.GetNumThreads();
+	result.stiffness = 0.0f;
+	result.msPerStep = seconds * 1e3 / bakes;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(bakes) * samples);
+	result.particleStepsPerSecond = static_cast<double>(bakes) * samples / seconds;
+	result.speedup = 1.0;
+	result.substeps = 1.0;
+	return result;
+}
+
+// The lattice thrown up into the baked sphere, swept against the field every step. No particle may end up further
+// inside than the field's own error
+static Result RunFieldContact(const char* name, const Options& options)
+{
+	static const int c_size = 128;
+
+	PhysicsBackend physics;
+	physics.SetWorkerCount(1);
+	physics.SetContinuousCollision(true);
+	SignedDistanceField field;
+	BakeSphereField(field, physics.GetWorkerPool());
+	Collider collider;
+	collider.SetSignedDistanceField(&field);
+	physics.AddCollider(&collider);
+	physics.UpdatePhysics(c_step);
+
+	SBLattice* lattice = MakeLattice(c_size, 25.0f);
+	ParticleStore& particles = lattice->GetParticles();
+	for (uint32_t n = 0; n < particles.count; ++n)
+		particles.SetVelocity(n, glm::vec3(0, 0, 8.0f));
+
+	uint32_t steps = StepsFor(c_size * c_size, options);
+	uint32_t contacts = 0;
+	float deepest = 0.0f;
+	Clock::time_point start = Clock::now();
+	for (uint32_t s = 0; s < steps; ++s)
+	{
+		lattice->Update(c_step, physics.GetWorkerPool());
+		contacts += physics.SweepParticlesColliders(particles);
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	for (uint32_t n = 0; n < particles.count; ++n)
+		deepest = std::min(deepest, field.Sample(particles.GetPosition(n)));
+	if (contacts == 0 || deepest < -0.01f)
+		ReportFailure("%s: %u contacts, a particle %g inside the field\n", name, contacts, -deepest);
+
+	Result result;
+	result.name = name;
+	result.solver = SolverName(SOLVER_EXPLICIT);
+	result.lattices = 1;
+	result.particles = particles.count;
+	result.checksum = HashPositions(particles, 14695981039346656037ull);
+	result.steps = steps;
+	result.threads = 1;
+	result.stiffness = 25.0f;
+	result.msPerStep = seconds * 1e3 / steps;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(steps) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(steps) * result.particles / seconds;
+	result.speedup = 1.0;
+	result.substeps = 1.0;
+	delete lattice;
+	return result;
+}
+
+// Many small lattices, registered with the backend and stepped by UpdatePhysics in shared work items, or stepped one
+// at a time by the caller with every pass dispatched across the pool
+static Result RunWorld(const char* name, uint32_t count, int size, bool world, uint32_t threads, const Options& options)
+{
+	PhysicsBackend physics;
+	physics.SetWorkerCount(threads);
+	std::vector<SBLattice*> lattices(1, MakeLattice(size, 25.0f));
+	for (uint32_t l = 1; l < count; ++l)
+	{
+		lattices.push_back(new SBLattice(lattices[0]->GetRestState(), 25.0f, 0.75f));
+		lattices.back()->SetSleepThresholds(0.0f, 0.0f);
+		lattices.back()->SetNetForce(glm::vec3(0.3f, -0.2f, 0.1f));
+	}
+	if (world)
+	{
+		for (SBLattice* lattice : lattices)
+			physics.AddLattice(lattice);
+	}
+
+	auto stepScene = [&]()
+	{
+		if (!world)
+		{
+			for (SBLattice* lattice : lattices)
+			{
+				uint32_t substeps = physics.PlanSubsteps(*lattice, c_step);
+				for (uint32_t s = 0; s < substeps; ++s)
+					lattice->Update(c_step / substeps, physics.GetWorkerPool());
+			}
+		}
+		physics.UpdatePhysics(c_step);
+	};
+
+	stepScene();
+	physics.ResetSubstepStats();
+
+	uint32_t steps = StepsFor(count * size * size, options);
+	Clock::time_point start = Clock::now();
+	for (uint32_t s = 0; s < steps; ++s)
+		stepScene();
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	Result result;
+	result.name = name;
+	result.solver = world ? "world" : "per_lattice";
+	result.lattices = count;
+	result.particles = 0;
+	result.checksum = 14695981039346656037ull;
+	for (SBLattice* lattice : lattices)
+	{
+		result.particles += lattice->GetNumBodies();
+		result.checksum = HashPositions(lattice->GetParticles(), result.checksum);
+	}
+	result.steps = steps;
+	result.threads = physics.GetWorkerPool()->GetNumThreads();
+	result.stiffness = 25.0f;
+	result.msPerStep = seconds * 1e3 / steps;
+	result.nsPerParticleStep = seconds * 1e9 / (static_cast<double>(steps) * result.particles);
+	result.particleStepsPerSecond = static_cast<double>(steps) * result.particles / seconds;
+	result.speedup = 1.0;
+	const SubstepStats& stats = physics.GetSubstepStats();
+	result.substeps = stats.steps > 0 ? static_cast<double>(stats.totalSubsteps) / stats.steps : 1.0;
+
+	for (SBLattice* lattice : lattices)
+		delete lattice;
+	return result;
+}
+
+static void WriteResult(FILE* out, const Result& result, bool last)
+{
+	fprintf(out, "\t\t{ \"name\": \"%s\", \"solver\": \"%s\", \"lattices\": %u, \"particles\": %u, \"steps\": %u, \"threads\": %u, \"stiffness\": %g, "
+		"\"ms_per_step\": %.4f, \"ns_per_particle_step\": %.3f, \"particle_steps_per_second\": %.0f, \"speedup\": %.3f, \"substeps\": %.2f, "
+		"\"checksum\": \"%016llx\" }%s\n",
+		result.name.c_str(), result.solver.c_str(), result.lattices, result.particles, result.steps, result.threads, result.stiffness,
+		result.msPerStep, result.nsPerParticleStep, result.particleStepsPerSecond, result.speedup, result.substeps,
+		static_cast<unsigned long long>(result.checksum), last ? "" : ",");
+}
+
+static const char* SimdName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSE:  return "sse";
+	default:        return "scalar";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int a = 1; a < argc; ++a)
+	{
+		if (strcmp(argv[a], "--quick") == 0)
+			options.quick = true;
+		else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc)
+			options.maxThreads = static_cast<uint32_t>(atoi(argv[++a]));
+		else if (strcmp(argv[a], "--out") == 0 && a + 1 < argc)
+			options.outFile = argv[++a];
+		else
+		{
+			fprintf(stderr, "usage: %s [--quick] [--threads n] [--out file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t maxThreads = options.maxThreads ? options.maxThreads : hardwareThreads;
+	int maxSize = options.quick ? 256 : 1024;
+
+	std::vector<Result> results;
+
+	// Lattice size, single threaded so the numbers compare across machines
+	const int sizes[] = { 11, 32, 64, 128, 256, 512, 1024 };
+	for (int size : sizes)
+	{
+		if (size > maxSize)
+			break;
+		std::string name = "size_" + std::to_string(size);
+		results.push_back(RunSingle(name.c_str(), size, 25.0f, 1, CONTACT_NONE, options));
+	}
+
+	// Stiffness sweep
+	const float stiffnesses[] = { 5.0f, 25.0f, 100.0f, 400.0f };
+	for (float stiffness : stiffnesses)
+	{
+		std::string name = "stiffness_" + std::to_string(static_cast<int>(stiffness));
+		results.push_back(RunSingle(name.c_str(), 128, stiffness, 1, CONTACT_NONE, options));
+	}
+
+	// XPBD and the implicit solver hold stiffnesses the explicit path can't step at this rate
+	const float stableStiffnesses[] = { 25.0f, 400.0f, 1.0e4f, 1.0e6f };
+	const SolverMode stableModes[] = { SOLVER_XPBD, SOLVER_IMPLICIT };
+	for (SolverMode mode : stableModes)
+	{
+		for (float stiffness : stableStiffnesses)
+		{
+			std::string name = std::string(SolverName(mode)) + "_stiffness_" + std::to_string(static_cast<int>(stiffness));
+			results.push_back(RunSingle(name.c_str(), 128, stiffness, 1, CONTACT_NONE, options, mode));
+		}
+	}
+
+	// The explicit path past its stable stiffness, split into as many substeps as the planner asks for
+	const float adaptiveStiffnesses[] = { 25.0f, 400.0f, 1.0e4f };
+	for (float stiffness : adaptiveStiffnesses)
+	{
+		std::string name = "adaptive_stiffness_" + std::to_string(static_cast<int>(stiffness));
+		results.push_back(RunSingle(name.c_str(), 128, stiffness, 1, CONTACT_NONE, options, SOLVER_EXPLICIT, true));
+	}
+
+	// Plane contact on top of the spring pass
+	results.push_back(RunSingle("plane_contact", 128, 25.0f, 1, CONTACT_PLANE, options));
+
+	// The lattice thrown at the ground faster than it is thick per step. The point test needs the velocity bound's
+	// substeps to keep up, the swept tests hold at the stiffness bound and catch the thin colliders as well
+	const Contact fastContacts[] = { CONTACT_PLANE, CONTACT_SWEPT };
+	for (Contact contact : fastContacts)
+	{
+		std::vector<SBLattice*> lattices(1, MakeLattice(128, 25.0f));
+		ParticleStore& particles = lattices[0]->GetParticles();
+		for (uint32_t n = 0; n < particles.count; ++n)
+			particles.SetVelocity(n, glm::vec3(0, 0, -40.0f));
+
+		const char* name = contact == CONTACT_SWEPT ? "swept_contact" : "fast_plane_contact";
+		results.push_back(Run(name, lattices, StepsFor(128 * 128, options), 1, 25.0f, contact, SOLVER_EXPLICIT, true));
+		delete lattices[0];
+	}
+
+	// Triangle mesh soft body with shear and bend springs
+	const SolverMode meshModes[] = { SOLVER_EXPLICIT, SOLVER_XPBD };
+	for (SolverMode mode : meshModes)
+	{
+		std::vector<SBLattice*> lattices(1, MakeMeshLattice(128, 25.0f, mode));
+		std::string name = std::string("mesh_") + SolverName(mode);
+		results.push_back(Run(name.c_str(), lattices, StepsFor(128 * 128, options), 1, 25.0f, CONTACT_NONE, mode));
+		delete lattices[0];
+	}
+
+	// Every integrator and spring law instance of the explicit loops, speedup relative to the default pair
+	const IntegratorType integrators[] = { INTEGRATOR_CONSTANT_ACCELERATION, INTEGRATOR_SYMPLECTIC_EULER, INTEGRATOR_VERLET, INTEGRATOR_VELOCITY_VERLET };
+	const SpringLaw laws[] = { SPRING_LINEAR, SPRING_NONLINEAR };
+	double defaultPair = 0.0;
+	for (SpringLaw law : laws)
+	{
+		if (!VerifySpringKernel(SelectSpringKernel(DetectSimdLevel(), law), law, 1e-4f))
+			ReportFailure("spring law %d: vector kernel differs from the scalar kernel\n", law);
+
+		for (IntegratorType integrator : integrators)
+		{
+			std::vector<SBLattice*> lattices(1, MakeLattice(128, 25.0f));
+			lattices[0]->SetIntegrator(integrator);
+			lattices[0]->SetSpringLaw(law, 2.0f);
+
+			std::string name = std::string("integrator_") + IntegratorName(integrator) + (law == SPRING_NONLINEAR ? "_nonlinear" : "_linear");
+			Result result = Run(name.c_str(), lattices, StepsFor(128 * 128, options), 1, 25.0f, CONTACT_NONE);
+			if (defaultPair == 0.0)
+				defaultPair = result.msPerStep;
+			result.speedup = defaultPair / result.msPerStep;
+			results.push_back(result);
+			delete lattices[0];
+		}
+	}
+	{
+		std::vector<SBLattice*> lattices(1, MakeMeshLattice(128, 25.0f));
+		lattices[0]->SetSpringLaw(SPRING_NONLINEAR, 2.0f);
+		results.push_back(Run("mesh_explicit_nonlinear", lattices, StepsFor(128 * 128, options), 1, 25.0f, CONTACT_NONE));
+		delete lattices[0];
+	}
+
+	// Many small lattices
+	const uint32_t counts[] = { 1, 4, 16, 64 };
+	for (uint32_t count : counts)
+	{
+		std::vector<SBLattice*> lattices;
+		for (uint32_t l = 0; l < count; ++l)
+			lattices.push_back(MakeLattice(32, 25.0f));
+
+		std::string name = "lattices_" + std::to_string(count);
+		results.push_back(Run(name.c_str(), lattices, StepsFor(count * 32 * 32, options), 1, 25.0f, CONTACT_NONE));
+
+		for (SBLattice* lattice : lattices)
+			delete lattice;
+	}
+
+	// The same lattices as instances of one shared rest state, stepping has to come out the same
+	{
+		std::vector<SBLattice*> lattices(1, MakeLattice(32, 25.0f));
+		for (uint32_t l = 1; l < 64; ++l)
+		{
+			lattices.push_back(new SBLattice(lattices[0]->GetRestState(), 25.0f, 0.75f));
+			lattices.back()->SetSleepThresholds(0.0f, 0.0f);
+			lattices.back()->SetNetForce(glm::vec3(0.3f, -0.2f, 0.1f));
+		}
+
+		Result result = Run("lattices_64_shared", lattices, StepsFor(64 * 32 * 32, options), 1, 25.0f, CONTACT_NONE);
+		if (result.checksum != results.back().checksum)
+			ReportFailure("lattices_64_shared: positions differ from lattices_64\n");
+		results.push_back(result);
+
+		for (SBLattice* lattice : lattices)
+			delete lattice;
+	}
+
+	// Hundreds of small lattices stepped by the world in shared work items, speedup relative to stepping them one by one
+	{
+		Result perLattice = RunWorld("world_256_per_lattice", 256, 16, false, maxThreads, options);
+		Result world = RunWorld("world_256", 256, 16, true, maxThreads, options);
+		if (world.checksum != perLattice.checksum)
+			ReportFailure("world_256: positions differ from stepping the lattices one by one\n");
+		world.speedup = perLattice.msPerStep / world.msPerStep;
+		results.push_back(perLattice);
+		results.push_back(world);
+	}
+
+	// Rigid body contact, warm started against starting every step from zero
+	results.push_back(RunRigidStack("rigid_stack_warm", true, options));
+	results.push_back(RunRigidStack("rigid_stack_cold", false, options));
+
+	// Saving every particle and body into the snapshot ring, and rolling back to re-step
+	results.push_back(RunSnapshot("snapshot_100k", options));
+
+	// Picking a particle out of a large lattice
+	results.push_back(RunRaycast("raycast_262k", options));
+
+	// Baking a mesh collider's distance field, and a lattice swept against it
+	results.push_back(RunFieldBake("sdf_bake", options));
+	results.push_back(RunFieldContact("sdf_contact", options));
+
+	// Streaming every step to disk in each encoding
+	results.push_back(RunTrajectory("trajectory_raw", TRAJECTORY_RAW, options));
+	results.push_back(RunTrajectory("trajectory_quantized", TRAJECTORY_QUANTIZED, options));
+	results.push_back(RunTrajectory("trajectory_delta", TRAJECTORY_DELTA, options));
+
+	// Thread scaling, speedup relative to the single threaded run of the same lattice
+	int scalingSize = options.quick ? 256 : 512;
+	double baseline = 0.0;
+	for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		std::string name = "threads_" + std::to_string(threads);
+		Result result = RunSingle(name.c_str(), scalingSize, 25.0f, threads, CONTACT_NONE, options);
+		if (threads == 1)
+			baseline = result.msPerStep;
+		result.speedup = baseline / result.msPerStep;
+		results.push_back(result);
+	}
+
+	// Deterministic mode at every thread count, the state hash chained over all steps has to match the single threaded run
+	uint64_t referenceHash = 0;
+	baseline = 0.0;
+	for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		std::vector<SBLattice*> lattices(1, MakeLattice(scalingSize, 25.0f));
+		lattices[0]->SetDeterministic(true);
+
+		std::string name = "deterministic_threads_" + std::to_string(threads);
+		Result result = Run(name.c_str(), lattices, StepsFor(scalingSize * scalingSize, options), threads, 25.0f, CONTACT_NONE);
+		result.checksum = lattices[0]->GetStateHash();
+		if (threads == 1)
+		{
+			baseline = result.msPerStep;
+			referenceHash = result.checksum;
+		}
+		else if (result.checksum != referenceHash)
+			ReportFailure("%s: state hash differs from the single threaded run\n", name.c_str());
+		result.speedup = baseline / result.msPerStep;
+		results.push_back(result);
+		delete lattices[0];
+	}
+
+	FILE* out = stdout;
+	if (!options.outFile.empty())
+	{
+		out = fopen(options.outFile.c_str(), "w");
+		if (out == nullptr)
+		{
+			fprintf(stderr, "failed to open %s\n", options.outFile.c_str());
+			return 1;
+		}
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"hardware_threads\": %u,\n", hardwareThreads);
+	fprintf(out, "\t\"simd\": \"%s\",\n", SimdName(DetectSimdLevel()));
+	fprintf(out, "\t\"step\": %g,\n", c_step);
+	fprintf(out, "\t\"scenarios\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		WriteResult(out, results[r], r + 1 == results.size());
+	}
+	fprintf(out, "\t],\n");
+	fprintf(out, "\t\"passed\": %s\n}\n", checksFailed ? "false" : "true");
+
+	if (out != stdout)
+		fclose(out);
+	return checksFailed ? 1 : 0;
+}
\ No newline at end of file
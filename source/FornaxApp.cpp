@@ -2,8 +2,19 @@
 
 #include <chrono>
 #include <iostream>
+#include <limits>
 #include <unordered_map>
 
+// Past this many steps in one frame the GPU solver drops the backlog instead of catching up
+static const uint32_t c_maxGpuStepsPerFrame = 8;
+// Reach of the cursor ray around every node, and how far around the hit the grab takes nodes along
+static const float c_pickRadius = 0.05f;
+static const float c_grabRadius = 0.1f;
+// Sample spacing of a baked mesh collider and how far from the surface it keeps exact distances
+static const float c_meshFieldCell = 0.02f;
+static const float c_meshFieldBand = 0.1f;
+static const char* c_softBodyModel = "../source/assets/models/quad.obj";
+
 double mouseX, mouseY;
 double prevMouseX, prevMouseY;
 std::unordered_map<int32_t, bool> heldKeys;
@@ -80,7 +91,7 @@ static void onMouseCallback(GLFWwindow* window, int button, int action, int mods
 	if (button == GLFW_MOUSE_BUTTON_1)
 	{
 		if (action == GLFW_PRESS)
-			r_buttonHeld = true;
+			l_buttonHeld = true;
 		else if (action == GLFW_RELEASE)
 			l_buttonHeld = false;
 	}
@@ -98,7 +109,7 @@ static void onErrorCallback(int error, const char* description)
 	puts(description);
 }
 
-FornaxApp::FornaxApp()
+FornaxApp::FornaxApp(bool useGpuSolver, const std::string& trajectoryPath, const std::string& colliderModel) : m_useGpuSolver(useGpuSolver), m_trajectoryPath(trajectoryPath)
 {
 	std::vector<const char*> enabledExtensions;
 	m_renderer = new VkRenderBackend(enabledExtensions);
@@ -111,10 +122,44 @@ FornaxApp::FornaxApp()
 	int width, height;
 	glfwGetWindowSize(m_window, &width, &height);
 	m_camera = Camera(width, height);
-	/*vk::Model model = m_renderer->GetModelList()[0];
+	// The quad's 11x11 vertices are the lattice nodes, the renderer displaces each by its node's deformation
+	vk::Model model;
+	model.LoadModel(c_softBodyModel);
 	m_softbody = new SBLattice(model, 0.25f, 0.25f, 11, 11, 25.0f, 0.75f);
+	m_renderer->SetSoftBodyModel(model);
 	m_plane.origin = glm::vec3(0,  0.5f, 0);
-	m_plane.normal = glm::vec3(0, -1.0f, 0);*/
+	m_plane.normal = glm::vec3(0, -1.0f, 0);
+
+	m_physics.SetContinuousCollision(true);
+
+	if (!m_trajectoryPath.empty())
+	{
+		m_player = new TrajectoryPlayer();
+		m_player->Open(m_trajectoryPath);
+		// Frames are drawn on the soft body's mesh, one deformation per vertex
+		if (m_player->GetNumNodes() != m_softbody->GetNumBodies())
+			throw std::runtime_error("trajectory " + m_trajectoryPath + " was not recorded from this soft body");
+	}
+	else if (m_softbody && m_useGpuSolver)
+	{
+		m_gpuSolver = m_renderer->CreateSoftBodyCompute();
+		m_gpuSolver->Prepare(*m_softbody);
+		m_renderer->SetDeformationSource(m_gpuSolver->GetDeformationBuffer(), m_softbody->GetNumBodies());
+	}
+	else if (m_softbody)
+	{
+		m_physics.AddLattice(m_softbody);
+		m_physics.AddPlane(m_plane.origin, m_plane.normal);
+		// Baked while the world is still only touched by this thread, the bake is cached next to the model
+		if (!colliderModel.empty())
+		{
+			vk::Model collider;
+			collider.LoadModel(colliderModel.c_str());
+			AddMeshCollider(collider, colliderModel + ".sdf");
+		}
+		m_simulation = new SimulationThread(m_softbody, physicsStep, [this](float step) { StepPhysics(step); });
+		m_simulation->Start();
+	}
 
 	std::cout << "\nPress -W- to move the camera forward along the z axis" << std::endl;
 	std::cout << "Press -S- to move the camera backward along the z axis" << std::endl;
@@ -129,6 +174,16 @@ FornaxApp::FornaxApp()
 
 FornaxApp::~FornaxApp()
 {
+	delete m_simulation;
+	delete m_player;
+	for (Collider* collider : m_meshColliders)
+	{
+		m_physics.RemoveCollider(collider);
+		delete collider;
+	}
+	for (SignedDistanceField* field : m_meshFields)
+		delete field;
+	delete m_softbody;
 	delete m_renderer;
 	getchar();
 }
@@ -140,8 +195,21 @@ void FornaxApp::Run()
 		glfwPollEvents();
 
 		glfwGetCursorPos(m_window, &mouseX, &mouseY);
-		if (l_buttonHeld)
-			m_softbody->SetNetForce(glm::vec3((prevMouseX - mouseX)*0.25, (mouseY - prevMouseY)*0.25, 0));
+		// The cursor ray goes to the simulation thread, only the grabbed nodes feel the drag
+		if (m_simulation && (l_buttonHeld || m_dragHeld))
+		{
+			int width, height;
+			glfwGetWindowSize(m_window, &width, &height);
+			glm::vec4 viewport(0, 0, width, height);
+			glm::vec3 origin = glm::unProject(glm::vec3(mouseX, mouseY, 0.0f), m_camera.getView(), m_camera.getProj(), viewport);
+			glm::vec3 end = glm::unProject(glm::vec3(mouseX, mouseY, 1.0f), m_camera.getView(), m_camera.getProj(), viewport);
+			glm::vec3 dir = glm::normalize(end - origin);
+			bool held = l_buttonHeld;
+			m_simulation->Post([this, held, origin, dir]() { DragSoftBody(held, origin, dir); });
+			m_dragHeld = l_buttonHeld;
+		}
+		if (l_buttonHeld && m_gpuSolver)
+			m_gpuSolver->SetNetForce(glm::vec3((prevMouseX - mouseX)*0.25, (mouseY - prevMouseY)*0.25, 0));
 		if (r_buttonHeld)
 			m_camera.MouseRotate((mouseX - prevMouseX)*0.00125, (mouseY - prevMouseY)*0.00125);
 		
@@ -175,26 +243,96 @@ void FornaxApp::UpdateAndDraw()
 	frameTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 	dt = frameTime - prevFrameTime;
 
-	/*for (size_t i = 0; i < 11; ++i)
+	m_camera.Update();
+	// Fixed steps submitted ahead of the frame on the same queue, the draw reads the deformation they leave behind
+	if (m_gpuSolver)
 	{
-		for (size_t j = 0; j < 11; ++j)
+		m_gpuAccumulator += dt;
+		uint32_t steps = static_cast<uint32_t>(m_gpuAccumulator / physicsStep);
+		if (steps > c_maxGpuStepsPerFrame)
 		{
-			RigidBody* point = &m_softbody->GetBodies()[i][j];
-			if (m_physics.TestPointPlane(point->position, m_plane.origin, m_plane.normal))
-				m_physics.ResolveCollision(point, m_plane.normal);
+			steps = c_maxGpuStepsPerFrame;
+			m_gpuAccumulator = 0;
 		}
-	}*/
-
-	m_camera.Update();
-	//m_softbody->Update(dt);
-	m_renderer->UpdateUniformBuffers(m_camera, m_softbody->deformVecs, frameTime);
+		else
+		{
+			m_gpuAccumulator -= steps * physicsStep;
+		}
+		m_gpuSolver->Step(physicsStep, steps);
+	}
+	// Recorded frames go from the mapped file into the upload slice without being parsed
+	if (m_player && m_player->GetFrameCount() > 0)
+	{
+		m_playbackTime += dt;
+		uint64_t frame = static_cast<uint64_t>(m_playbackTime / m_player->GetStep()) % m_player->GetFrameCount();
+		m_player->WriteDeformation(frame, m_renderer->BeginDeformationUpload(m_player->GetNumNodes()));
+	}
+	// A sleeping soft body keeps drawing from the last slice it was uploaded to
+	if (m_simulation && m_simulation->NeedsUpload())
+		m_simulation->Interpolate(m_renderer->BeginDeformationUpload(m_softbody->GetNumBodies()));
+	m_renderer->UpdateUniformBuffers(m_camera, frameTime);
 	m_renderer->RequestFrameRender();
 
 	prevFrameTime = frameTime;
 }
 
+void FornaxApp::StepPhysics(float step)
+{
+	// The soft body is part of the physics world, which plans its substeps and sweeps it against the plane and
+	// colliders. Contact is swept, so fast particles don't force substeps of their own
+	m_physics.UpdatePhysics(step);
+}
+
+void FornaxApp::DragSoftBody(bool held, glm::vec3 origin, glm::vec3 dir)
+{
+	if (!held)
+	{
+		m_softbody->ReleaseDrag();
+		m_grabbing = false;
+		return;
+	}
+
+	// The broadphase is only built on the press, every held frame after only moves the target of the grabbed nodes
+	if (!m_grabbing)
+	{
+		std::vector<const ParticleStore*> stores(1, &m_softbody->GetParticles());
+		m_physics.BuildParticleBroadphase(stores, c_grabRadius);
+
+		SpatialHash::Entry hit;
+		if (!m_physics.RaycastParticles(origin, dir, c_pickRadius, std::numeric_limits<float>::max(), hit, m_grabDepth))
+			return;
+
+		glm::vec3 point = origin + dir * m_grabDepth;
+		m_physics.FindParticlesNear(point, c_grabRadius, m_grabbed);
+		m_grabNodes.clear();
+		for (const SpatialHash::Entry& entry : m_grabbed)
+			m_grabNodes.push_back(entry.index);
+		m_softbody->Grab(m_grabNodes, point, c_grabRadius);
+		m_grabbing = true;
+	}
+	m_softbody->SetDragTarget(origin + dir * m_grabDepth);
+}
+
+void FornaxApp::AddMeshCollider(vk::Model& model, const std::string& cachePath)
+{
+	SignedDistanceField* field = new SignedDistanceField();
+	field->BakeCached(cachePath, model, c_meshFieldCell, c_meshFieldBand, m_physics.GetWorkerPool());
+	Collider* collider = new Collider();
+	collider->SetSignedDistanceField(field);
+	m_physics.AddCollider(collider);
+	m_meshFields.push_back(field);
+	m_meshColliders.push_back(collider);
+}
+
 void FornaxApp::Cleanup()
 {
+	if (m_simulation)
+		m_simulation->Stop();
+
+	// The solver's buffers belong to the renderer's device
+	delete m_gpuSolver;
+	m_gpuSolver = nullptr;
+
 	m_renderer->Cleanup();
 
 	glfwDestroyWindow(m_window);
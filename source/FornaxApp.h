@@ -6,6 +6,9 @@
 #include "render/VkRenderBackend.h"
 #include "physics/PhysicsBackend.h"
 #include "physics/SBLattice.h"
+#include "physics/SignedDistanceField.h"
+#include "physics/SimulationThread.h"
+#include "physics/TrajectoryPlayer.h"
 
 class FornaxApp
 {
@@ -13,11 +16,23 @@ public:
 	const int WIDTH  = 800;
 	const int HEIGHT = 600;
 
-	FornaxApp();
+	// useGpuSolver steps the soft body in a compute shader instead of on the simulation thread,
+	// a trajectoryPath plays that recording in a loop instead of simulating and a colliderModel is
+	// baked into a static collider the soft body hits
+	FornaxApp(bool useGpuSolver = false, const std::string& trajectoryPath = "", const std::string& colliderModel = "");
 	~FornaxApp();
 
 	void Run();
 	void UpdateAndDraw();
+	// One fixed physics step, runs on the simulation thread
+	void StepPhysics(float step);
+	// Runs on the simulation thread. Pressing picks the node under the cursor ray and grabs the nodes around it,
+	// holding drags them along with the point at the grab depth on the ray, letting go releases them
+	void DragSoftBody(bool held, glm::vec3 origin, glm::vec3 dir);
+	// Bakes a static model into a distance field collider across the physics workers, or loads the bake from
+	// cachePath when it was made from the same model. Only called from the constructor, before the simulation
+	// thread starts stepping the world the collider joins
+	void AddMeshCollider(vk::Model& model, const std::string& cachePath);
 
 //private:
 	GLFWwindow* m_window = nullptr;
@@ -27,7 +42,25 @@ public:
 
 	Camera m_camera;
 
-	SBLattice* m_softbody;
+	SBLattice*        m_softbody = nullptr;
+	SimulationThread* m_simulation = nullptr;
+	// Steps the soft body in a compute shader on the render thread instead of the simulation thread
+	bool               m_useGpuSolver = false;
+	VkSoftBodyCompute* m_gpuSolver = nullptr;
+	float              m_gpuAccumulator = 0;
+	// The render thread's view of the drag button, the grab itself belongs to the simulation thread
+	bool                            m_dragHeld = false;
+	bool                            m_grabbing = false;
+	float                           m_grabDepth = 0;
+	std::vector<SpatialHash::Entry> m_grabbed;
+	std::vector<uint32_t>           m_grabNodes;
+	// Static models baked by AddMeshCollider, the colliders point into the fields
+	std::vector<SignedDistanceField*> m_meshFields;
+	std::vector<Collider*>            m_meshColliders;
+	// Plays a recorded trajectory in a loop instead of simulating, when a path is set
+	std::string       m_trajectoryPath;
+	TrajectoryPlayer* m_player = nullptr;
+	float             m_playbackTime = 0;
 	struct {
 		glm::vec3 origin;
 		glm::vec3 normal;
@@ -37,7 +70,7 @@ public:
 	float prevFrameTime = 0;
 	float startTime;
 	float dt;
-	const float physicsStep = 0.12;
+	const float physicsStep = 1.0f / 120.0f;
 	float moverate = 0.01f;
 
 	void Cleanup();
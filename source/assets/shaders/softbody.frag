@@ -0,0 +1,12 @@
+#version 450
+// #extension GL_ARB_seperate_sharder_objects : enable
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = vec4(fragColor, 1.0);
+}
\ No newline at end of file
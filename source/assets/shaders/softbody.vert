@@ -5,9 +5,13 @@ layout(binding = 0) uniform UniformBufferObject {
 	mat4 model;
 	mat4 view;
 	mat4 proj;
-	vec3 deformVec[121];
 } ubo;
 
+// One deformation per vertex, sized by the lattice and bound at this frame's slice of the ring
+layout(std430, binding = 1) readonly buffer DeformBuffer {
+	vec4 deformVec[];
+} deform;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 texCoord;
 layout(location = 2) in vec3 color;
@@ -22,7 +26,8 @@ layout(location = 1) out vec2 fragTexCoord;
 
 void main()
 {
-	vec3 alteredPosition = position - ubo.deformVec[gl_VertexIndex];
+	// Deformation is the node's offset from its rest position, which is this vertex
+	vec3 alteredPosition = position + deform.deformVec[gl_VertexIndex].xyz;
 
 	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(alteredPosition, 1.0);
 	fragColor = position;
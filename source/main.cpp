@@ -1,10 +1,27 @@
 #include <iostream>
+#include <cstring>
+#include <string>
 
 #include "FornaxApp.h"
 
-int main()
+int main(int argc, char** argv)
 {
-	FornaxApp app;
+	// --gpu steps the soft body with the compute shader solver, --play <file> loops a recorded trajectory,
+	// --collider <obj> adds a static mesh collider
+	bool useGpuSolver = false;
+	std::string trajectoryPath;
+	std::string colliderModel;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--gpu") == 0)
+			useGpuSolver = true;
+		else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+			trajectoryPath = argv[++i];
+		else if (strcmp(argv[i], "--collider") == 0 && i + 1 < argc)
+			colliderModel = argv[++i];
+	}
+
+	FornaxApp app(useGpuSolver, trajectoryPath, colliderModel);
 	try
 	{
 		app.Run();
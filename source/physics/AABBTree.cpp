@@ -0,0 +1,321 @@
+#include "AABBTree.h"
+
+#include <cassert>
+#include <algorithm>
+
+AABBTree::AABBTree(float m)
+{
+	root = c_nullNode;
+	freeList = c_nullNode;
+	margin = m;
+}
+
+int32_t AABBTree::AllocateNode()
+{
+	if (freeList == c_nullNode)
+	{
+		// Grow the pool and thread the new nodes onto the free list
+		int32_t oldSize = static_cast<int32_t>(nodes.size());
+		int32_t newSize = oldSize == 0 ? 16 : oldSize * 2;
+		nodes.resize(newSize);
+		for (int32_t i = oldSize; i < newSize; ++i)
+		{
+			nodes[i].parent = i + 1 < newSize ? i + 1 : c_nullNode;
+			nodes[i].height = -1;
+		}
+		freeList = oldSize;
+	}
+
+	int32_t id = freeList;
+	freeList = nodes[id].parent;
+
+	Node& node = nodes[id];
+	node.parent = c_nullNode;
+	node.child1 = c_nullNode;
+	node.child2 = c_nullNode;
+	node.height = 0;
+	node.userData = nullptr;
+	return id;
+}
+
+void AABBTree::FreeNode(int32_t id)
+{
+	nodes[id].parent = freeList;
+	nodes[id].height = -1;
+	freeList = id;
+}
+
+int32_t AABBTree::Insert(const Bounds& bounds, void* userData)
+{
+	int32_t proxy = AllocateNode();
+
+	glm::vec3 fat(margin);
+	nodes[proxy].bounds = Bounds(bounds.min - fat, bounds.max + fat);
+	nodes[proxy].userData = userData;
+
+	InsertLeaf(proxy);
+	return proxy;
+}
+
+void AABBTree::Remove(int32_t proxy)
+{
+	assert(nodes[proxy].IsLeaf());
+
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+}
+
+bool AABBTree::Move(int32_t proxy, const Bounds& bounds, glm::vec3 displacement)
+{
+	if (nodes[proxy].bounds.Contains(bounds))
+		return false;
+
+	RemoveLeaf(proxy);
+
+	glm::vec3 fat(margin);
+	Bounds enlarged(bounds.min - fat, bounds.max + fat);
+
+	// Predict the motion so a steadily moving proxy isn't re-inserted every step
+	glm::vec3 ahead = 2.0f * displacement;
+	enlarged.min += glm::min(ahead, glm::vec3(0));
+	enlarged.max += glm::max(ahead, glm::vec3(0));
+
+	nodes[proxy].bounds = enlarged;
+	InsertLeaf(proxy);
+	return true;
+}
+
+void AABBTree::InsertLeaf(int32_t leaf)
+{
+	if (root == c_nullNode)
+	{
+		root = leaf;
+		nodes[root].parent = c_nullNode;
+		return;
+	}
+
+	// Descend towards the sibling with the lowest surface area cost
+	Bounds leafBounds = nodes[leaf].bounds;
+	int32_t index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		int32_t child1 = nodes[index].child1;
+		int32_t child2 = nodes[index].child2;
+
+		float area = nodes[index].bounds.GetSurfaceArea();
+		float combinedArea = Bounds::Union(nodes[index].bounds, leafBounds).GetSurfaceArea();
+
+		// Cost of making a new parent for this node and the leaf
+		float cost = 2.0f * combinedArea;
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float cost1 = Bounds::Union(leafBounds, nodes[child1].bounds).GetSurfaceArea() + inheritanceCost;
+		if (!nodes[child1].IsLeaf())
+			cost1 -= nodes[child1].bounds.GetSurfaceArea();
+
+		float cost2 = Bounds::Union(leafBounds, nodes[child2].bounds).GetSurfaceArea() + inheritanceCost;
+		if (!nodes[child2].IsLeaf())
+			cost2 -= nodes[child2].bounds.GetSurfaceArea();
+
+		if (cost < cost1 && cost < cost2)
+			break;
+
+		index = cost1 < cost2 ? child1 : child2;
+	}
+
+	int32_t sibling = index;
+
+	// New parent for the sibling and the leaf
+	int32_t oldParent = nodes[sibling].parent;
+	int32_t newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = Bounds::Union(leafBounds, nodes[sibling].bounds);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != c_nullNode)
+	{
+		if (nodes[oldParent].child1 == sibling)
+			nodes[oldParent].child1 = newParent;
+		else
+			nodes[oldParent].child2 = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// Walk back up refitting bounds and heights
+	index = nodes[leaf].parent;
+	while (index != c_nullNode)
+	{
+		index = Balance(index);
+
+		int32_t child1 = nodes[index].child1;
+		int32_t child2 = nodes[index].child2;
+		nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+		nodes[index].bounds = Bounds::Union(nodes[child1].bounds, nodes[child2].bounds);
+
+		index = nodes[index].parent;
+	}
+}
+
+void AABBTree::RemoveLeaf(int32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = c_nullNode;
+		return;
+	}
+
+	int32_t parent = nodes[leaf].parent;
+	int32_t grandParent = nodes[parent].parent;
+	int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent != c_nullNode)
+	{
+		// The sibling takes the parent's place
+		if (nodes[grandParent].child1 == parent)
+			nodes[grandParent].child1 = sibling;
+		else
+			nodes[grandParent].child2 = sibling;
+		nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+
+		int32_t index = grandParent;
+		while (index != c_nullNode)
+		{
+			index = Balance(index);
+
+			int32_t child1 = nodes[index].child1;
+			int32_t child2 = nodes[index].child2;
+			nodes[index].bounds = Bounds::Union(nodes[child1].bounds, nodes[child2].bounds);
+			nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+
+			index = nodes[index].parent;
+		}
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = c_nullNode;
+		FreeNode(parent);
+	}
+}
+
+// Rotates node A up or down if its subtrees differ in height by more than one, returns the new subtree root
+int32_t AABBTree::Balance(int32_t iA)
+{
+	Node* A = &nodes[iA];
+	if (A->IsLeaf() || A->height < 2)
+		return iA;
+
+	int32_t iB = A->child1;
+	int32_t iC = A->child2;
+	Node* B = &nodes[iB];
+	Node* C = &nodes[iC];
+
+	int32_t balance = C->height - B->height;
+
+	// Rotate C up
+	if (balance > 1)
+	{
+		int32_t iF = C->child1;
+		int32_t iG = C->child2;
+		Node* F = &nodes[iF];
+		Node* G = &nodes[iG];
+
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		if (C->parent != c_nullNode)
+		{
+			if (nodes[C->parent].child1 == iA)
+				nodes[C->parent].child1 = iC;
+			else
+				nodes[C->parent].child2 = iC;
+		}
+		else
+		{
+			root = iC;
+		}
+
+		if (F->height > G->height)
+		{
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+			A->bounds = Bounds::Union(B->bounds, G->bounds);
+			C->bounds = Bounds::Union(A->bounds, F->bounds);
+			A->height = 1 + std::max(B->height, G->height);
+			C->height = 1 + std::max(A->height, F->height);
+		}
+		else
+		{
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+			A->bounds = Bounds::Union(B->bounds, F->bounds);
+			C->bounds = Bounds::Union(A->bounds, G->bounds);
+			A->height = 1 + std::max(B->height, F->height);
+			C->height = 1 + std::max(A->height, G->height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (balance < -1)
+	{
+		int32_t iD = B->child1;
+		int32_t iE = B->child2;
+		Node* D = &nodes[iD];
+		Node* E = &nodes[iE];
+
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		if (B->parent != c_nullNode)
+		{
+			if (nodes[B->parent].child1 == iA)
+				nodes[B->parent].child1 = iB;
+			else
+				nodes[B->parent].child2 = iB;
+		}
+		else
+		{
+			root = iB;
+		}
+
+		if (D->height > E->height)
+		{
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+			A->bounds = Bounds::Union(C->bounds, E->bounds);
+			B->bounds = Bounds::Union(A->bounds, D->bounds);
+			A->height = 1 + std::max(C->height, E->height);
+			B->height = 1 + std::max(A->height, D->height);
+		}
+		else
+		{
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+			A->bounds = Bounds::Union(C->bounds, D->bounds);
+			B->bounds = Bounds::Union(A->bounds, E->bounds);
+			A->height = 1 + std::max(C->height, D->height);
+			B->height = 1 + std::max(A->height, E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
\ No newline at end of file
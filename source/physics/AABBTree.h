@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+
+#include "../PrecompiledHeader.h"
+
+struct Bounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	Bounds() {};
+	Bounds(glm::vec3 lo, glm::vec3 hi) : min(lo), max(hi) {};
+
+	glm::vec3 GetCenter() const { return 0.5f * (min + max); }
+	float GetSurfaceArea() const
+	{
+		glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+	bool Contains(const Bounds& other) const
+	{
+		return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+	}
+	bool Overlaps(const Bounds& other) const
+	{
+		return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+	}
+	static Bounds Union(const Bounds& a, const Bounds& b)
+	{
+		return Bounds(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+};
+
+// Slab test of the segment origin + t * dir, t in [0, maxT], against a box
+// invDir is 1 / dir per component, tEntry receives the parameter where the segment enters the box
+inline bool RayIntersectsBounds(glm::vec3 origin, glm::vec3 invDir, float maxT, const Bounds& bounds, float& tEntry)
+{
+	glm::vec3 t0 = (bounds.min - origin) * invDir;
+	glm::vec3 t1 = (bounds.max - origin) * invDir;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+	tEntry = enter;
+	return enter <= exit;
+}
+
+// Dynamic bounding volume tree over fat AABBs
+// Leaves hold bounds enlarged by a margin so small movements don't touch the tree,
+// insertion descends by the surface area heuristic and the tree is kept balanced with rotations
+class AABBTree
+{
+public:
+	static const int32_t c_nullNode = -1;
+
+	AABBTree(float margin = 0.1f);
+
+	int32_t Insert(const Bounds& bounds, void* userData);
+	void    Remove(int32_t proxy);
+	// Re-inserts the proxy when its bounds left the fat bounds, displacement stretches the new fat bounds ahead of the motion
+	// Returns true when the tree changed
+	bool    Move(int32_t proxy, const Bounds& bounds, glm::vec3 displacement);
+
+	void*         GetUserData(int32_t proxy) const { return nodes[proxy].userData; }
+	const Bounds& GetFatBounds(int32_t proxy) const { return nodes[proxy].bounds; }
+	int32_t       GetHeight() const { return root == c_nullNode ? 0 : nodes[root].height; }
+
+	// fn(proxy) for every leaf whose fat bounds overlap, return false from fn to stop early
+	template <typename Fn> void Query(const Bounds& bounds, Fn fn) const;
+	// fn(proxy, tEntry) for every leaf whose fat bounds the segment crosses, returns the new maxT (0 stops, maxT continues unclipped)
+	template <typename Fn> void RayCast(glm::vec3 origin, glm::vec3 dir, float maxT, Fn fn) const;
+	// fn(proxyA, proxyB) once for every pair of leaves with overlapping fat bounds
+	template <typename Fn> void QueryPairs(Fn fn) const;
+
+private:
+	struct Node
+	{
+		Bounds  bounds;
+		void*   userData;
+		// Parent in the tree, next free node while in the free list
+		int32_t parent;
+		int32_t child1;
+		int32_t child2;
+		// Leaf = 0, free = -1
+		int32_t height;
+
+		bool IsLeaf() const { return child1 == c_nullNode; }
+	};
+
+	// Traversal stack, balanced trees over any realistic collider count stay far below this depth
+	struct Stack
+	{
+		int32_t  items[256];
+		uint32_t count = 0;
+		void     Push(int32_t n) { if (count < 256) items[count++] = n; }
+		int32_t  Pop() { return items[--count]; }
+		bool     Empty() const { return count == 0; }
+	};
+
+	int32_t AllocateNode();
+	void    FreeNode(int32_t node);
+	void    InsertLeaf(int32_t leaf);
+	void    RemoveLeaf(int32_t leaf);
+	int32_t Balance(int32_t node);
+
+	std::vector<Node> nodes;
+	int32_t root;
+	int32_t freeList;
+	float   margin;
+};
+
+template <typename Fn>
+void AABBTree::Query(const Bounds& bounds, Fn fn) const
+{
+	Stack stack;
+	stack.Push(root);
+
+	while (!stack.Empty())
+	{
+		int32_t id = stack.Pop();
+		if (id == c_nullNode)
+			continue;
+
+		const Node& node = nodes[id];
+		if (!node.bounds.Overlaps(bounds))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (!fn(id))
+				return;
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+template <typename Fn>
+void AABBTree::RayCast(glm::vec3 origin, glm::vec3 dir, float maxT, Fn fn) const
+{
+	glm::vec3 invDir = 1.0f / dir;
+
+	Stack stack;
+	stack.Push(root);
+
+	while (!stack.Empty())
+	{
+		int32_t id = stack.Pop();
+		if (id == c_nullNode)
+			continue;
+
+		const Node& node = nodes[id];
+		float tEntry;
+		if (!RayIntersectsBounds(origin, invDir, maxT, node.bounds, tEntry))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			maxT = fn(id, tEntry);
+			if (maxT <= 0.0f)
+				return;
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+template <typename Fn>
+void AABBTree::QueryPairs(Fn fn) const
+{
+	for (int32_t id = 0; id < static_cast<int32_t>(nodes.size()); ++id)
+	{
+		if (nodes[id].height != 0)
+			continue;
+
+		Query(nodes[id].bounds, [&](int32_t other)
+		{
+			if (other > id)
+				fn(id, other);
+			return true;
+		});
+	}
+}
\ No newline at end of file
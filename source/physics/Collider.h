@@ -1,6 +1,10 @@
 #pragma once
 
 #include "../PrecompiledHeader.h"
+#include "SignedDistanceField.h"
+#include "SleepState.h"
+
+class RigidBody;
 
 enum ColliderType
 {
@@ -9,6 +13,7 @@ enum ColliderType
 	OOBB,
 	SPHERE,
 	SOFTBODY,
+	SDF,
 	COUNT
 };
 
@@ -16,6 +21,66 @@ struct Collider
 {
 	ColliderType colliderType;
 
+	// World bounds, all the broadphase sees of any type
 	glm::vec3 min;
 	glm::vec3 max;
+
+	// Shape for the narrowphase, SPHERE uses center and radius, OOBB center, halfExtents and orientation (local to world)
+	glm::vec3 center = glm::vec3(0);
+	float     radius = 0;
+	glm::vec3 halfExtents = glm::vec3(0);
+	glm::mat3 orientation = glm::mat3(1);
+	// Baked static mesh for SDF, shared and never owned by the collider
+	const SignedDistanceField* field = nullptr;
+
+	// Broadphase tree leaf, -1 while not registered with a PhysicsBackend
+	int32_t proxy = -1;
+	// Island the collider belongs to, nullptr for static geometry that never wakes anything
+	SleepState* sleep = nullptr;
+	// Body the collider moves with, nullptr for static geometry
+	RigidBody* body = nullptr;
+
+	// Set the shape along with the world bounds around it
+	void SetSphere(glm::vec3 c, float r)
+	{
+		colliderType = SPHERE;
+		center = c;
+		radius = r;
+		min = c - glm::vec3(r);
+		max = c + glm::vec3(r);
+	}
+
+	void SetBox(glm::vec3 boxMin, glm::vec3 boxMax)
+	{
+		colliderType = AABB;
+		center = 0.5f * (boxMin + boxMax);
+		halfExtents = 0.5f * (boxMax - boxMin);
+		orientation = glm::mat3(1);
+		min = boxMin;
+		max = boxMax;
+	}
+
+	void SetOrientedBox(glm::vec3 c, glm::vec3 extents, const glm::mat3& rotation)
+	{
+		colliderType = OOBB;
+		center = c;
+		halfExtents = extents;
+		orientation = rotation;
+		// Each world axis reaches as far as the rotated extents project onto it
+		glm::vec3 reach(0);
+		for (int axis = 0; axis < 3; ++axis)
+			reach += glm::abs(rotation[axis]) * extents[axis];
+		min = c - reach;
+		max = c + reach;
+	}
+
+	// The field's own grid is the bounds, it's already in world space
+	void SetSignedDistanceField(const SignedDistanceField* f)
+	{
+		colliderType = SDF;
+		field = f;
+		min = f->GetMin();
+		max = f->GetMax();
+		center = 0.5f * (min + max);
+	}
 };
\ No newline at end of file
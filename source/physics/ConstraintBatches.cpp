@@ -0,0 +1,77 @@
+#include "ConstraintBatches.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Colours tracked per particle as a bit mask
+static const uint32_t c_maxColors = 64;
+
+ConstraintBatches::ConstraintBatches()
+{
+	Clear();
+}
+
+void ConstraintBatches::Clear()
+{
+	constraints.clear();
+	colorStart.assign(1, 0);
+}
+
+void ColorEdges(const uint32_t* a, const uint32_t* b, size_t count, uint32_t numNodes,
+	std::vector<uint32_t>& order, std::vector<uint32_t>& colorStart)
+{
+	std::vector<uint64_t> usedColors(numNodes, 0);
+	std::vector<uint32_t> colorOf(count);
+	std::vector<uint32_t> colorCount(c_maxColors + 1, 0);
+	uint32_t numColors = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint64_t used = usedColors[a[i]] | usedColors[b[i]];
+		if (~used == 0)
+		{
+			throw std::runtime_error("constraint graph needs more colours than supported");
+		}
+
+		uint32_t color = 0;
+		while (used & (1ull << color))
+			++color;
+
+		colorOf[i] = color;
+		usedColors[a[i]] |= 1ull << color;
+		usedColors[b[i]] |= 1ull << color;
+		++colorCount[color + 1];
+		numColors = std::max(numColors, color + 1);
+	}
+
+	// Prefix sum into colour ranges, then scatter keeping the input order inside each colour
+	colorStart.assign(colorCount.begin(), colorCount.begin() + numColors + 1);
+	for (uint32_t c = 0; c < numColors; ++c)
+		colorStart[c + 1] += colorStart[c];
+
+	std::vector<uint32_t> cursor(colorStart.begin(), colorStart.end() - 1);
+	order.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		order[cursor[colorOf[i]]++] = static_cast<uint32_t>(i);
+	}
+}
+
+void ConstraintBatches::Build(const std::vector<DistanceConstraint>& input, uint32_t numParticles)
+{
+	std::vector<uint32_t> a(input.size()), b(input.size());
+	for (size_t i = 0; i < input.size(); ++i)
+	{
+		a[i] = input[i].a;
+		b[i] = input[i].b;
+	}
+
+	std::vector<uint32_t> order;
+	ColorEdges(a.data(), b.data(), input.size(), numParticles, order, colorStart);
+
+	constraints.resize(input.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		constraints[i] = input[order[i]];
+	}
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "../PrecompiledHeader.h"
+
+// Greedy edge colouring, every edge takes the lowest colour neither of its nodes is in yet
+// order lists the edge indices colour by colour, colour c owning [colorStart[c], colorStart[c + 1]), input order kept within a colour
+void ColorEdges(const uint32_t* a, const uint32_t* b, size_t count, uint32_t numNodes,
+	std::vector<uint32_t>& order, std::vector<uint32_t>& colorStart);
+
+struct DistanceConstraint
+{
+	uint32_t a, b;
+	float    restLength;
+	// Inverse stiffness of the spring it stands in for
+	float    compliance;
+};
+
+// Distance constraints grouped by graph colour
+// No two constraints of one colour share a particle, so a colour can be solved in parallel without atomics
+class ConstraintBatches
+{
+public:
+	ConstraintBatches();
+
+	void Build(const std::vector<DistanceConstraint>& constraints, uint32_t numParticles);
+	void Clear();
+
+	uint32_t GetNumConstraints() const { return static_cast<uint32_t>(constraints.size()); }
+	uint32_t GetNumColors() const { return static_cast<uint32_t>(colorStart.size()) - 1; }
+	// Constraints of colour c are [GetColorBegin(c), GetColorEnd(c))
+	uint32_t GetColorBegin(uint32_t c) const { return colorStart[c]; }
+	uint32_t GetColorEnd(uint32_t c) const { return colorStart[c + 1]; }
+
+	// Sorted by colour
+	const DistanceConstraint* GetConstraints() const { return constraints.data(); }
+
+private:
+	std::vector<DistanceConstraint> constraints;
+	std::vector<uint32_t>           colorStart;
+};
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include "ContactSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Fraction of the penetration the position pass removes per iteration
+static const float c_baumgarte = 0.2f;
+// Largest push the position pass gives one point per iteration, so deep overlaps come apart over a few steps
+static const float c_maxCorrection = 0.2f;
+// Penetration left alone so resting contacts don't jitter in and out of touch
+static const float c_linearSlop = 0.005f;
+// How far an anchor may drift in a step and still count as the same contact
+static const float c_matchDistance = 0.02f;
+
+static uint64_t PairKey(const Collider* a, const Collider* b)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(a->proxy)) << 32) | static_cast<uint32_t>(b->proxy);
+}
+
+// Point in the collider's frame, its body's pose when it has one
+static glm::vec3 ToLocal(const Collider* collider, glm::vec3 point)
+{
+	if (collider->body)
+		return glm::conjugate(collider->body->orientation) * (point - collider->body->position);
+	return glm::transpose(collider->orientation) * (point - collider->center);
+}
+
+static void TangentBasis(glm::vec3 n, glm::vec3 tangents[2])
+{
+	glm::vec3 t = fabsf(n.x) > 0.57735f ? glm::vec3(n.y, -n.x, 0) : glm::vec3(0, n.z, -n.y);
+	tangents[0] = glm::normalize(t);
+	tangents[1] = glm::cross(n, tangents[0]);
+}
+
+// Point fixed to the collider, anchored by its body when it has one
+static glm::vec3 ToWorld(const Collider* collider, glm::vec3 local)
+{
+	if (collider->body)
+		return collider->body->position + collider->body->orientation * local;
+	return collider->center + collider->orientation * local;
+}
+
+static void ApplyPositionImpulse(RigidBody* body, const glm::mat3& invInertia, glm::vec3 r, glm::vec3 impulse)
+{
+	if (body == nullptr || body->invMass <= 0.0f)
+		return;
+	body->position += body->invMass * impulse;
+	glm::vec3 rotation = invInertia * glm::cross(r, impulse);
+	body->orientation += 0.5f * (glm::quat(0, rotation.x, rotation.y, rotation.z) * body->orientation);
+	body->orientation = glm::normalize(body->orientation);
+}
+
+static void ApplyImpulse(RigidBody* body, const glm::mat3& invInertia, glm::vec3 r, glm::vec3 impulse)
+{
+	if (body == nullptr)
+		return;
+	body->velocity += body->invMass * impulse;
+	body->angularVelocity += invInertia * glm::cross(r, impulse);
+}
+
+static void ApplyTwist(RigidBody* body, const glm::mat3& invInertia, glm::vec3 angularImpulse)
+{
+	if (body)
+		body->angularVelocity += invInertia * angularImpulse;
+}
+
+ContactSolver::ContactSolver()
+{
+	iterations = 8;
+	positionIterations = 3;
+	warmStarting = true;
+}
+
+void ContactSolver::UpdateManifold(Collider* a, Collider* b, const ContactSet& contacts, uint64_t step)
+{
+	ContactManifold& manifold = manifolds[PairKey(a, b)];
+	ContactManifold previous = manifold;
+	manifold = ContactManifold();
+
+	manifold.a = a;
+	manifold.b = b;
+	manifold.normal = contacts.normal;
+	TangentBasis(contacts.normal, manifold.tangents);
+	manifold.friction = sqrtf((a->body ? a->body->friction : 0.5f) * (b->body ? b->body->friction : 0.5f));
+	manifold.lastStep = step;
+	manifold.count = contacts.count;
+
+	bool matched[ContactSet::c_maxPoints] = {};
+	for (uint32_t i = 0; i < contacts.count; ++i)
+	{
+		ManifoldPoint& point = manifold.points[i];
+		point = ManifoldPoint();
+		point.position = contacts.points[i];
+		point.depth = contacts.depths[i];
+		point.localA = ToLocal(a, point.position);
+		point.localB = ToLocal(b, point.position);
+
+		// Closest unclaimed point of last step, by the farther of its two anchors
+		int match = -1;
+		float best = c_matchDistance * c_matchDistance;
+		for (uint32_t j = 0; j < previous.count; ++j)
+		{
+			if (matched[j])
+				continue;
+			glm::vec3 da = previous.points[j].localA - point.localA;
+			glm::vec3 db = previous.points[j].localB - point.localB;
+			float dist2 = std::max(glm::dot(da, da), glm::dot(db, db));
+			if (dist2 < best)
+			{
+				best = dist2;
+				match = static_cast<int>(j);
+			}
+		}
+
+		if (match >= 0)
+		{
+			matched[match] = true;
+			point.normalImpulse = previous.points[match].normalImpulse;
+		}
+	}
+
+	// Friction carries over while any point does, the tangents follow the normal so they barely turn between steps
+	for (uint32_t j = 0; j < previous.count; ++j)
+	{
+		if (matched[j])
+		{
+			manifold.tangentImpulse[0] = glm::dot(previous.tangentImpulse[0] * previous.tangents[0]
+				+ previous.tangentImpulse[1] * previous.tangents[1], manifold.tangents[0]);
+			manifold.tangentImpulse[1] = glm::dot(previous.tangentImpulse[0] * previous.tangents[0]
+				+ previous.tangentImpulse[1] * previous.tangents[1], manifold.tangents[1]);
+			manifold.twistImpulse = previous.twistImpulse;
+			break;
+		}
+	}
+}
+
+void ContactSolver::KeepManifold(const Collider* a, const Collider* b, uint64_t step)
+{
+	std::map<uint64_t, ContactManifold>::iterator it = manifolds.find(PairKey(a, b));
+	if (it != manifolds.end())
+		it->second.lastStep = step;
+}
+
+void ContactSolver::RemoveStale(uint64_t step)
+{
+	for (std::map<uint64_t, ContactManifold>::iterator it = manifolds.begin(); it != manifolds.end();)
+	{
+		if (it->second.lastStep != step)
+			it = manifolds.erase(it);
+		else
+			++it;
+	}
+}
+
+void ContactSolver::RemoveCollider(const Collider* collider)
+{
+	for (std::map<uint64_t, ContactManifold>::iterator it = manifolds.begin(); it != manifolds.end();)
+	{
+		if (it->second.a == collider || it->second.b == collider)
+			it = manifolds.erase(it);
+		else
+			++it;
+	}
+}
+
+void ContactSolver::SaveManifolds(std::vector<ContactManifold>& saved) const
+{
+	saved.clear();
+	for (auto& entry : manifolds)
+		saved.push_back(entry.second);
+}
+
+void ContactSolver::RestoreManifolds(const std::vector<ContactManifold>& saved)
+{
+	manifolds.clear();
+	active.clear();
+	// Saved in key order, so every insert lands at the end
+	for (const ContactManifold& manifold : saved)
+		manifolds.insert(manifolds.end(), std::make_pair(PairKey(manifold.a, manifold.b), manifold));
+}
+
+uint32_t ContactSolver::GetContactCount() const
+{
+	uint32_t count = 0;
+	for (auto& entry : manifolds)
+		count += entry.second.count;
+	return count;
+}
+
+void ContactSolver::Solve(float dt)
+{
+	active.clear();
+	if (manifolds.empty() || dt <= 0.0f)
+		return;
+
+	for (auto& entry : manifolds)
+	{
+		if (IsActive(entry.second))
+			active.push_back(&entry.second);
+	}
+
+	float invDt = 1.0f / dt;
+	for (ContactManifold* manifold : active)
+		PrepareManifold(*manifold, invDt);
+
+	for (uint32_t i = 0; i < iterations; ++i)
+	{
+		for (ContactManifold* manifold : active)
+			SolveManifold(*manifold);
+	}
+}
+
+void ContactSolver::SolvePositions()
+{
+	for (uint32_t i = 0; i < positionIterations; ++i)
+	{
+		for (ContactManifold* manifold : active)
+		{
+			RigidBody* bodyA = manifold->a->body;
+			RigidBody* bodyB = manifold->b->body;
+			float invMassA = bodyA ? bodyA->invMass : 0.0f;
+			float invMassB = bodyB ? bodyB->invMass : 0.0f;
+
+			for (uint32_t p = 0; p < manifold->count; ++p)
+			{
+				const ManifoldPoint& point = manifold->points[p];
+
+				// Both anchors coincided at the depth found by the narrowphase, how far they moved apart since reduces it
+				glm::vec3 anchorA = ToWorld(manifold->a, point.localA);
+				glm::vec3 anchorB = ToWorld(manifold->b, point.localB);
+				float separation = glm::dot(anchorB - anchorA, manifold->normal) - point.depth;
+				float correction = glm::clamp(c_baumgarte * (separation + c_linearSlop), -c_maxCorrection, 0.0f);
+				if (correction >= 0.0f)
+					continue;
+
+				glm::vec3 contact = 0.5f * (anchorA + anchorB);
+				glm::vec3 rA = contact - (bodyA ? bodyA->position : manifold->a->center);
+				glm::vec3 rB = contact - (bodyB ? bodyB->position : manifold->b->center);
+				glm::vec3 angular = glm::cross(manifold->invInertiaA * glm::cross(rA, manifold->normal), rA)
+					+ glm::cross(manifold->invInertiaB * glm::cross(rB, manifold->normal), rB);
+				float k = invMassA + invMassB + glm::dot(angular, manifold->normal);
+				if (k <= 0.0f)
+					continue;
+
+				glm::vec3 impulse = (-correction / k) * manifold->normal;
+				ApplyPositionImpulse(bodyA, manifold->invInertiaA, rA, -impulse);
+				ApplyPositionImpulse(bodyB, manifold->invInertiaB, rB, impulse);
+			}
+		}
+	}
+}
+
+bool ContactSolver::IsActive(const ContactManifold& manifold)
+{
+	const RigidBody* bodies[2] = { manifold.a->body, manifold.b->body };
+	for (const RigidBody* body : bodies)
+	{
+		if (body && body->invMass > 0.0f && !body->IsAsleep())
+			return true;
+	}
+	return false;
+}
+
+void ContactSolver::PrepareManifold(ContactManifold& manifold, float invDt)
+{
+	RigidBody* bodyA = manifold.a->body;
+	RigidBody* bodyB = manifold.b->body;
+	float invMassA = bodyA ? bodyA->invMass : 0.0f;
+	float invMassB = bodyB ? bodyB->invMass : 0.0f;
+	manifold.invInertiaA = bodyA ? bodyA->GetInvInertiaWorld() : glm::mat3(0);
+	manifold.invInertiaB = bodyB ? bodyB->GetInvInertiaWorld() : glm::mat3(0);
+	glm::vec3 centerA = bodyA ? bodyA->position : manifold.a->center;
+	glm::vec3 centerB = bodyB ? bodyB->position : manifold.b->center;
+
+	// Effective mass along a direction d at offsets rA and rB, 1 / (mA + mB + d . ((IA^-1 (rA x d)) x rA + (IB^-1 (rB x d)) x rB))
+	auto effectiveMass = [&](glm::vec3 rA, glm::vec3 rB, glm::vec3 d)
+	{
+		glm::vec3 angular = glm::cross(manifold.invInertiaA * glm::cross(rA, d), rA)
+			+ glm::cross(manifold.invInertiaB * glm::cross(rB, d), rB);
+		float k = invMassA + invMassB + glm::dot(angular, d);
+		return k > 0.0f ? 1.0f / k : 0.0f;
+	};
+
+	manifold.center = glm::vec3(0);
+	for (uint32_t i = 0; i < manifold.count; ++i)
+		manifold.center += manifold.points[i].position / static_cast<float>(manifold.count);
+	manifold.rA = manifold.center - centerA;
+	manifold.rB = manifold.center - centerB;
+	manifold.tangentMass[0] = effectiveMass(manifold.rA, manifold.rB, manifold.tangents[0]);
+	manifold.tangentMass[1] = effectiveMass(manifold.rA, manifold.rB, manifold.tangents[1]);
+	float twist = glm::dot(manifold.normal, (manifold.invInertiaA + manifold.invInertiaB) * manifold.normal);
+	manifold.twistMass = twist > 0.0f ? 1.0f / twist : 0.0f;
+	manifold.twistRadius = 0.0f;
+	for (uint32_t i = 0; i < manifold.count; ++i)
+		manifold.twistRadius += glm::length(manifold.points[i].position - manifold.center) / static_cast<float>(manifold.count);
+
+	for (uint32_t i = 0; i < manifold.count; ++i)
+	{
+		ManifoldPoint& point = manifold.points[i];
+		point.rA = point.position - centerA;
+		point.rB = point.position - centerB;
+		point.normalMass = effectiveMass(point.rA, point.rB, manifold.normal);
+		// A gap may close by no more than it is wide, penetration is left to the position pass
+		point.bias = std::min(point.depth, 0.0f) * invDt;
+	}
+
+	if (!warmStarting)
+	{
+		for (uint32_t i = 0; i < manifold.count; ++i)
+			manifold.points[i].normalImpulse = 0;
+		manifold.tangentImpulse[0] = manifold.tangentImpulse[1] = manifold.twistImpulse = 0;
+		return;
+	}
+
+	// Last step's impulses as the starting guess
+	for (uint32_t i = 0; i < manifold.count; ++i)
+	{
+		ManifoldPoint& point = manifold.points[i];
+		ApplyImpulse(bodyA, manifold.invInertiaA, point.rA, -point.normalImpulse * manifold.normal);
+		ApplyImpulse(bodyB, manifold.invInertiaB, point.rB, point.normalImpulse * manifold.normal);
+	}
+	glm::vec3 friction = manifold.tangentImpulse[0] * manifold.tangents[0] + manifold.tangentImpulse[1] * manifold.tangents[1];
+	ApplyImpulse(bodyA, manifold.invInertiaA, manifold.rA, -friction);
+	ApplyImpulse(bodyB, manifold.invInertiaB, manifold.rB, friction);
+	ApplyTwist(bodyA, manifold.invInertiaA, -manifold.twistImpulse * manifold.normal);
+	ApplyTwist(bodyB, manifold.invInertiaB, manifold.twistImpulse * manifold.normal);
+}
+
+void ContactSolver::SolveManifold(ContactManifold& manifold)
+{
+	RigidBody* bodyA = manifold.a->body;
+	RigidBody* bodyB = manifold.b->body;
+	auto relativeVelocity = [&](glm::vec3 point)
+	{
+		return (bodyB ? bodyB->GetPointVelocity(point) : glm::vec3(0)) - (bodyA ? bodyA->GetPointVelocity(point) : glm::vec3(0));
+	};
+
+	// Friction first, the normal impulses solved after it are the ones that matter most
+	float normalImpulse = 0;
+	for (uint32_t i = 0; i < manifold.count; ++i)
+		normalImpulse += manifold.points[i].normalImpulse;
+	float maxFriction = manifold.friction * normalImpulse;
+
+	for (int t = 0; t < 2; ++t)
+	{
+		float lambda = -manifold.tangentMass[t] * glm::dot(relativeVelocity(manifold.center), manifold.tangents[t]);
+		float accumulated = glm::clamp(manifold.tangentImpulse[t] + lambda, -maxFriction, maxFriction);
+		lambda = accumulated - manifold.tangentImpulse[t];
+		manifold.tangentImpulse[t] = accumulated;
+
+		glm::vec3 impulse = lambda * manifold.tangents[t];
+		ApplyImpulse(bodyA, manifold.invInertiaA, manifold.rA, -impulse);
+		ApplyImpulse(bodyB, manifold.invInertiaB, manifold.rB, impulse);
+	}
+
+	glm::vec3 spinA = bodyA ? bodyA->angularVelocity : glm::vec3(0);
+	glm::vec3 spinB = bodyB ? bodyB->angularVelocity : glm::vec3(0);
+	float maxTwist = maxFriction * manifold.twistRadius;
+	float lambda = -manifold.twistMass * glm::dot(spinB - spinA, manifold.normal);
+	float accumulated = glm::clamp(manifold.twistImpulse + lambda, -maxTwist, maxTwist);
+	lambda = accumulated - manifold.twistImpulse;
+	manifold.twistImpulse = accumulated;
+	ApplyTwist(bodyA, manifold.invInertiaA, -lambda * manifold.normal);
+	ApplyTwist(bodyB, manifold.invInertiaB, lambda * manifold.normal);
+
+	// Normal impulses, the accumulated total may only push
+	for (uint32_t i = 0; i < manifold.count; ++i)
+	{
+		ManifoldPoint& point = manifold.points[i];
+		float lambda = point.normalMass * (point.bias - glm::dot(relativeVelocity(point.position), manifold.normal));
+		float accumulated = std::max(point.normalImpulse + lambda, 0.0f);
+		lambda = accumulated - point.normalImpulse;
+		point.normalImpulse = accumulated;
+
+		glm::vec3 impulse = lambda * manifold.normal;
+		ApplyImpulse(bodyA, manifold.invInertiaA, point.rA, -impulse);
+		ApplyImpulse(bodyB, manifold.invInertiaB, point.rB, impulse);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+#include <map>
+#include "Collider.h"
+#include "Narrowphase.h"
+#include "RigidBody.h"
+
+struct ManifoldPoint
+{
+	// Anchors in either collider's frame, a point whose anchors stay put from one step to the next is the same contact
+	glm::vec3 localA;
+	glm::vec3 localB;
+	glm::vec3 position;
+	float     depth;
+
+	// Accumulated impulse, carried into the next step to warm start it
+	float normalImpulse = 0;
+
+	// Set up at the start of every solve
+	glm::vec3 rA, rB;
+	float     normalMass;
+	float     bias;
+};
+
+// Contact points of one collider pair, kept for as long as the pair stays touching
+struct ContactManifold
+{
+	Collider* a;
+	Collider* b;
+	// From a to b, with two tangents for friction
+	glm::vec3 normal;
+	glm::vec3 tangents[2];
+	float     friction;
+
+	uint32_t      count = 0;
+	ManifoldPoint points[ContactSet::c_maxPoints];
+	// Step the pair was last found touching
+	uint64_t      lastStep = 0;
+
+	// Friction acts once at the center of the points, sliding along both tangents and twisting about the normal,
+	// bounded by the total normal impulse, which unlike the split between the points is well determined
+	float tangentImpulse[2] = { 0, 0 };
+	float twistImpulse = 0;
+
+	// Set up at the start of every solve
+	glm::mat3 invInertiaA;
+	glm::mat3 invInertiaB;
+	glm::vec3 center, rA, rB;
+	float     tangentMass[2];
+	float     twistMass;
+	// Average distance of the points from the center, turns the friction bound into a twist bound
+	float     twistRadius;
+};
+
+// Sequential impulse solver over persistent contact manifolds
+// Manifolds are keyed by the broadphase proxies of the pair, so the impulses of a contact that persists
+// survive into the next step and the iterations start from last step's answer
+class ContactSolver
+{
+public:
+	ContactSolver();
+
+	void SetIterations(uint32_t count) { iterations = count; }
+	void SetPositionIterations(uint32_t count) { positionIterations = count; }
+	void SetWarmStarting(bool enabled) { warmStarting = enabled; }
+
+	// Replaces the pair's points with the new contacts, carrying over the impulses of the ones that match
+	// a has to be the collider with the lower broadphase proxy
+	void UpdateManifold(Collider* a, Collider* b, const ContactSet& contacts, uint64_t step);
+	// Keeps a resting pair's manifold, impulses included, through steps where nothing about it is computed
+	void KeepManifold(const Collider* a, const Collider* b, uint64_t step);
+	// Drops the manifolds of pairs not found touching on the given step
+	void RemoveStale(uint64_t step);
+	void RemoveCollider(const Collider* collider);
+	// Copies of the current manifolds, impulses included, so a restored state warm starts exactly as it first did
+	// Restoring needs every collider the copies point to still registered
+	void SaveManifolds(std::vector<ContactManifold>& saved) const;
+	void RestoreManifolds(const std::vector<ContactManifold>& saved);
+
+	// Solves the velocities of the bodies in the current manifolds, manifolds with nothing awake to move are left alone
+	void Solve(float dt);
+	// Once the bodies moved, pushes apart what still overlaps by moving the bodies themselves, which unlike
+	// feeding the penetration back into the velocities adds no energy, so tall stacks don't start to rock
+	void SolvePositions();
+
+	size_t   GetManifoldCount() const { return manifolds.size(); }
+	uint32_t GetContactCount() const;
+
+private:
+	static bool IsActive(const ContactManifold& manifold);
+	void PrepareManifold(ContactManifold& manifold, float invDt);
+	void SolveManifold(ContactManifold& manifold);
+
+	uint32_t iterations;
+	uint32_t positionIterations;
+	bool     warmStarting;
+
+	// Ordered so the solve order, and with it the result, doesn't depend on pointer values
+	std::map<uint64_t, ContactManifold> manifolds;
+	std::vector<ContactManifold*> active;
+};
\ No newline at end of file
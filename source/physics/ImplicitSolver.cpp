@@ -0,0 +1,406 @@
+#include "ImplicitSolver.h"
+#include "SpringKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef FORNAX_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+// Nodes per reduction block
+static const uint32_t c_blockSize = 2048;
+
+void ImplicitSolver::Field::Resize(uint32_t count, uint32_t guard)
+{
+	float** pointers[3] = { &x, &y, &z };
+	for (int c = 0; c < 3; ++c)
+	{
+		storage[c].assign(count + 2 * guard, 0.0f);
+		*pointers[c] = storage[c].data() + guard;
+	}
+}
+
+void ImplicitSolver::SpringField::Resize(uint32_t count, uint32_t guard)
+{
+	float** pointers[6] = { &a, &b, &nx, &ny, &nz, &force };
+	for (int c = 0; c < 6; ++c)
+	{
+		storage[c].assign(count + 2 * guard, 0.0f);
+		*pointers[c] = storage[c].data() + guard;
+	}
+}
+
+ImplicitSolver::ImplicitSolver()
+{
+	maxIterations = 32;
+	tolerance = 1e-4f;
+	lastIterations = 0;
+	lastResidual = 0.0f;
+
+	count = 0;
+	stride = 0;
+	mass = mask = nullptr;
+}
+
+void ImplicitSolver::SetIterations(uint32_t iterations, float tol)
+{
+	maxIterations = iterations;
+	tolerance = tol;
+}
+
+void ImplicitSolver::Resize(uint32_t numNodes, int dimensionsX)
+{
+	if (numNodes == count && dimensionsX == stride)
+		return;
+
+	count = numNodes;
+	stride = dimensionsX;
+
+	// A row plus one node either side covers every stencil read
+	uint32_t guard = dimensionsX + 1;
+	right.Resize(count, guard);
+	down.Resize(count, guard);
+
+	massStorage.assign(count + 2 * guard, 0.0f);
+	maskStorage.assign(count + 2 * guard, 0.0f);
+	mass = massStorage.data() + guard;
+	mask = maskStorage.data() + guard;
+
+	Field* fields[] = { &invDiagonal, &rhs, &velocity, &solution, &residual, &preconditioned, &direction, &product };
+	for (Field* field : fields)
+		field->Resize(count, guard);
+
+	blockSums.resize(2 * ((count + c_blockSize - 1) / c_blockSize));
+}
+
+void ImplicitSolver::ForBlocks(WorkerPool* pool, const BlockJob& job, double* sums)
+{
+	uint32_t numBlocks = (count + c_blockSize - 1) / c_blockSize;
+
+	auto blocks = [&](uint32_t first, uint32_t last)
+	{
+		for (uint32_t block = first; block < last; ++block)
+		{
+			double* blockSum = &blockSums[2 * block];
+			blockSum[0] = blockSum[1] = 0.0;
+			job(block * c_blockSize, std::min(count, (block + 1) * c_blockSize), blockSum);
+		}
+	};
+
+	if (pool)
+		pool->ParallelFor(numBlocks, blocks);
+	else
+		blocks(0, numBlocks);
+
+	sums[0] = sums[1] = 0.0;
+	for (uint32_t block = 0; block < numBlocks; ++block)
+	{
+		sums[0] += blockSums[2 * block];
+		sums[1] += blockSums[2 * block + 1];
+	}
+}
+
+void ImplicitSolver::BuildSprings(const ParticleStore& particles, const ImplicitStepParams& params, float dt, uint32_t begin, uint32_t end)
+{
+	const int X = params.dimensionsX;
+	const int Y = params.dimensionsY;
+	const float k = params.coefficient;
+
+	for (uint32_t n = begin; n < end; ++n)
+	{
+		int i = n / X;
+		int j = n % X;
+
+		SpringField* springs[2] = { &right, &down };
+		bool exists[2] = { j < X - 1, i < Y - 1 };
+		uint32_t neighbour[2] = { n + 1, n + X };
+		float rest[2] = { params.restWidth, params.restHeight };
+
+		for (int s = 0; s < 2; ++s)
+		{
+			SpringField& spring = *springs[s];
+			if (!exists[s])
+			{
+				spring.a[n] = spring.b[n] = spring.force[n] = 0.0f;
+				spring.nx[n] = spring.ny[n] = spring.nz[n] = 0.0f;
+				continue;
+			}
+
+			float dx = particles.px[neighbour[s]] - particles.px[n];
+			float dy = particles.py[neighbour[s]] - particles.py[n];
+			float dz = particles.pz[neighbour[s]] - particles.pz[n];
+			float length = sqrtf(dx * dx + dy * dy + dz * dz);
+			float invLength = length > 1e-9f ? 1.0f / length : 0.0f;
+
+			// The transverse part is dropped while compressed, which keeps the system positive definite
+			float transverse = std::max(0.0f, 1.0f - rest[s] * invLength);
+			spring.a[n] = k * transverse;
+			spring.b[n] = k * (1.0f - transverse);
+			spring.nx[n] = dx * invLength;
+			spring.ny[n] = dy * invLength;
+			spring.nz[n] = dz * invLength;
+			spring.force[n] = k * (length - rest[s]);
+		}
+
+		// Every existing spring damps the node, as on the explicit path
+		int numSprings = (i > 0) + (i < Y - 1) + (j > 0) + (j < X - 1);
+		bool isFree = particles.invMass[n] > 0.0f;
+		mask[n] = isFree ? 1.0f : 0.0f;
+		mass[n] = isFree ? 1.0f / particles.invMass[n] + dt * numSprings * params.dampening : 0.0f;
+
+		velocity.x[n] = particles.vx[n];
+		velocity.y[n] = particles.vy[n];
+		velocity.z[n] = particles.vz[n];
+	}
+}
+
+// Linearised stiffness of one spring applied to the difference between the node and its neighbour
+static inline void SpringTerm(float a, float b, float nx, float ny, float nz, float dx, float dy, float dz, float& sx, float& sy, float& sz)
+{
+	float nd = nx * dx + ny * dy + nz * dz;
+	sx += a * dx + b * nx * nd;
+	sy += a * dy + b * ny * nd;
+	sz += a * dz + b * nz * nd;
+}
+
+#ifdef FORNAX_SIMD_X86
+static inline void SpringTermSSE(const float* a, const float* b, const float* nx, const float* ny, const float* nz,
+	__m128 dx, __m128 dy, __m128 dz, __m128& sx, __m128& sy, __m128& sz)
+{
+	__m128 vnx = _mm_loadu_ps(nx);
+	__m128 vny = _mm_loadu_ps(ny);
+	__m128 vnz = _mm_loadu_ps(nz);
+	__m128 va = _mm_loadu_ps(a);
+	__m128 bnd = _mm_mul_ps(_mm_loadu_ps(b), _mm_add_ps(_mm_add_ps(_mm_mul_ps(vnx, dx), _mm_mul_ps(vny, dy)), _mm_mul_ps(vnz, dz)));
+
+	sx = _mm_add_ps(sx, _mm_add_ps(_mm_mul_ps(va, dx), _mm_mul_ps(bnd, vnx)));
+	sy = _mm_add_ps(sy, _mm_add_ps(_mm_mul_ps(va, dy), _mm_mul_ps(bnd, vny)));
+	sz = _mm_add_ps(sz, _mm_add_ps(_mm_mul_ps(va, dz), _mm_mul_ps(bnd, vnz)));
+}
+#endif
+
+void ImplicitSolver::Apply(const Field& in, Field& out, float diagonalWeight, float stencilWeight, uint32_t begin, uint32_t end)
+{
+	const int X = stride;
+	const SpringField& r = right;
+	const SpringField& d = down;
+
+	uint32_t n = begin;
+
+#ifdef FORNAX_SIMD_X86
+	// The guard cells hold zero springs, so border nodes go through the same four neighbour stencil
+	const __m128 wDiagonal = _mm_set1_ps(diagonalWeight);
+	const __m128 wStencil = _mm_set1_ps(stencilWeight);
+	for (; n + 4 <= end; n += 4)
+	{
+		__m128 x = _mm_loadu_ps(in.x + n);
+		__m128 y = _mm_loadu_ps(in.y + n);
+		__m128 z = _mm_loadu_ps(in.z + n);
+		__m128 sx = _mm_setzero_ps();
+		__m128 sy = _mm_setzero_ps();
+		__m128 sz = _mm_setzero_ps();
+
+		SpringTermSSE(r.a + n, r.b + n, r.nx + n, r.ny + n, r.nz + n,
+			_mm_sub_ps(x, _mm_loadu_ps(in.x + n + 1)), _mm_sub_ps(y, _mm_loadu_ps(in.y + n + 1)), _mm_sub_ps(z, _mm_loadu_ps(in.z + n + 1)), sx, sy, sz);
+		SpringTermSSE(r.a + n - 1, r.b + n - 1, r.nx + n - 1, r.ny + n - 1, r.nz + n - 1,
+			_mm_sub_ps(x, _mm_loadu_ps(in.x + n - 1)), _mm_sub_ps(y, _mm_loadu_ps(in.y + n - 1)), _mm_sub_ps(z, _mm_loadu_ps(in.z + n - 1)), sx, sy, sz);
+		SpringTermSSE(d.a + n, d.b + n, d.nx + n, d.ny + n, d.nz + n,
+			_mm_sub_ps(x, _mm_loadu_ps(in.x + n + X)), _mm_sub_ps(y, _mm_loadu_ps(in.y + n + X)), _mm_sub_ps(z, _mm_loadu_ps(in.z + n + X)), sx, sy, sz);
+		SpringTermSSE(d.a + n - X, d.b + n - X, d.nx + n - X, d.ny + n - X, d.nz + n - X,
+			_mm_sub_ps(x, _mm_loadu_ps(in.x + n - X)), _mm_sub_ps(y, _mm_loadu_ps(in.y + n - X)), _mm_sub_ps(z, _mm_loadu_ps(in.z + n - X)), sx, sy, sz);
+
+		__m128 m = _mm_mul_ps(wDiagonal, _mm_loadu_ps(mass + n));
+		__m128 freeMask = _mm_loadu_ps(mask + n);
+		_mm_storeu_ps(out.x + n, _mm_mul_ps(freeMask, _mm_add_ps(_mm_mul_ps(m, x), _mm_mul_ps(wStencil, sx))));
+		_mm_storeu_ps(out.y + n, _mm_mul_ps(freeMask, _mm_add_ps(_mm_mul_ps(m, y), _mm_mul_ps(wStencil, sy))));
+		_mm_storeu_ps(out.z + n, _mm_mul_ps(freeMask, _mm_add_ps(_mm_mul_ps(m, z), _mm_mul_ps(wStencil, sz))));
+	}
+#endif
+
+	for (; n < end; ++n)
+	{
+		// Signed, the owners and neighbours of the first row reach into the guard cells
+		int node = static_cast<int>(n);
+		float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+		int owners[4] = { node, node - 1, node, node - X };
+		int neighbours[4] = { node + 1, node - 1, node + X, node - X };
+		const SpringField* springs[4] = { &r, &r, &d, &d };
+
+		for (int s = 0; s < 4; ++s)
+		{
+			const SpringField& spring = *springs[s];
+			int o = owners[s];
+			int m = neighbours[s];
+			SpringTerm(spring.a[o], spring.b[o], spring.nx[o], spring.ny[o], spring.nz[o],
+				in.x[n] - in.x[m], in.y[n] - in.y[m], in.z[n] - in.z[m], sx, sy, sz);
+		}
+
+		float m = diagonalWeight * mass[n];
+		out.x[n] = mask[n] * (m * in.x[n] + stencilWeight * sx);
+		out.y[n] = mask[n] * (m * in.y[n] + stencilWeight * sy);
+		out.z[n] = mask[n] * (m * in.z[n] + stencilWeight * sz);
+	}
+}
+
+void ImplicitSolver::BuildSystem(const ParticleStore& particles, const ImplicitStepParams& params, float dt, uint32_t begin, uint32_t end)
+{
+	const int X = params.dimensionsX;
+	const int Y = params.dimensionsY;
+	const float dt2 = dt * dt;
+
+	// K v for the right hand side
+	Apply(velocity, product, 0.0f, 1.0f, begin, end);
+
+	for (uint32_t n = begin; n < end; ++n)
+	{
+		int node = static_cast<int>(n);
+		int i = node / X;
+		int j = node % X;
+
+		// Springs pull the owner along n and the neighbour against it
+		glm::vec3 f = glm::vec3(particles.fx[n], particles.fy[n], particles.fz[n]);
+		f += right.force[n] * glm::vec3(right.nx[n], right.ny[n], right.nz[n]);
+		f -= right.force[node - 1] * glm::vec3(right.nx[node - 1], right.ny[node - 1], right.nz[node - 1]);
+		f += down.force[n] * glm::vec3(down.nx[n], down.ny[n], down.nz[n]);
+		f -= down.force[node - X] * glm::vec3(down.nx[node - X], down.ny[node - X], down.nz[node - X]);
+
+		int missing = (i == 0) + (i == Y - 1) + (j == 0) + (j == X - 1);
+		int numSprings = 4 - missing;
+		f += static_cast<float>(missing) * params.externalForce;
+		f -= static_cast<float>(numSprings) * params.dampening * glm::vec3(velocity.x[n], velocity.y[n], velocity.z[n]);
+
+		rhs.x[n] = mask[n] * dt * (f.x - dt * product.x[n]);
+		rhs.y[n] = mask[n] * dt * (f.y - dt * product.y[n]);
+		rhs.z[n] = mask[n] * dt * (f.z - dt * product.z[n]);
+
+		// Jacobi preconditioner, the diagonal of every spring block is a + b n_c^2
+		glm::vec3 diagonal(mass[n]);
+		int owners[4] = { node, node - 1, node, node - X };
+		const SpringField* springs[4] = { &right, &right, &down, &down };
+		for (int s = 0; s < 4; ++s)
+		{
+			const SpringField& spring = *springs[s];
+			int o = owners[s];
+			glm::vec3 normal(spring.nx[o], spring.ny[o], spring.nz[o]);
+			diagonal += dt2 * (glm::vec3(spring.a[o]) + spring.b[o] * normal * normal);
+		}
+
+		invDiagonal.x[n] = mask[n] > 0.0f ? 1.0f / diagonal.x : 0.0f;
+		invDiagonal.y[n] = mask[n] > 0.0f ? 1.0f / diagonal.y : 0.0f;
+		invDiagonal.z[n] = mask[n] > 0.0f ? 1.0f / diagonal.z : 0.0f;
+	}
+}
+
+float ImplicitSolver::Step(ParticleStore& particles, const ImplicitStepParams& params, float dt, WorkerPool* pool)
+{
+	Resize(particles.count, params.dimensionsX);
+
+	const float dt2 = dt * dt;
+	double sums[2];
+
+	ForBlocks(pool, [&](uint32_t begin, uint32_t end, double*)
+	{
+		BuildSprings(particles, params, dt, begin, end);
+	}, sums);
+
+	// Starting from dv = 0 the residual is the right hand side
+	ForBlocks(pool, [&](uint32_t begin, uint32_t end, double* blockSum)
+	{
+		BuildSystem(particles, params, dt, begin, end);
+		for (uint32_t n = begin; n < end; ++n)
+		{
+			solution.x[n] = solution.y[n] = solution.z[n] = 0.0f;
+			residual.x[n] = rhs.x[n]; residual.y[n] = rhs.y[n]; residual.z[n] = rhs.z[n];
+			preconditioned.x[n] = invDiagonal.x[n] * residual.x[n];
+			preconditioned.y[n] = invDiagonal.y[n] * residual.y[n];
+			preconditioned.z[n] = invDiagonal.z[n] * residual.z[n];
+			direction.x[n] = preconditioned.x[n]; direction.y[n] = preconditioned.y[n]; direction.z[n] = preconditioned.z[n];
+
+			blockSum[0] += residual.x[n] * preconditioned.x[n] + residual.y[n] * preconditioned.y[n] + residual.z[n] * preconditioned.z[n];
+			blockSum[1] += residual.x[n] * residual.x[n] + residual.y[n] * residual.y[n] + residual.z[n] * residual.z[n];
+		}
+	}, sums);
+
+	double rz = sums[0];
+	double rhsNorm2 = sums[1];
+	double residualNorm2 = rhsNorm2;
+	double threshold = static_cast<double>(tolerance) * tolerance * rhsNorm2;
+
+	uint32_t iteration = 0;
+	while (iteration < maxIterations && residualNorm2 > threshold)
+	{
+		// q = A p
+		ForBlocks(pool, [&](uint32_t begin, uint32_t end, double* blockSum)
+		{
+			Apply(direction, product, 1.0f, dt2, begin, end);
+			for (uint32_t n = begin; n < end; ++n)
+				blockSum[0] += direction.x[n] * product.x[n] + direction.y[n] * product.y[n] + direction.z[n] * product.z[n];
+		}, sums);
+
+		if (sums[0] <= 0.0)
+			break;
+		float alpha = static_cast<float>(rz / sums[0]);
+
+		ForBlocks(pool, [&](uint32_t begin, uint32_t end, double* blockSum)
+		{
+			for (uint32_t n = begin; n < end; ++n)
+			{
+				solution.x[n] += alpha * direction.x[n];
+				solution.y[n] += alpha * direction.y[n];
+				solution.z[n] += alpha * direction.z[n];
+				residual.x[n] -= alpha * product.x[n];
+				residual.y[n] -= alpha * product.y[n];
+				residual.z[n] -= alpha * product.z[n];
+				preconditioned.x[n] = invDiagonal.x[n] * residual.x[n];
+				preconditioned.y[n] = invDiagonal.y[n] * residual.y[n];
+				preconditioned.z[n] = invDiagonal.z[n] * residual.z[n];
+
+				blockSum[0] += residual.x[n] * preconditioned.x[n] + residual.y[n] * preconditioned.y[n] + residual.z[n] * preconditioned.z[n];
+				blockSum[1] += residual.x[n] * residual.x[n] + residual.y[n] * residual.y[n] + residual.z[n] * residual.z[n];
+			}
+		}, sums);
+
+		++iteration;
+		residualNorm2 = sums[1];
+		if (residualNorm2 <= threshold)
+			break;
+
+		float beta = static_cast<float>(sums[0] / rz);
+		rz = sums[0];
+
+		ForBlocks(pool, [&](uint32_t begin, uint32_t end, double*)
+		{
+			for (uint32_t n = begin; n < end; ++n)
+			{
+				direction.x[n] = preconditioned.x[n] + beta * direction.x[n];
+				direction.y[n] = preconditioned.y[n] + beta * direction.y[n];
+				direction.z[n] = preconditioned.z[n] + beta * direction.z[n];
+			}
+		}, sums);
+	}
+
+	lastIterations = iteration;
+	lastResidual = rhsNorm2 > 0.0 ? static_cast<float>(sqrt(residualNorm2 / rhsNorm2)) : 0.0f;
+
+	// v += dv, x += dt v into the back buffer
+	ForBlocks(pool, [&](uint32_t begin, uint32_t end, double* blockSum)
+	{
+		for (uint32_t n = begin; n < end; ++n)
+		{
+			particles.vx[n] += solution.x[n];
+			particles.vy[n] += solution.y[n];
+			particles.vz[n] += solution.z[n];
+
+			particles.prevX[n] = particles.px[n] + particles.vx[n] * dt;
+			particles.prevY[n] = particles.py[n] + particles.vy[n] * dt;
+			particles.prevZ[n] = particles.pz[n] + particles.vz[n] * dt;
+
+			particles.fx[n] = particles.fy[n] = particles.fz[n] = 0.0f;
+
+			blockSum[0] += 0.5f * (particles.vx[n] * particles.vx[n] + particles.vy[n] * particles.vy[n] + particles.vz[n] * particles.vz[n]);
+		}
+	}, sums);
+
+	return static_cast<float>(sums[0]);
+}
\ No newline at end of file
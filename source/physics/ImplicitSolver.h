@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "../PrecompiledHeader.h"
+#include "ParticleStore.h"
+#include "WorkerPool.h"
+
+// Lattice description the implicit step needs, nodes are row major as in SBLattice
+struct ImplicitStepParams
+{
+	int       dimensionsX, dimensionsY;
+	float     restWidth, restHeight;
+	float     coefficient;
+	float     dampening;
+	glm::vec3 externalForce;
+};
+
+// Backward Euler step for a grid lattice
+// Linearises the springs around the current state and solves (M + dt D + dt^2 K) dv = dt (f - dt K v)
+// with Jacobi preconditioned conjugate gradients, K is never assembled, every product walks the grid stencil
+class ImplicitSolver
+{
+public:
+	ImplicitSolver();
+
+	// Caps the conjugate gradient iterations and stops early once |r| <= tolerance * |b|
+	void SetIterations(uint32_t maxIterations, float tolerance);
+
+	// Writes the new positions into the back buffer and updates the velocities, the caller swaps the position sets
+	// Returns the summed kinetic energy per unit mass after the step
+	float Step(ParticleStore& particles, const ImplicitStepParams& params, float dt, WorkerPool* pool);
+
+	uint32_t GetLastIterations() const { return lastIterations; }
+	float    GetLastResidual() const { return lastResidual; }
+
+private:
+	// Three component vector over the nodes, padded with zeros a row and one node either side
+	// so the stencil reads of border nodes need no branches
+	struct Field
+	{
+		std::vector<float> storage[3];
+		float* x;
+		float* y;
+		float* z;
+
+		void Resize(uint32_t count, uint32_t guard);
+	};
+
+	// Per node spring to the right and spring below, zero where the neighbour doesn't exist
+	// The linearised stiffness of a spring applied to d is a * d + b * n (n . d), its force k (|d| - rest) along n
+	struct SpringField
+	{
+		std::vector<float> storage[6];
+		float *a, *b, *nx, *ny, *nz, *force;
+
+		void Resize(uint32_t count, uint32_t guard);
+	};
+
+	// Fills two partial sums for the nodes [begin, end)
+	typedef std::function<void(uint32_t begin, uint32_t end, double* sums)> BlockJob;
+
+	void Resize(uint32_t count, int dimensionsX);
+	// Runs job over fixed blocks of nodes and adds up the block sums in order,
+	// so the reductions come out the same whatever the thread count
+	void ForBlocks(WorkerPool* pool, const BlockJob& job, double* sums);
+
+	void BuildSprings(const ParticleStore& particles, const ImplicitStepParams& params, float dt, uint32_t begin, uint32_t end);
+	void BuildSystem(const ParticleStore& particles, const ImplicitStepParams& params, float dt, uint32_t begin, uint32_t end);
+	// out = mask * (diagonalWeight * mass * in + stencilWeight * K in)
+	void Apply(const Field& in, Field& out, float diagonalWeight, float stencilWeight, uint32_t begin, uint32_t end);
+
+	uint32_t maxIterations;
+	float    tolerance;
+	uint32_t lastIterations;
+	float    lastResidual;
+
+	uint32_t count;
+	int      stride;
+
+	SpringField right, down;
+	// Mass plus the damping term, and 1 for free nodes, 0 for pinned ones
+	std::vector<float> massStorage, maskStorage;
+	float* mass;
+	float* mask;
+
+	Field invDiagonal, rhs, velocity, solution, residual, preconditioned, direction, product;
+	std::vector<double> blockSums;
+};
\ No newline at end of file
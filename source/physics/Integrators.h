@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+
+enum IntegratorType
+{
+	// Position from the start velocity plus half the start acceleration, then the velocity, what the lattice always did.
+	// Not symplectic, the acceleration is never revisited at the end of the step
+	INTEGRATOR_CONSTANT_ACCELERATION,
+	// Velocity first, then the position from the new velocity
+	INTEGRATOR_SYMPLECTIC_EULER,
+	// Position Verlet, the velocity is derived from the last two positions
+	INTEGRATOR_VERLET,
+	// Velocity Verlet, the velocity takes the average of the accelerations at both ends of the step
+	INTEGRATOR_VELOCITY_VERLET
+};
+
+// Integrator policies, one axis of one node per Step so the lattice loops stay plain streaming loops
+// x the position, a the acceleration, dt the step and lastDt the one before it, v the velocity, lastA the
+// acceleration the last step started from, out the new position, out may alias x
+// The springs are evaluated once per step, only velocity Verlet looks back at the last step
+struct ConstantAccelerationIntegrator
+{
+	static void Step(float x, float a, float dt, float, float& v, float&, float& out)
+	{
+		// x + v dt + a dt^2 / 2, then v + a dt
+		out = x + (v * dt + a * (0.5f * dt * dt));
+		v += a * dt;
+	}
+};
+
+struct SymplecticEulerIntegrator
+{
+	static void Step(float x, float a, float dt, float, float& v, float&, float& out)
+	{
+		v += a * dt;
+		out = x + v * dt;
+	}
+};
+
+// x - prev is carried as v * lastDt rather than read from the previous position, so scaling it by dt / lastDt
+// follows a step that changed length and velocity edits (contact, self collision, restore) carry on.
+// The positions are the ones symplectic Euler takes, only the rounding differs
+struct VerletIntegrator
+{
+	static void Step(float x, float a, float dt, float, float& v, float&, float& out)
+	{
+		out = x + (v * dt + a * (dt * dt));
+		v = (out - x) / dt;
+	}
+};
+
+// The forces at the end of a step are the ones the next step starts from, so the second half kick waits for them.
+// A step leaves v at v + lastA lastDt and trades lastA for the average once a is in. A lastDt of 0 means
+// there is no step to finish
+struct VelocityVerletIntegrator
+{
+	static void Step(float x, float a, float dt, float lastDt, float& v, float& lastA, float& out)
+	{
+		v += (a - lastA) * (0.5f * lastDt);
+		out = x + (v * dt + a * (0.5f * dt * dt));
+		v += a * dt;
+		lastA = a;
+	}
+};
\ No newline at end of file
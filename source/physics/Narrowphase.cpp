@@ -0,0 +1,311 @@
+#include "Narrowphase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// An edge axis has to beat the best face axis by this much, faces give the steadier manifold
+static const float c_edgeAxisBias = 0.01f;
+// Shapes this close already report contacts with a negative depth, so resting contacts don't flicker in and out
+static const float c_contactMargin = 0.02f;
+// Cross products of nearly parallel edges are noise, not separating axes
+static const float c_parallelEpsilon = 1e-6f;
+
+struct Box
+{
+	glm::vec3 center;
+	glm::vec3 axes[3];
+	glm::vec3 halfExtents;
+};
+
+static Box MakeBox(const Collider& collider)
+{
+	Box box;
+	box.center = collider.center;
+	box.halfExtents = collider.halfExtents;
+	for (int i = 0; i < 3; ++i)
+		box.axes[i] = collider.colliderType == AABB ? glm::vec3(i == 0, i == 1, i == 2) : collider.orientation[i];
+	return box;
+}
+
+// Half the box's extent along the axis
+static float ProjectBox(const Box& box, glm::vec3 axis)
+{
+	return box.halfExtents.x * fabsf(glm::dot(box.axes[0], axis)) + box.halfExtents.y * fabsf(glm::dot(box.axes[1], axis))
+		+ box.halfExtents.z * fabsf(glm::dot(box.axes[2], axis));
+}
+
+static void AddPoint(ContactSet& contacts, glm::vec3 point, float depth)
+{
+	if (contacts.count < ContactSet::c_maxPoints)
+	{
+		contacts.points[contacts.count] = point;
+		contacts.depths[contacts.count] = depth;
+		++contacts.count;
+	}
+}
+
+static bool CollideSpheres(const Collider& a, const Collider& b, ContactSet& contacts)
+{
+	glm::vec3 d = b.center - a.center;
+	float dist2 = glm::dot(d, d);
+	float radii = a.radius + b.radius;
+	if (dist2 > (radii + c_contactMargin) * (radii + c_contactMargin))
+		return false;
+
+	float dist = sqrtf(dist2);
+	contacts.normal = dist > 0 ? d / dist : glm::vec3(0, 1, 0);
+	float depth = radii - dist;
+	AddPoint(contacts, a.center + contacts.normal * (a.radius - 0.5f * depth), depth);
+	return true;
+}
+
+// Normal from the box to the sphere
+static bool CollideBoxSphere(const Box& box, const Collider& sphere, ContactSet& contacts)
+{
+	glm::vec3 d = sphere.center - box.center;
+	glm::vec3 local(glm::dot(d, box.axes[0]), glm::dot(d, box.axes[1]), glm::dot(d, box.axes[2]));
+	glm::vec3 closest = glm::clamp(local, -box.halfExtents, box.halfExtents);
+
+	glm::vec3 localNormal;
+	float depth;
+	if (closest == local)
+	{
+		// Center inside the box, out through the nearest face
+		glm::vec3 gap = box.halfExtents - glm::abs(local);
+		int axis = gap.x < gap.y ? (gap.x < gap.z ? 0 : 2) : (gap.y < gap.z ? 1 : 2);
+		localNormal = glm::vec3(0);
+		localNormal[axis] = local[axis] < 0 ? -1.0f : 1.0f;
+		closest[axis] = localNormal[axis] * box.halfExtents[axis];
+		depth = sphere.radius + gap[axis];
+	}
+	else
+	{
+		glm::vec3 offset = local - closest;
+		float dist2 = glm::dot(offset, offset);
+		if (dist2 > (sphere.radius + c_contactMargin) * (sphere.radius + c_contactMargin))
+			return false;
+		float dist = sqrtf(dist2);
+		localNormal = offset / dist;
+		depth = sphere.radius - dist;
+	}
+
+	contacts.normal = localNormal.x * box.axes[0] + localNormal.y * box.axes[1] + localNormal.z * box.axes[2];
+	glm::vec3 surface = box.center + closest.x * box.axes[0] + closest.y * box.axes[1] + closest.z * box.axes[2];
+	AddPoint(contacts, surface + contacts.normal * (0.5f * depth), depth);
+	return true;
+}
+
+// Keeps the polygon on the side of the plane dot(n, p) <= offset
+static void ClipPolygon(const std::vector<glm::vec3>& in, glm::vec3 n, float offset, std::vector<glm::vec3>& out)
+{
+	out.clear();
+	for (size_t i = 0; i < in.size(); ++i)
+	{
+		glm::vec3 p = in[i];
+		glm::vec3 q = in[(i + 1) % in.size()];
+		float dp = glm::dot(n, p) - offset;
+		float dq = glm::dot(n, q) - offset;
+		if (dp <= 0)
+			out.push_back(p);
+		if ((dp < 0 && dq > 0) || (dp > 0 && dq < 0))
+			out.push_back(p + (q - p) * (dp / (dp - dq)));
+	}
+}
+
+// Deepest point, the one farthest from it, then the widest triangle either side of the line between them
+static void ReducePoints(const std::vector<glm::vec3>& points, const std::vector<float>& depths, glm::vec3 normal, ContactSet& contacts)
+{
+	size_t first = std::max_element(depths.begin(), depths.end()) - depths.begin();
+	size_t picks[4] = { first, first, first, first };
+
+	float best = -1;
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		float dist2 = glm::dot(points[i] - points[first], points[i] - points[first]);
+		if (dist2 > best)
+		{
+			best = dist2;
+			picks[1] = i;
+		}
+	}
+
+	float most = 0, least = 0;
+	glm::vec3 edge = points[picks[1]] - points[first];
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		float area = glm::dot(glm::cross(edge, points[i] - points[first]), normal);
+		if (area > most)
+		{
+			most = area;
+			picks[2] = i;
+		}
+		if (area < least)
+		{
+			least = area;
+			picks[3] = i;
+		}
+	}
+
+	for (int p = 0; p < 4; ++p)
+	{
+		bool repeat = false;
+		for (int q = 0; q < p; ++q)
+			repeat = repeat || picks[q] == picks[p];
+		if (!repeat)
+			AddPoint(contacts, points[picks[p]], depths[picks[p]]);
+	}
+}
+
+// Incident face of the other box clipped against the side planes of the reference face
+// normal points from the reference box to the incident one
+static void ClipFaces(const Box& reference, int referenceAxis, const Box& incident, glm::vec3 normal, ContactSet& contacts)
+{
+	// The reference face is the one facing along the normal
+	glm::vec3 faceNormal = glm::dot(reference.axes[referenceAxis], normal) > 0 ? reference.axes[referenceAxis] : -reference.axes[referenceAxis];
+	float faceOffset = glm::dot(faceNormal, reference.center) + reference.halfExtents[referenceAxis];
+
+	// The incident face is the one facing most against it
+	int incidentAxis = 0;
+	float facing = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		float d = fabsf(glm::dot(incident.axes[i], faceNormal));
+		if (d > facing)
+		{
+			facing = d;
+			incidentAxis = i;
+		}
+	}
+	float side = glm::dot(incident.axes[incidentAxis], faceNormal) > 0 ? -1.0f : 1.0f;
+	glm::vec3 faceCenter = incident.center + side * incident.halfExtents[incidentAxis] * incident.axes[incidentAxis];
+	glm::vec3 u = incident.axes[(incidentAxis + 1) % 3] * incident.halfExtents[(incidentAxis + 1) % 3];
+	glm::vec3 v = incident.axes[(incidentAxis + 2) % 3] * incident.halfExtents[(incidentAxis + 2) % 3];
+
+	std::vector<glm::vec3> polygon = { faceCenter + u + v, faceCenter - u + v, faceCenter - u - v, faceCenter + u - v };
+	std::vector<glm::vec3> clipped;
+	for (int i = 1; i < 3 && !polygon.empty(); ++i)
+	{
+		glm::vec3 axis = reference.axes[(referenceAxis + i) % 3];
+		float extent = reference.halfExtents[(referenceAxis + i) % 3];
+		float center = glm::dot(axis, reference.center);
+		ClipPolygon(polygon, axis, center + extent, clipped);
+		ClipPolygon(clipped, -axis, -center + extent, polygon);
+	}
+
+	std::vector<glm::vec3> points;
+	std::vector<float> depths;
+	for (glm::vec3 p : polygon)
+	{
+		float separation = glm::dot(faceNormal, p) - faceOffset;
+		if (separation <= c_contactMargin)
+		{
+			points.push_back(p - faceNormal * (0.5f * separation));
+			depths.push_back(-separation);
+		}
+	}
+
+	if (points.size() <= ContactSet::c_maxPoints)
+	{
+		for (size_t i = 0; i < points.size(); ++i)
+			AddPoint(contacts, points[i], depths[i]);
+	}
+	else
+		ReducePoints(points, depths, faceNormal, contacts);
+}
+
+static bool CollideBoxes(const Box& a, const Box& b, ContactSet& contacts)
+{
+	glm::vec3 t = b.center - a.center;
+
+	// Face axes of both boxes, then the nine edge pairs
+	float bestOverlap = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	glm::vec3 bestNormal;
+	for (int axis = 0; axis < 15; ++axis)
+	{
+		glm::vec3 l;
+		if (axis < 3)
+			l = a.axes[axis];
+		else if (axis < 6)
+			l = b.axes[axis - 3];
+		else
+		{
+			l = glm::cross(a.axes[(axis - 6) / 3], b.axes[(axis - 6) % 3]);
+			float length = glm::length(l);
+			if (length < c_parallelEpsilon)
+				continue;
+			l /= length;
+		}
+
+		float distance = glm::dot(t, l);
+		float overlap = ProjectBox(a, l) + ProjectBox(b, l) - fabsf(distance);
+		if (overlap < -c_contactMargin)
+			return false;
+
+		float score = axis < 6 ? overlap : overlap + c_edgeAxisBias;
+		if (score < bestOverlap)
+		{
+			bestOverlap = score;
+			bestAxis = axis;
+			bestNormal = distance < 0 ? -l : l;
+		}
+	}
+
+	contacts.normal = bestNormal;
+	if (bestAxis < 3)
+		ClipFaces(a, bestAxis, b, bestNormal, contacts);
+	else if (bestAxis < 6)
+		ClipFaces(b, bestAxis - 3, a, -bestNormal, contacts);
+	else
+	{
+		// Edge against edge, the closest points of the two supporting edges
+		int i = (bestAxis - 6) / 3;
+		int j = (bestAxis - 6) % 3;
+		glm::vec3 pa = a.center;
+		glm::vec3 pb = b.center;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (k != i)
+				pa += (glm::dot(a.axes[k], bestNormal) > 0 ? 1.0f : -1.0f) * a.halfExtents[k] * a.axes[k];
+			if (k != j)
+				pb += (glm::dot(b.axes[k], bestNormal) > 0 ? -1.0f : 1.0f) * b.halfExtents[k] * b.axes[k];
+		}
+
+		glm::vec3 da = a.axes[i];
+		glm::vec3 db = b.axes[j];
+		glm::vec3 r = pa - pb;
+		float d = glm::dot(da, db);
+		float denominator = 1.0f - d * d;
+		float s = denominator > c_parallelEpsilon ? (d * glm::dot(db, r) - glm::dot(da, r)) / denominator : 0.0f;
+		float u = glm::dot(db, r) + s * d;
+		s = glm::clamp(s, -a.halfExtents[i], a.halfExtents[i]);
+		u = glm::clamp(u, -b.halfExtents[j], b.halfExtents[j]);
+		AddPoint(contacts, 0.5f * (pa + s * da + pb + u * db), bestOverlap - c_edgeAxisBias);
+	}
+	return contacts.count > 0;
+}
+
+bool Collide(const Collider& a, const Collider& b, ContactSet& contacts)
+{
+	contacts.count = 0;
+	bool sphereA = a.colliderType == SPHERE;
+	bool sphereB = b.colliderType == SPHERE;
+	bool boxA = a.colliderType == AABB || a.colliderType == OOBB;
+	bool boxB = b.colliderType == AABB || b.colliderType == OOBB;
+
+	if (sphereA && sphereB)
+		return CollideSpheres(a, b, contacts);
+	if (boxA && sphereB)
+		return CollideBoxSphere(MakeBox(a), b, contacts);
+	if (sphereA && boxB)
+	{
+		if (!CollideBoxSphere(MakeBox(b), a, contacts))
+			return false;
+		contacts.normal = -contacts.normal;
+		return true;
+	}
+	if (boxA && boxB)
+		return CollideBoxes(MakeBox(a), MakeBox(b), contacts);
+	return false;
+}
\ No newline at end of file
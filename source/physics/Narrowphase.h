@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+#include "Collider.h"
+
+// Contacts between two shapes, the normal points from the first shape to the second
+struct ContactSet
+{
+	static const uint32_t c_maxPoints = 4;
+
+	glm::vec3 normal;
+	uint32_t  count = 0;
+	// Halfway between the two surfaces
+	glm::vec3 points[c_maxPoints];
+	// Penetration, negative for points just short of touching
+	float     depths[c_maxPoints];
+};
+
+// Closed form for spheres, separating axes for boxes, AABB colliders count as boxes without a rotation
+// Returns false when the shapes are apart or either has no shape
+bool Collide(const Collider& a, const Collider& b, ContactSet& contacts);
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "ParticleStore.h"
+#include "PhysicsMemory.h"
+
+#include <cstring>
+#include <utility>
+
+// Number of float arrays held in the block
+static const uint32_t c_numStreams = 16;
+
+ParticleStore::ParticleStore()
+{
+	count = stride = 0;
+	px = py = pz = nullptr;
+	prevX = prevY = prevZ = nullptr;
+	vx = vy = vz = nullptr;
+	fx = fy = fz = nullptr;
+	lastAx = lastAy = lastAz = nullptr;
+	invMass = nullptr;
+
+	block = nullptr;
+	blockSize = 0;
+}
+
+ParticleStore::~ParticleStore()
+{
+	Free();
+}
+
+void ParticleStore::Allocate(uint32_t numParticles)
+{
+	Free();
+
+	count = numParticles;
+	stride = static_cast<uint32_t>(physics::StaggerFloats(numParticles));
+	blockSize = sizeof(float) * stride * c_numStreams;
+	block = physics::AlignedMalloc(blockSize);
+	memset(block, 0, blockSize);
+
+	float* stream = static_cast<float*>(block);
+	float** streams[c_numStreams] = { &px, &py, &pz, &prevX, &prevY, &prevZ, &vx, &vy, &vz, &fx, &fy, &fz, &lastAx, &lastAy, &lastAz, &invMass };
+	for (uint32_t i = 0; i < c_numStreams; ++i)
+	{
+		*streams[i] = stream;
+		stream += stride;
+	}
+}
+
+void ParticleStore::Free()
+{
+	if (block)
+	{
+		physics::AlignedFree(block);
+	}
+
+	count = stride = 0;
+	px = py = pz = nullptr;
+	prevX = prevY = prevZ = nullptr;
+	vx = vy = vz = nullptr;
+	fx = fy = fz = nullptr;
+	lastAx = lastAy = lastAz = nullptr;
+	invMass = nullptr;
+
+	block = nullptr;
+	blockSize = 0;
+}
+
+void ParticleStore::ClearForces()
+{
+	// Force streams are adjacent in the block
+	memset(fx, 0, sizeof(float) * stride * 3);
+}
+
+void ParticleStore::SwapPositions()
+{
+	std::swap(px, prevX);
+	std::swap(py, prevY);
+	std::swap(pz, prevZ);
+}
+
+void ParticleStore::SyncPreviousPositions()
+{
+	memcpy(prevX, px, sizeof(float) * stride);
+	memcpy(prevY, py, sizeof(float) * stride);
+	memcpy(prevZ, pz, sizeof(float) * stride);
+}
+
+void ParticleStore::SaveState(void* state) const
+{
+	// Positions, previous positions and the seven streams from vx on each sit together, three copies move the lot
+	float* out = static_cast<float*>(state);
+	memcpy(out, px, sizeof(float) * stride * 3);
+	memcpy(out + stride * 3, prevX, sizeof(float) * stride * 3);
+	memcpy(out + stride * 6, vx, sizeof(float) * stride * (c_numStreams - 6));
+}
+
+void ParticleStore::RestoreState(const void* state)
+{
+	const float* in = static_cast<const float*>(state);
+	memcpy(px, in, sizeof(float) * stride * 3);
+	memcpy(prevX, in + stride * 3, sizeof(float) * stride * 3);
+	memcpy(vx, in + stride * 6, sizeof(float) * stride * (c_numStreams - 6));
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+
+// Structure-of-arrays particle storage
+// Every attribute is its own cache line aligned array, all carved out of one allocation
+class ParticleStore
+{
+public:
+	ParticleStore();
+	~ParticleStore();
+
+	void Allocate(uint32_t numParticles);
+	void Free();
+	void ClearForces();
+	// Integration writes into the previous position streams, then the two sets trade places
+	void SwapPositions();
+	void SyncPreviousPositions();
+	// Copies every stream out of and back into the block, positions first whichever way the sets were last swapped
+	// The state has to come from a store of the same count
+	size_t GetStateSize() const { return blockSize; }
+	void SaveState(void* state) const;
+	void RestoreState(const void* state);
+
+	glm::vec3 GetPosition(uint32_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+	glm::vec3 GetVelocity(uint32_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
+	void SetPosition(uint32_t i, glm::vec3 p) { px[i] = p.x; py[i] = p.y; pz[i] = p.z; }
+	void SetVelocity(uint32_t i, glm::vec3 v) { vx[i] = v.x; vy[i] = v.y; vz[i] = v.z; }
+	void AddForce(uint32_t i, glm::vec3 f)    { fx[i] += f.x; fy[i] += f.y; fz[i] += f.z; }
+
+	uint32_t count;
+	// Padded length of every array
+	uint32_t stride;
+
+	float *px, *py, *pz;
+	// Position back buffer, holds the positions of the step before once a step has been swapped in
+	float *prevX, *prevY, *prevZ;
+	float *vx, *vy, *vz;
+	float *fx, *fy, *fz;
+	// Acceleration the last step started from, velocity Verlet finishes that step's velocity with it
+	float *lastAx, *lastAy, *lastAz;
+	float *invMass;
+
+private:
+	ParticleStore(const ParticleStore&) = delete;
+	ParticleStore& operator=(const ParticleStore&) = delete;
+
+	void*  block;
+	size_t blockSize;
+};
\ No newline at end of file
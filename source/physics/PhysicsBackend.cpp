@@ -1,8 +1,800 @@
 #include "PhysicsBackend.h"
+#include "PhysicsMemory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+// Fraction of the explicit stability limit a substep may use
+static const float c_stiffnessSafety = 0.5f;
+// Amplitude growth per second the constant acceleration integrator may leave on a mode that damping doesn't cover
+static const float c_maxGrowthRate = 0.05f;
+// Fraction of the shortest spring the fastest particle may cover in one substep
+static const float c_maxTravel = 0.25f;
+// Past this a step gives up on the bounds rather than stall the frame
+static const uint32_t c_maxSubsteps = 256;
+// Gap a clamped particle is left above the surface so its next segment starts outside
+static const float c_contactSkin = 1e-4f;
+// Shortest step a field sweep takes as a fraction of a cell, so a segment grazing the surface still gets to its end
+static const float c_fieldMinStep = 0.1f;
+// Past this a field sweep gives up on the segment
+static const uint32_t c_maxFieldSteps = 32;
+
+// Puts the particle just outside the surface at point and takes away its velocity into the surface
+static void ClampToContact(ParticleStore& particles, uint32_t n, glm::vec3 point, glm::vec3 normal)
+{
+	particles.SetPosition(n, point + normal * c_contactSkin);
+	glm::vec3 v = particles.GetVelocity(n);
+	float vN = glm::dot(v, normal);
+	if (vN < 0)
+		particles.SetVelocity(n, v - vN * normal);
+}
+
+// Segment start -> end against a sphere, the contact point and outward normal of the first touch
+static bool SweepSphere(glm::vec3 start, glm::vec3 end, glm::vec3 center, float radius, glm::vec3& point, glm::vec3& normal)
+{
+	glm::vec3 m = start - center;
+	float c = glm::dot(m, m) - radius * radius;
+	if (c <= 0)
+	{
+		// Started inside, out along the radius through the end point
+		glm::vec3 out = end - center;
+		float dist2 = glm::dot(out, out);
+		if (dist2 >= radius * radius)
+			return false;
+		normal = dist2 > 0 ? out / sqrtf(dist2) : glm::vec3(0, 0, 1);
+		point = center + normal * radius;
+		return true;
+	}
+
+	// |m + t * delta|^2 = r^2, the smaller root is the entry
+	glm::vec3 delta = end - start;
+	float a = glm::dot(delta, delta);
+	float b = glm::dot(m, delta);
+	if (a <= 0 || b >= 0)
+		return false;
+	float disc = b * b - a * c;
+	if (disc < 0)
+		return false;
+	float t = (-b - sqrtf(disc)) / a;
+	if (t > 1)
+		return false;
+	point = start + t * delta;
+	normal = (point - center) / radius;
+	return true;
+}
+
+// Segment start -> end against a baked field, stepping by the sampled distance until it changes sign
+static bool SweepField(glm::vec3 start, glm::vec3 end, const SignedDistanceField& field, glm::vec3& point, glm::vec3& normal)
+{
+	glm::vec3 gradient;
+	float d = field.Sample(start, gradient);
+	if (d <= 0)
+	{
+		// Started inside, out along the gradient at the end point
+		d = field.Sample(end, gradient);
+		float slope = glm::length(gradient);
+		if (d > 0 || slope <= 0)
+			return false;
+		normal = gradient / slope;
+		point = end - normal * d;
+		return true;
+	}
+
+	glm::vec3 delta = end - start;
+	float length = glm::length(delta);
+	if (length <= 0)
+		return false;
+	glm::vec3 dir = delta / length;
+	float minStep = c_fieldMinStep * field.GetCellSize();
+	float t = 0;
+	for (uint32_t i = 0; i < c_maxFieldSteps && t < length; ++i)
+	{
+		float lastT = t;
+		float lastD = d;
+		t = std::min(t + std::max(d, minStep), length);
+		d = field.Sample(start + dir * t, gradient);
+		if (d > 0)
+			continue;
+
+		// Crossed between the last two samples, the surface is where the distance interpolates to zero
+		float hit = lastT + (t - lastT) * (lastD / (lastD - d));
+		point = start + dir * hit;
+		field.Sample(point, gradient);
+		float slope = glm::length(gradient);
+		normal = slope > 0 ? gradient / slope : -dir;
+		return true;
+	}
+	return false;
+}
+
+// Segment start -> end against the box [-extents, extents] in the box's own frame, slab by slab
+static bool SweepLocalBox(glm::vec3 start, glm::vec3 end, glm::vec3 extents, glm::vec3& point, glm::vec3& normal)
+{
+	normal = glm::vec3(0);
+	if (glm::all(glm::lessThanEqual(glm::abs(start), extents)))
+	{
+		// Started inside, out through the face nearest the end point
+		glm::vec3 depth = extents - glm::abs(end);
+		if (depth.x < 0 || depth.y < 0 || depth.z < 0)
+			return false;
+		int axis = depth.x < depth.y ? (depth.x < depth.z ? 0 : 2) : (depth.y < depth.z ? 1 : 2);
+		float side = end[axis] < 0 ? -1.0f : 1.0f;
+		point = end;
+		point[axis] = side * extents[axis];
+		normal[axis] = side;
+		return true;
+	}
+
+	glm::vec3 delta = end - start;
+	float enter = 0;
+	float exit = 1;
+	int enterAxis = -1;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (delta[axis] == 0)
+		{
+			if (fabsf(start[axis]) > extents[axis])
+				return false;
+			continue;
+		}
+		float t0 = (-extents[axis] - start[axis]) / delta[axis];
+		float t1 = (extents[axis] - start[axis]) / delta[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		if (t0 > enter)
+		{
+			enter = t0;
+			enterAxis = axis;
+		}
+		exit = std::min(exit, t1);
+		if (enter > exit)
+			return false;
+	}
+	if (enterAxis < 0)
+		return false;
+
+	point = start + enter * delta;
+	normal[enterAxis] = delta[enterAxis] > 0 ? -1.0f : 1.0f;
+	return true;
+}
+
+// Leads every snapshot frame, the backend's own step counter and hash
+struct BackendSnapshotHeader
+{
+	uint64_t rigidStep;
+	uint64_t stateHash;
+};
+
+// Everything a step changes about a rigid body, its shape and mass stay as they are
+struct RigidBodySnapshot
+{
+	glm::vec3  position, velocity, acceleration;
+	glm::vec3  netForce, netImpulse;
+	glm::quat  orientation;
+	glm::vec3  angularVelocity;
+	glm::vec3  netTorque;
+	SleepState sleep;
+};
+
+PhysicsBackend::PhysicsBackend()
+{
+	workers = new WorkerPool();
+}
+
+PhysicsBackend::~PhysicsBackend()
+{
+	delete workers;
+}
+
+void PhysicsBackend::SetWorkerCount(uint32_t count)
+{
+	delete workers;
+	workers = new WorkerPool(count);
+}
+
+// Whether the collider belongs to a body the solver may move this step
+static bool IsAwakeBody(const Collider* collider)
+{
+	return collider->body && collider->body->invMass > 0.0f && !collider->body->IsAsleep();
+}
 
 void PhysicsBackend::UpdatePhysics(float dt)
 {
-	
+	for (RigidBody* body : rigidBodies)
+		body->IntegrateVelocity(dt, gravity);
+
+	// Refit the collider tree, most colliders stay inside their fat bounds and cost a containment test
+	for (size_t i = 0; i < colliders.size(); ++i)
+	{
+		Collider* collider = colliders[i];
+		Bounds bounds(collider->min, collider->max);
+		glm::vec3 center = bounds.GetCenter();
+		colliderTree.Move(collider->proxy, bounds, center - colliderCenters[i]);
+		colliderCenters[i] = center;
+	}
+
+	colliderPairs.clear();
+	colliderTree.QueryPairs([&](int32_t a, int32_t b)
+	{
+		Collider* colliderA = static_cast<Collider*>(colliderTree.GetUserData(a));
+		Collider* colliderB = static_cast<Collider*>(colliderTree.GetUserData(b));
+		// Fat bounds overlap, keep only the pairs whose actual bounds touch
+		if (Bounds(colliderA->min, colliderA->max).Overlaps(Bounds(colliderB->min, colliderB->max)))
+			colliderPairs.push_back(std::make_pair(colliderA, colliderB));
+	});
+
+	// An awake island touching a sleeping one wakes it, contact with static geometry doesn't
+	for (auto& pair : colliderPairs)
+	{
+		SleepState* sleepA = pair.first->sleep;
+		SleepState* sleepB = pair.second->sleep;
+		if (sleepA && sleepB && sleepA->asleep != sleepB->asleep)
+		{
+			sleepA->Wake();
+			sleepB->Wake();
+		}
+	}
+
+	if (!rigidBodies.empty())
+		StepRigidBodies(dt);
+	StepLattices(dt);
+}
+
+void PhysicsBackend::StepRigidBodies(float dt)
+{
+	// Narrowphase on the pairs with something awake to push, resting pairs keep their manifolds as they are
+	++rigidStep;
+	ContactSet contacts;
+	for (auto& pair : colliderPairs)
+	{
+		Collider* a = pair.first;
+		Collider* b = pair.second;
+		if (a->proxy > b->proxy)
+			std::swap(a, b);
+		if (!IsAwakeBody(a) && !IsAwakeBody(b))
+			contactSolver.KeepManifold(a, b, rigidStep);
+		else if (Collide(*a, *b, contacts))
+			contactSolver.UpdateManifold(a, b, contacts, rigidStep);
+	}
+	contactSolver.RemoveStale(rigidStep);
+	contactSolver.Solve(dt);
+
+	for (RigidBody* body : rigidBodies)
+		body->IntegratePosition(dt);
+	contactSolver.SolvePositions();
+	for (RigidBody* body : rigidBodies)
+		body->UpdateCollider();
+
+	if (deterministic)
+	{
+		for (const RigidBody* body : rigidBodies)
+		{
+			stateHash = HashBytes(&body->position, sizeof(body->position), stateHash);
+			stateHash = HashBytes(&body->orientation, sizeof(body->orientation), stateHash);
+			stateHash = HashBytes(&body->velocity, sizeof(body->velocity), stateHash);
+			stateHash = HashBytes(&body->angularVelocity, sizeof(body->angularVelocity), stateHash);
+		}
+	}
+}
+
+void PhysicsBackend::StepLattices(float dt)
+{
+	batched.clear();
+	batchStarts.clear();
+	uint32_t batchNodes = 0;
+	SubstepStats plan;
+	for (SBLattice* lattice : lattices)
+	{
+		if (lattice->IsAsleep())
+			continue;
+
+		// Large lattices one after another, each splitting its own passes across the pool
+		if (lattice->GetNumBodies() >= c_batchNodes)
+		{
+			StepLattice(*lattice, dt, workers, plan, sweepCandidates);
+			RecordSubsteps(plan);
+			continue;
+		}
+
+		// Small ones fill work items in registration order, so the split never depends on the number of threads
+		if (batchStarts.empty() || batchNodes >= c_batchNodes)
+		{
+			batchStarts.push_back(static_cast<uint32_t>(batched.size()));
+			batchNodes = 0;
+		}
+		batched.push_back(lattice);
+		batchNodes += lattice->GetNumBodies();
+	}
+	if (batched.empty())
+		return;
+	batchStarts.push_back(static_cast<uint32_t>(batched.size()));
+
+	// Every lattice of an item is stepped whole on the item's thread, one dispatch for all of them
+	uint32_t numBatches = static_cast<uint32_t>(batchStarts.size() - 1);
+	batchPlans.resize(batched.size());
+	if (batchCandidates.size() < numBatches)
+		batchCandidates.resize(numBatches);
+	workers->ParallelFor(numBatches, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t b = begin; b < end; ++b)
+		{
+			for (uint32_t l = batchStarts[b]; l < batchStarts[b + 1]; ++l)
+				StepLattice(*batched[l], dt, nullptr, batchPlans[l], batchCandidates[b]);
+		}
+	});
+	for (const SubstepStats& latticePlan : batchPlans)
+		RecordSubsteps(latticePlan);
+}
+
+void PhysicsBackend::StepLattice(SBLattice& lattice, float dt, WorkerPool* pool, SubstepStats& plan, std::vector<Collider*>& candidates)
+{
+	uint32_t substeps = ComputeSubsteps(lattice, dt, plan);
+	ParticleStore& particles = lattice.GetParticles();
+	for (uint32_t s = 0; s < substeps; ++s)
+	{
+		lattice.Update(dt / substeps, pool);
+		for (const LatticePlane& plane : planes)
+			SweepPlane(particles, plane.origin, plane.normal, pool, continuousCollision);
+		SweepColliders(particles, pool, candidates, continuousCollision);
+	}
+}
+
+void PhysicsBackend::SetDeterministic(bool enabled)
+{
+	deterministic = enabled;
+	stateHash = c_stateHashSeed;
+}
+
+void PhysicsBackend::AddLattice(SBLattice* lattice)
+{
+	if (std::find(lattices.begin(), lattices.end(), lattice) != lattices.end())
+		return;
+
+	lattices.push_back(lattice);
+	snapshotLayoutValid = false;
+	snapshots.Clear();
+}
+
+void PhysicsBackend::RemoveLattice(SBLattice* lattice)
+{
+	std::vector<SBLattice*>::iterator it = std::find(lattices.begin(), lattices.end(), lattice);
+	if (it == lattices.end())
+		return;
+
+	lattices.erase(it);
+	snapshotLayoutValid = false;
+	snapshots.Clear();
+}
+
+void PhysicsBackend::AddPlane(glm::vec3 origin, glm::vec3 normal)
+{
+	LatticePlane plane = { origin, glm::normalize(normal) };
+	planes.push_back(plane);
+}
+
+void PhysicsBackend::ReserveSnapshots(uint32_t frames)
+{
+	snapshotFrames = frames;
+	LayoutSnapshots();
+}
+
+void PhysicsBackend::LayoutSnapshots()
+{
+	size_t offset = physics::PadBytes(sizeof(BackendSnapshotHeader));
+	snapshotLatticeOffsets.clear();
+	for (const SBLattice* lattice : lattices)
+	{
+		snapshotLatticeOffsets.push_back(offset);
+		offset += physics::PadBytes(lattice->GetSnapshotSize());
+	}
+	snapshotBodyOffset = offset;
+	offset += sizeof(RigidBodySnapshot) * rigidBodies.size();
+
+	snapshots.Allocate(snapshotFrames, offset);
+	snapshotManifolds.resize(snapshotFrames);
+	snapshotLayoutValid = true;
+}
+
+uint64_t PhysicsBackend::SaveSnapshot()
+{
+	if (snapshotFrames == 0)
+		throw std::runtime_error("no snapshot frames reserved");
+	if (!snapshotLayoutValid)
+		LayoutSnapshots();
+
+	uint64_t id;
+	uint32_t slot = snapshots.Push(id);
+	char* frame = static_cast<char*>(snapshots.GetFrame(slot));
+
+	BackendSnapshotHeader* header = reinterpret_cast<BackendSnapshotHeader*>(frame);
+	header->rigidStep = rigidStep;
+	header->stateHash = stateHash;
+
+	for (size_t l = 0; l < lattices.size(); ++l)
+		lattices[l]->SaveSnapshot(frame + snapshotLatticeOffsets[l]);
+
+	RigidBodySnapshot* bodies = reinterpret_cast<RigidBodySnapshot*>(frame + snapshotBodyOffset);
+	for (size_t b = 0; b < rigidBodies.size(); ++b)
+	{
+		const RigidBody* body = rigidBodies[b];
+		RigidBodySnapshot& saved = bodies[b];
+		saved.position = body->position;
+		saved.velocity = body->velocity;
+		saved.acceleration = body->acceleration;
+		saved.netForce = body->netForce;
+		saved.netImpulse = body->netImpulse;
+		saved.orientation = body->orientation;
+		saved.angularVelocity = body->angularVelocity;
+		saved.netTorque = body->netTorque;
+		saved.sleep = body->sleep;
+	}
+
+	contactSolver.SaveManifolds(snapshotManifolds[slot]);
+	return id;
+}
+
+bool PhysicsBackend::RestoreSnapshot(uint64_t id)
+{
+	uint32_t slot = snapshots.Find(id);
+	if (!snapshotLayoutValid || slot == SnapshotRing::c_noSlot)
+		return false;
+
+	const char* frame = static_cast<const char*>(snapshots.GetFrame(slot));
+	const BackendSnapshotHeader* header = reinterpret_cast<const BackendSnapshotHeader*>(frame);
+	rigidStep = header->rigidStep;
+	stateHash = header->stateHash;
+
+	for (size_t l = 0; l < lattices.size(); ++l)
+		lattices[l]->RestoreSnapshot(frame + snapshotLatticeOffsets[l]);
+
+	const RigidBodySnapshot* bodies = reinterpret_cast<const RigidBodySnapshot*>(frame + snapshotBodyOffset);
+	for (size_t b = 0; b < rigidBodies.size(); ++b)
+	{
+		RigidBody* body = rigidBodies[b];
+		const RigidBodySnapshot& saved = bodies[b];
+		body->position = saved.position;
+		body->velocity = saved.velocity;
+		body->acceleration = saved.acceleration;
+		body->netForce = saved.netForce;
+		body->netImpulse = saved.netImpulse;
+		body->orientation = saved.orientation;
+		body->angularVelocity = saved.angularVelocity;
+		body->netTorque = saved.netTorque;
+		body->sleep = saved.sleep;
+		body->UpdateCollider();
+	}
+
+	contactSolver.RestoreManifolds(snapshotManifolds[slot]);
+	return true;
+}
+
+void PhysicsBackend::AddRigidBody(RigidBody* body)
+{
+	if (std::find(rigidBodies.begin(), rigidBodies.end(), body) != rigidBodies.end())
+		return;
+
+	snapshotLayoutValid = false;
+	snapshots.Clear();
+
+	body->collider.body = body;
+	body->collider.sleep = &body->sleep;
+	body->UpdateCollider();
+	AddCollider(&body->collider);
+	rigidBodies.push_back(body);
+}
+
+void PhysicsBackend::RemoveRigidBody(RigidBody* body)
+{
+	std::vector<RigidBody*>::iterator it = std::find(rigidBodies.begin(), rigidBodies.end(), body);
+	if (it == rigidBodies.end())
+		return;
+
+	rigidBodies.erase(it);
+	RemoveCollider(&body->collider);
+	snapshotLayoutValid = false;
+	snapshots.Clear();
+}
+
+void PhysicsBackend::AddCollider(Collider* collider)
+{
+	if (collider->proxy != AABBTree::c_nullNode)
+		return;
+
+	Bounds bounds(collider->min, collider->max);
+	collider->proxy = colliderTree.Insert(bounds, collider);
+	colliders.push_back(collider);
+	colliderCenters.push_back(bounds.GetCenter());
+}
+
+void PhysicsBackend::RemoveCollider(Collider* collider)
+{
+	std::vector<Collider*>::iterator it = std::find(colliders.begin(), colliders.end(), collider);
+	if (it == colliders.end())
+		return;
+
+	size_t i = it - colliders.begin();
+	colliders[i] = colliders.back();
+	colliders.pop_back();
+	colliderCenters[i] = colliderCenters.back();
+	colliderCenters.pop_back();
+
+	contactSolver.RemoveCollider(collider);
+	colliderTree.Remove(collider->proxy);
+	collider->proxy = AABBTree::c_nullNode;
+}
+
+void PhysicsBackend::QueryColliders(const Bounds& bounds, std::vector<Collider*>& result)
+{
+	result.clear();
+	colliderTree.Query(bounds, [&](int32_t proxy)
+	{
+		Collider* collider = static_cast<Collider*>(colliderTree.GetUserData(proxy));
+		if (Bounds(collider->min, collider->max).Overlaps(bounds))
+			result.push_back(collider);
+		return true;
+	});
+}
+
+void PhysicsBackend::RaycastColliders(glm::vec3 origin, glm::vec3 dir, float maxT, std::vector<Collider*>& result)
+{
+	result.clear();
+	std::vector<std::pair<float, Collider*>> hits;
+	glm::vec3 invDir = 1.0f / dir;
+	colliderTree.RayCast(origin, dir, maxT, [&](int32_t proxy, float)
+	{
+		Collider* collider = static_cast<Collider*>(colliderTree.GetUserData(proxy));
+		float tEntry;
+		if (RayIntersectsBounds(origin, invDir, maxT, Bounds(collider->min, collider->max), tEntry))
+			hits.push_back(std::make_pair(tEntry, collider));
+		return maxT;
+	});
+
+	std::sort(hits.begin(), hits.end(), [](const std::pair<float, Collider*>& a, const std::pair<float, Collider*>& b)
+	{
+		return a.first < b.first;
+	});
+	for (size_t i = 0; i < hits.size(); ++i)
+		result.push_back(hits[i].second);
+}
+
+void PhysicsBackend::BuildParticleBroadphase(const std::vector<const ParticleStore*>& stores, float cellSize)
+{
+	particleGrid.Build(stores, cellSize);
+}
+
+void PhysicsBackend::FindParticlePairs(float radius, std::vector<std::pair<SpatialHash::Entry, SpatialHash::Entry>>& pairs)
+{
+	pairs.clear();
+	const std::vector<SpatialHash::Entry>& entries = particleGrid.GetSortedEntries();
+	particleGrid.FindPairs(radius, [&](uint32_t a, uint32_t b)
+	{
+		pairs.push_back(std::make_pair(entries[a], entries[b]));
+	});
+}
+
+bool PhysicsBackend::RaycastParticles(glm::vec3 origin, glm::vec3 dir, float radius, float maxT, SpatialHash::Entry& hit, float& t)
+{
+	uint32_t slot;
+	if (!particleGrid.Raycast(origin, dir, radius, maxT, slot, t))
+		return false;
+	hit = particleGrid.GetSortedEntries()[slot];
+	return true;
+}
+
+void PhysicsBackend::FindParticlesNear(glm::vec3 point, float radius, std::vector<SpatialHash::Entry>& found)
+{
+	found.clear();
+	const std::vector<SpatialHash::Entry>& entries = particleGrid.GetSortedEntries();
+	particleGrid.QueryRadius(point, radius, [&](uint32_t slot)
+	{
+		found.push_back(entries[slot]);
+	});
+}
+
+void PhysicsBackend::FindColliderCandidates(const Collider& collider, std::vector<SpatialHash::Entry>& candidates)
+{
+	candidates.clear();
+	const std::vector<SpatialHash::Entry>& entries = particleGrid.GetSortedEntries();
+	particleGrid.QueryAABB(collider.min, collider.max, [&](uint32_t slot)
+	{
+		candidates.push_back(entries[slot]);
+	});
+}
+
+uint32_t PhysicsBackend::PlanSubsteps(SBLattice& lattice, float dt)
+{
+	SubstepStats plan;
+	uint32_t substeps = ComputeSubsteps(lattice, dt, plan);
+	RecordSubsteps(plan);
+	return substeps;
+}
+
+uint32_t PhysicsBackend::ComputeSubsteps(SBLattice& lattice, float dt, SubstepStats& plan) const
+{
+	float bound = std::numeric_limits<float>::max();
+
+	// A mode of frequency w and damping D needs h < 2 / w to keep oscillating and h < 2 / D not to overshoot.
+	// The symplectic schemes stay bounded under just those, even undamped. Constant acceleration holds the
+	// force over the step and scales the amplitude by sqrt(1 - D h + w^2 h^2 / 2), so it grows by at most r per
+	// second only for h < 2 (D + 2 r) / w^2. Undamped it can't decay at all, r keeps that bound above zero.
+	// The highest mode of a node has w^2 of about 2 * stiffnessBound and D of dampingBound
+	float stiffnessStep = std::numeric_limits<float>::max();
+	float stiffness = lattice.GetStiffnessBound();
+	float damping = lattice.GetDampingBound();
+	if (lattice.GetSolverMode() == SOLVER_EXPLICIT)
+	{
+		if (stiffness > 0)
+		{
+			stiffnessStep = c_stiffnessSafety * sqrtf(2.0f / stiffness);
+			if (lattice.GetIntegrator() == INTEGRATOR_CONSTANT_ACCELERATION)
+				stiffnessStep = std::min(stiffnessStep, c_stiffnessSafety * (damping + 2.0f * c_maxGrowthRate) / stiffness);
+		}
+		if (damping > 0)
+			stiffnessStep = std::min(stiffnessStep, 2.0f * c_stiffnessSafety / damping);
+		bound = std::min(bound, stiffnessStep);
+	}
+
+	const ParticleStore& particles = lattice.GetParticles();
+	float peakSpeed2 = 0;
+	for (uint32_t n = 0; n < particles.count; ++n)
+	{
+		float speed2 = particles.vx[n] * particles.vx[n] + particles.vy[n] * particles.vy[n] + particles.vz[n] * particles.vz[n];
+		peakSpeed2 = std::max(peakSpeed2, speed2);
+	}
+	float peakSpeed = sqrtf(peakSpeed2);
+
+	float velocityStep = std::numeric_limits<float>::max();
+	if (!continuousCollision && peakSpeed > 0 && lattice.GetMinRestLength() > 0)
+	{
+		velocityStep = c_maxTravel * lattice.GetMinRestLength() / peakSpeed;
+		bound = std::min(bound, velocityStep);
+	}
+
+	uint32_t substeps = 1;
+	if (dt > bound)
+		substeps = static_cast<uint32_t>(std::min(ceilf(dt / bound), static_cast<float>(c_maxSubsteps)));
+
+	plan.substeps = substeps;
+	plan.substep = dt / substeps;
+	plan.stiffnessStep = stiffnessStep;
+	plan.velocityStep = velocityStep;
+	plan.peakSpeed = peakSpeed;
+	return substeps;
+}
+
+void PhysicsBackend::RecordSubsteps(const SubstepStats& plan)
+{
+	substepStats.substeps = plan.substeps;
+	substepStats.substep = plan.substep;
+	substepStats.stiffnessStep = plan.stiffnessStep;
+	substepStats.velocityStep = plan.velocityStep;
+	substepStats.peakSpeed = plan.peakSpeed;
+	substepStats.steps += 1;
+	substepStats.totalSubsteps += plan.substeps;
+	substepStats.maxSubsteps = std::max(substepStats.maxSubsteps, plan.substeps);
+}
+
+uint32_t PhysicsBackend::SweepParticlesPlane(ParticleStore& particles, glm::vec3 planeOrigin, glm::vec3 planeNormal)
+{
+	return SweepPlane(particles, planeOrigin, planeNormal, workers, true);
+}
+
+uint32_t PhysicsBackend::SweepParticlesCollider(ParticleStore& particles, const Collider& collider)
+{
+	return SweepCollider(particles, collider, workers, true);
+}
+
+uint32_t PhysicsBackend::SweepParticlesColliders(ParticleStore& particles)
+{
+	return SweepColliders(particles, workers, sweepCandidates, true);
+}
+
+uint32_t PhysicsBackend::SweepPlane(ParticleStore& particles, glm::vec3 planeOrigin, glm::vec3 planeNormal, WorkerPool* pool, bool swept)
+{
+	std::atomic<uint32_t> contacts(0);
+	auto job = [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t clamped = 0;
+		for (uint32_t n = begin; n < end; ++n)
+		{
+			// Signed distances of both segment ends, most particles end above the plane and stop here
+			float d1 = (particles.px[n] - planeOrigin.x) * planeNormal.x + (particles.py[n] - planeOrigin.y) * planeNormal.y
+				+ (particles.pz[n] - planeOrigin.z) * planeNormal.z;
+			if (d1 > 0 || particles.invMass[n] <= 0.0f)
+				continue;
+
+			glm::vec3 stop = particles.GetPosition(n);
+			glm::vec3 start = swept ? glm::vec3(particles.prevX[n], particles.prevY[n], particles.prevZ[n]) : stop;
+			float d0 = glm::dot(start - planeOrigin, planeNormal);
+			glm::vec3 point = d0 > 0 ? start + (d0 / (d0 - d1)) * (stop - start) : stop - d1 * planeNormal;
+			ClampToContact(particles, n, point, planeNormal);
+			++clamped;
+		}
+		contacts += clamped;
+	};
+	if (pool)
+		pool->ParallelFor(particles.count, job);
+	else
+		job(0, particles.count);
+	return contacts;
+}
+
+uint32_t PhysicsBackend::SweepCollider(ParticleStore& particles, const Collider& collider, WorkerPool* pool, bool swept)
+{
+	bool field = collider.colliderType == SDF && collider.field != nullptr && collider.field->IsBaked();
+	if (collider.colliderType != SPHERE && collider.colliderType != AABB && collider.colliderType != OOBB && !field)
+		return 0;
+
+	std::atomic<uint32_t> contacts(0);
+	auto job = [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t clamped = 0;
+		for (uint32_t n = begin; n < end; ++n)
+		{
+			// Segment bounds against the collider bounds first, the bulk of a lattice is nowhere near
+			if (std::max(particles.px[n], particles.prevX[n]) < collider.min.x || std::min(particles.px[n], particles.prevX[n]) > collider.max.x ||
+				std::max(particles.py[n], particles.prevY[n]) < collider.min.y || std::min(particles.py[n], particles.prevY[n]) > collider.max.y ||
+				std::max(particles.pz[n], particles.prevZ[n]) < collider.min.z || std::min(particles.pz[n], particles.prevZ[n]) > collider.max.z)
+				continue;
+			if (particles.invMass[n] <= 0.0f)
+				continue;
+
+			glm::vec3 stop = particles.GetPosition(n);
+			glm::vec3 start = swept ? glm::vec3(particles.prevX[n], particles.prevY[n], particles.prevZ[n]) : stop;
+			glm::vec3 point, normal;
+			if (collider.colliderType == SPHERE)
+			{
+				if (!SweepSphere(start, stop, collider.center, collider.radius, point, normal))
+					continue;
+			}
+			else if (field)
+			{
+				if (!SweepField(start, stop, *collider.field, point, normal))
+					continue;
+			}
+			else
+			{
+				// Into the box frame and back, the orientation is a pure rotation so its transpose inverts it
+				glm::mat3 toLocal = glm::transpose(collider.orientation);
+				glm::vec3 localPoint, localNormal;
+				if (!SweepLocalBox(toLocal * (start - collider.center), toLocal * (stop - collider.center), collider.halfExtents, localPoint, localNormal))
+					continue;
+				point = collider.center + collider.orientation * localPoint;
+				normal = collider.orientation * localNormal;
+			}
+			ClampToContact(particles, n, point, normal);
+			++clamped;
+		}
+		contacts += clamped;
+	};
+	if (pool)
+		pool->ParallelFor(particles.count, job);
+	else
+		job(0, particles.count);
+	return contacts;
+}
+
+uint32_t PhysicsBackend::SweepColliders(ParticleStore& particles, WorkerPool* pool, std::vector<Collider*>& candidates, bool swept)
+{
+	if (particles.count == 0 || colliders.empty())
+		return 0;
+
+	glm::vec3 sweptMin(std::numeric_limits<float>::max());
+	glm::vec3 sweptMax(-std::numeric_limits<float>::max());
+	for (uint32_t n = 0; n < particles.count; ++n)
+	{
+		sweptMin = glm::min(sweptMin, glm::min(particles.GetPosition(n), glm::vec3(particles.prevX[n], particles.prevY[n], particles.prevZ[n])));
+		sweptMax = glm::max(sweptMax, glm::max(particles.GetPosition(n), glm::vec3(particles.prevX[n], particles.prevY[n], particles.prevZ[n])));
+	}
+
+	QueryColliders(Bounds(sweptMin, sweptMax), candidates);
+	uint32_t contacts = 0;
+	for (Collider* collider : candidates)
+		contacts += SweepCollider(particles, *collider, pool, swept);
+	return contacts;
 }
 
 bool PhysicsBackend::TestPointPlane(glm::vec3 pointPos, glm::vec3 planeOrigin, glm::vec3 planeNormal)
@@ -12,14 +804,19 @@ bool PhysicsBackend::TestPointPlane(glm::vec3 pointPos, glm::vec3 planeOrigin, g
 	return d <= 0;
 }
 
-void PhysicsBackend::ResolveCollision(RigidBody* point, glm::vec3 normal)
+void PhysicsBackend::ResolveCollision(ParticleStore& particles, uint32_t index, glm::vec3 normal)
 {
-	glm::vec3 rV = -point->velocity;
+	glm::vec3 rV = -particles.GetVelocity(index);
 	float vN = glm::dot(rV, normal);
 	if (vN > 0)
 		return;
+	// The impulse j * n is scaled by the mass and straight away by invMass again,
+	// so it goes directly into the velocity stream
+	if (particles.invMass[index] <= 0.0f)
+		return;
 	float j = -vN;
-	j *= point->mass;
-	glm::vec3 impulse = j * normal;
-	point->netImpulse += impulse * 0.1f;
+	glm::vec3 deltaV = j * normal * 0.1f;
+	particles.vx[index] += deltaV.x;
+	particles.vy[index] += deltaV.y;
+	particles.vz[index] += deltaV.z;
 }
\ No newline at end of file
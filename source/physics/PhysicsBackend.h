@@ -2,13 +2,184 @@
 
 #include "../PrecompiledHeader.h"
 #include "SBLattice.h"
+#include "WorkerPool.h"
+#include "SpatialHash.h"
+#include "Collider.h"
+#include "AABBTree.h"
+#include "RigidBody.h"
+#include "ContactSolver.h"
+#include "StateHash.h"
+#include "SnapshotRing.h"
+
+// How the substep planner split the steps so far
+struct SubstepStats
+{
+	// The last planned step, its substep count and length
+	uint32_t substeps = 1;
+	float    substep = 0;
+	// Bounds behind it, from the springs and from the fastest particle
+	float    stiffnessStep = 0;
+	float    velocityStep = 0;
+	float    peakSpeed = 0;
+	// Running totals, totalSubsteps / steps is the mean split
+	uint64_t steps = 0;
+	uint64_t totalSubsteps = 0;
+	uint32_t maxSubsteps = 0;
+};
 
 class PhysicsBackend
 {
 public:
+	// Lattices with fewer nodes than this share work items in UpdatePhysics
+	static const uint32_t c_batchNodes = 8192;
+
+	PhysicsBackend();
+	~PhysicsBackend();
+
 	void UpdatePhysics(float dt);
+
+	// Number of threads the solver passes are spread across, 1 keeps everything on the calling thread
+	void SetWorkerCount(uint32_t count);
+	WorkerPool* GetWorkerPool() { return workers; }
+
+	// Particle broadphase, rebuilt from the given stores every step
+	void BuildParticleBroadphase(const std::vector<const ParticleStore*>& stores, float cellSize);
+	// Every pair of particles closer than radius, across all stores the broadphase was built from
+	void FindParticlePairs(float radius, std::vector<std::pair<SpatialHash::Entry, SpatialHash::Entry>>& pairs);
+	// Particles in the cells overlapped by the collider bounds, still to be tested against the shape itself
+	void FindColliderCandidates(const Collider& collider, std::vector<SpatialHash::Entry>& candidates);
+	// Nearest particle whose sphere of radius the ray origin + t * dir, t in [0, maxT], passes through, dir normalised
+	// Walks the broadphase cells along the ray, so radius should stay within the cell size it was built with
+	bool RaycastParticles(glm::vec3 origin, glm::vec3 dir, float radius, float maxT, SpatialHash::Entry& hit, float& t);
+	// Every particle within radius of point, radius around the cell size
+	void FindParticlesNear(glm::vec3 point, float radius, std::vector<SpatialHash::Entry>& found);
+	const SpatialHash& GetParticleBroadphase() const { return particleGrid; }
+
+	// Collider broadphase, colliders stay owned by the caller and are refit every UpdatePhysics
+	void AddCollider(Collider* collider);
+	void RemoveCollider(Collider* collider);
+	void QueryColliders(const Bounds& bounds, std::vector<Collider*>& colliders);
+	// Colliders whose tight bounds the segment origin + t * dir, t in [0, maxT], crosses, ordered by entry distance
+	void RaycastColliders(glm::vec3 origin, glm::vec3 dir, float maxT, std::vector<Collider*>& colliders);
+	// Overlapping collider pairs found by the last UpdatePhysics
+	const std::vector<std::pair<Collider*, Collider*>>& GetColliderPairs() const { return colliderPairs; }
+
+	// Rigid bodies stay owned by the caller, their colliders join the collider broadphase. Every UpdatePhysics moves
+	// forces and gravity into their velocities, solves the contacts of the touching pairs and then moves the bodies
+	void AddRigidBody(RigidBody* body);
+	void RemoveRigidBody(RigidBody* body);
+	void SetGravity(glm::vec3 g) { gravity = g; }
+	ContactSolver& GetContactSolver() { return contactSolver; }
+
+	// Lattices stay owned by the caller. Every UpdatePhysics steps the registered ones after the rigid bodies, each
+	// split into its planned substeps and after every substep put against the colliders and planes, swept with continuous
+	// collision on, otherwise tested at the particles' new positions only. Lattices below c_batchNodes are packed into shared work items of about that many nodes, one thread
+	// each, larger ones spread their own passes across the pool. Registering one also puts its state into the snapshots
+	void AddLattice(SBLattice* lattice);
+	void RemoveLattice(SBLattice* lattice);
+	// Infinite planes the registered lattices collide with, the normal pointing away from the solid side
+	void AddPlane(glm::vec3 origin, glm::vec3 normal);
+	void ClearPlanes() { planes.clear(); }
+
+	// Preallocates a ring of frames, each one flat block holding every registered lattice and rigid body, plus the
+	// contact manifolds. Registering or removing a lattice or body drops the frames held, the layout no longer fits
+	void ReserveSnapshots(uint32_t frames);
+	// Copies the current state into the next frame, overwriting the oldest once the ring is full, and returns its id
+	uint64_t SaveSnapshot();
+	// Puts every registered lattice and body back as it was when the frame was saved, false once it has been
+	// overwritten. Stepping on from there repeats the original run bit for bit, frames saved after it stay held
+	bool RestoreSnapshot(uint64_t id);
+	uint32_t GetSnapshotCount() const { return snapshots.GetCount(); }
+	uint64_t GetLatestSnapshot() const { return snapshots.GetLatest(); }
+
+	// The backend's own passes already give every particle and body the same result on any number of threads, the
+	// mode adds the self check, a hash of the rigid bodies' state chained over every UpdatePhysics. Lattices have their own
+	void SetDeterministic(bool enabled);
+	bool IsDeterministic() const { return deterministic; }
+	uint64_t GetStateHash() const { return stateHash; }
+
+	// Fewest equal substeps dt has to be split into for the lattice to stay stable, from its stiffness to mass ratio
+	// on the explicit path and, for every solver without swept contact, from how far its fastest particle would travel in one substep
+	uint32_t PlanSubsteps(SBLattice& lattice, float dt);
+	const SubstepStats& GetSubstepStats() const { return substepStats; }
+	void ResetSubstepStats() { substepStats = SubstepStats(); }
+	// With swept contact nothing tunnels, so the planner drops the velocity bound and keeps only the stiffness one
+	void SetContinuousCollision(bool enabled) { continuousCollision = enabled; }
+	bool GetContinuousCollision() const { return continuousCollision; }
+
+	// Swept contact over the segment every particle moved along in the last lattice step, previous -> current position.
+	// A particle whose segment enters the shape is put back at the time of impact, just outside the surface, and loses
+	// the velocity into it. Particles already inside are pushed out the nearest way. Returns the particles clamped
+	uint32_t SweepParticlesPlane(ParticleStore& particles, glm::vec3 planeOrigin, glm::vec3 planeNormal);
+	// SDF colliders are stepped through by their sampled distance, which only ever undershoots the surface
+	uint32_t SweepParticlesCollider(ParticleStore& particles, const Collider& collider);
+	// Sweeps against every registered collider the store's swept bounds touch
+	uint32_t SweepParticlesColliders(ParticleStore& particles);
+
 	bool TestPointPlane(glm::vec3 pointPos, glm::vec3 planeOrigin, glm::vec3 planeNormal);
-	void ResolveCollision(RigidBody* point, glm::vec3 normal);
+	void ResolveCollision(ParticleStore& particles, uint32_t index, glm::vec3 normal);
 
 private:
+	// Owns the worker pool
+	PhysicsBackend(const PhysicsBackend&) = delete;
+	PhysicsBackend& operator=(const PhysicsBackend&) = delete;
+
+	struct LatticePlane
+	{
+		glm::vec3 origin;
+		glm::vec3 normal;
+	};
+
+	void StepRigidBodies(float dt);
+	void StepLattices(float dt);
+	// Plans and runs one lattice's substeps with its contact, the passes spread across pool when one is given
+	void StepLattice(SBLattice& lattice, float dt, WorkerPool* pool, SubstepStats& plan, std::vector<Collider*>& candidates);
+	// The planner without the bookkeeping, plan gets the last step fields, safe to run on several lattices at once
+	uint32_t ComputeSubsteps(SBLattice& lattice, float dt, SubstepStats& plan) const;
+	void     RecordSubsteps(const SubstepStats& plan);
+	// Without swept each particle's segment starts where it ends, so only particles already inside are pushed out
+	uint32_t SweepPlane(ParticleStore& particles, glm::vec3 planeOrigin, glm::vec3 planeNormal, WorkerPool* pool, bool swept);
+	uint32_t SweepCollider(ParticleStore& particles, const Collider& collider, WorkerPool* pool, bool swept);
+	uint32_t SweepColliders(ParticleStore& particles, WorkerPool* pool, std::vector<Collider*>& candidates, bool swept);
+
+	WorkerPool* workers;
+	SpatialHash particleGrid;
+
+	AABBTree colliderTree;
+	std::vector<Collider*> colliders;
+	// Collider centers as of the last refit, used to stretch the fat bounds along the motion
+	std::vector<glm::vec3> colliderCenters;
+	std::vector<std::pair<Collider*, Collider*>> colliderPairs;
+
+	std::vector<RigidBody*> rigidBodies;
+	ContactSolver contactSolver;
+	glm::vec3     gravity = glm::vec3(0);
+	uint64_t      rigidStep = 0;
+
+	bool     deterministic = false;
+	uint64_t stateHash = c_stateHashSeed;
+
+	std::vector<SBLattice*> lattices;
+	// Where every lattice's state and the rigid body array start within a frame, laid out again after registration changes
+	void LayoutSnapshots();
+	SnapshotRing        snapshots;
+	uint32_t            snapshotFrames = 0;
+	bool                snapshotLayoutValid = false;
+	std::vector<size_t> snapshotLatticeOffsets;
+	size_t              snapshotBodyOffset = 0;
+	// The manifolds vary in number, so they keep a vector per slot, reused from lap to lap
+	std::vector<std::vector<ContactManifold>> snapshotManifolds;
+
+	SubstepStats substepStats;
+	bool         continuousCollision = false;
+
+	std::vector<Collider*> sweepCandidates;
+
+	std::vector<LatticePlane> planes;
+	// The small awake lattices of the current step in registration order, work item b steps batched[batchStarts[b]]
+	// up to batched[batchStarts[b + 1]]. Each lattice gets its own plan and each item its own collider candidates
+	std::vector<SBLattice*>             batched;
+	std::vector<uint32_t>               batchStarts;
+	std::vector<SubstepStats>           batchPlans;
+	std::vector<std::vector<Collider*>> batchCandidates;
 };
\ No newline at end of file
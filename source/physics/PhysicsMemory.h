@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstddef>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace physics
+{
+	// Cache line alignment, also wide enough for 256 bit vector loads
+	const size_t c_cacheLine = 64;
+
+	inline void* AlignedMalloc(size_t size, size_t alignment = c_cacheLine)
+	{
+		void* ptr = nullptr;
+#ifdef _WIN32
+		ptr = _aligned_malloc(size, alignment);
+#else
+		if (posix_memalign(&ptr, alignment, size) != 0)
+			ptr = nullptr;
+#endif
+		if (ptr == nullptr)
+		{
+			throw std::runtime_error("failed to allocate aligned physics memory");
+		}
+		return ptr;
+	}
+
+	inline void AlignedFree(void* ptr)
+	{
+#ifdef _WIN32
+		_aligned_free(ptr);
+#else
+		free(ptr);
+#endif
+	}
+
+	// Round a float count up so the next array starts on a cache line
+	inline size_t PadFloats(size_t count)
+	{
+		const size_t floatsPerLine = c_cacheLine / sizeof(float);
+		return (count + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+	}
+
+	// Page size the L1 set index repeats at
+	const size_t c_cacheSetSpan = 4096;
+
+	// Pad a float count like PadFloats, then add a line if the arrays would all start
+	// at the same offset in a page, since more streams than L1 ways then evict each other
+	inline size_t StaggerFloats(size_t count)
+	{
+		size_t padded = PadFloats(count);
+		if ((padded * sizeof(float)) % c_cacheSetSpan == 0)
+			padded += c_cacheLine / sizeof(float);
+		return padded;
+	}
+
+	// Round a byte count up so whatever follows starts on a cache line
+	inline size_t PadBytes(size_t size)
+	{
+		return (size + c_cacheLine - 1) / c_cacheLine * c_cacheLine;
+	}
+}
\ No newline at end of file
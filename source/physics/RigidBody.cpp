@@ -11,17 +11,126 @@ RigidBody::RigidBody(glm::vec3 pos, glm::vec3 vel, glm::vec3 acc, float m)
 
 	netForce = glm::vec3(0);
 	netImpulse = glm::vec3(0);
+
+	collider.colliderType = NONE;
+	collider.min = collider.max = pos;
 }
 
 void RigidBody::ApplyForce(float dt)
 {
-	acceleration = invMass * netForce;
+	if (sleep.asleep)
+	{
+		if (netForce == glm::vec3(0) && netImpulse == glm::vec3(0))
+			return;
+		sleep.Wake();
+	}
+
+	glm::vec3 a = invMass * netForce;
 
-	glm::vec3 vDt = velocity * dt;
-	glm::vec3 aDt2 = 0.5f * acceleration * powf(dt, 2);
-	position += vDt + aDt2;
+	switch (integrator)
+	{
+	case INTEGRATOR_SYMPLECTIC_EULER:
+		IntegrateLinear<SymplecticEulerIntegrator>(a, dt);
+		break;
+	case INTEGRATOR_VERLET:
+		IntegrateLinear<VerletIntegrator>(a, dt);
+		break;
+	case INTEGRATOR_VELOCITY_VERLET:
+		IntegrateLinear<VelocityVerletIntegrator>(a, dt);
+		break;
+	default:
+		IntegrateLinear<ConstantAccelerationIntegrator>(a, dt);
+		break;
+	}
+	acceleration = a;
+	lastDt = dt;
 
-	velocity += acceleration * dt + invMass * netImpulse;
+	velocity += invMass * netImpulse;
 
 	netForce = netImpulse = glm::vec3(0);
+
+	float energy = 0.5f * glm::dot(velocity, velocity);
+	if (invMass > 0.0f && sleep.Update(energy, c_sleepEnergy, c_sleepWindow, dt))
+		velocity = glm::vec3(0);
+}
+
+template<class Integrator>
+void RigidBody::IntegrateLinear(glm::vec3 a, float dt)
+{
+	for (int axis = 0; axis < 3; ++axis)
+		Integrator::Step(position[axis], a[axis], dt, lastDt, velocity[axis], acceleration[axis], position[axis]);
+}
+
+void RigidBody::SetSphere(float radius)
+{
+	collider.SetSphere(position, radius);
+
+	// Solid sphere, 2/5 m r^2 about every axis
+	float inertia = 0.4f * mass * radius * radius;
+	invInertia = invMass > 0.0f && inertia > 0.0f ? glm::vec3(1.0f / inertia) : glm::vec3(0);
+}
+
+void RigidBody::SetBox(glm::vec3 halfExtents)
+{
+	collider.SetOrientedBox(position, halfExtents, glm::mat3_cast(orientation));
+
+	// Solid box, m / 3 times the sum of the other two half extents squared
+	glm::vec3 h2 = halfExtents * halfExtents;
+	glm::vec3 inertia = mass / 3.0f * glm::vec3(h2.y + h2.z, h2.x + h2.z, h2.x + h2.y);
+	invInertia = invMass > 0.0f ? 1.0f / inertia : glm::vec3(0);
+}
+
+void RigidBody::UpdateCollider()
+{
+	if (collider.colliderType == SPHERE)
+		collider.SetSphere(position, collider.radius);
+	else if (collider.colliderType == OOBB || collider.colliderType == AABB)
+		collider.SetOrientedBox(position, collider.halfExtents, glm::mat3_cast(orientation));
+}
+
+void RigidBody::IntegrateVelocity(float dt, glm::vec3 gravity)
+{
+	bool loaded = netForce != glm::vec3(0) || netImpulse != glm::vec3(0) || netTorque != glm::vec3(0);
+	if (sleep.asleep)
+	{
+		if (!loaded)
+			return;
+		sleep.Wake();
+	}
+
+	// The split leaves no half kick for ApplyForce's velocity Verlet to finish
+	lastDt = 0;
+	if (invMass > 0.0f)
+	{
+		acceleration = invMass * netForce + gravity;
+		velocity += acceleration * dt + invMass * netImpulse;
+		angularVelocity += GetInvInertiaWorld() * netTorque * dt;
+	}
+
+	netForce = netImpulse = netTorque = glm::vec3(0);
+}
+
+void RigidBody::IntegratePosition(float dt)
+{
+	if (sleep.asleep || invMass <= 0.0f)
+		return;
+
+	position += velocity * dt;
+	// dq / dt = w q / 2 with w as a pure quaternion
+	orientation += 0.5f * dt * (glm::quat(0, angularVelocity.x, angularVelocity.y, angularVelocity.z) * orientation);
+	orientation = glm::normalize(orientation);
+
+	float energy = 0.5f * (glm::dot(velocity, velocity) + glm::dot(angularVelocity, angularVelocity));
+	if (sleep.Update(energy, c_sleepEnergy, c_sleepWindow, dt))
+		velocity = angularVelocity = glm::vec3(0);
+}
+
+glm::mat3 RigidBody::GetInvInertiaWorld() const
+{
+	glm::mat3 rotation = glm::mat3_cast(orientation);
+	glm::mat3 local(0);
+	local[0][0] = invInertia.x;
+	local[1][1] = invInertia.y;
+	local[2][2] = invInertia.z;
+	return rotation * local * glm::transpose(rotation);
 }
\ No newline at end of file
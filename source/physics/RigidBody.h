@@ -1,6 +1,10 @@
 #pragma once
 
 #include "../PrecompiledHeader.h"
+#include <glm/gtc/quaternion.hpp>
+#include "SleepState.h"
+#include "Collider.h"
+#include "Integrators.h"
 
 class RigidBody
 {
@@ -8,9 +12,44 @@ public:
 	float mass, invMass;
 	glm::vec3 position, velocity, acceleration;
 	glm::vec3 netForce, netImpulse;
+	SleepState sleep;
+
+	glm::quat orientation = glm::quat(1, 0, 0, 0);
+	glm::vec3 angularVelocity = glm::vec3(0);
+	glm::vec3 netTorque = glm::vec3(0);
+	// Inverse inertia about the shape's principal axes, in body space
+	glm::vec3 invInertia = glm::vec3(0);
+	float     friction = 0.5f;
+	// Shape the body collides with, kept at the body's pose by UpdateCollider
+	Collider  collider;
+	// Scheme ApplyForce steps with, the contact solver's split is symplectic Euler whatever this says
+	IntegratorType integrator = INTEGRATOR_CONSTANT_ACCELERATION;
 
 	RigidBody() {};
 	RigidBody(glm::vec3 pos, glm::vec3 vel, glm::vec3 acc, float m);
 
+	// Integrates the accumulated force and impulse, a sleeping body stays put until something is applied to it
 	void ApplyForce(float dt);
+	void Wake() { sleep.Wake(); }
+	bool IsAsleep() const { return sleep.asleep; }
+
+	// Set the collision shape and the inertia of a solid of that shape and the body's mass
+	void SetSphere(float radius);
+	void SetBox(glm::vec3 halfExtents);
+	void UpdateCollider();
+
+	// The contact solver's split of ApplyForce, forces and gravity into the velocities first, the solved velocities into the pose after
+	void IntegrateVelocity(float dt, glm::vec3 gravity);
+	void IntegratePosition(float dt);
+
+	glm::mat3 GetInvInertiaWorld() const;
+	glm::vec3 GetPointVelocity(glm::vec3 point) const { return velocity + glm::cross(angularVelocity, point - position); }
+
+private:
+	// Length of the last ApplyForce step, 0 when there is none for velocity Verlet to finish
+	float lastDt = 0;
+
+	// One integrator policy per axis, picked once per ApplyForce. acceleration still holds the last step's
+	template<class Integrator>
+	void IntegrateLinear(glm::vec3 a, float dt);
 };
\ No newline at end of file
@@ -1,109 +1,897 @@
 #include "SBLattice.h"
+#include "PhysicsMemory.h"
+#include "../render/VulkanModel.h"
+
 #include <cstdio>
 #include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <limits>
+
+// Nodes per chunk of a deterministic pass, large enough that the chunk loop costs nothing next to the nodes
+static const uint32_t c_chunkNodes = 4096;
+// Drag spring per unit mass, critically damped at about three oscillations a second
+static const float c_dragStiffness = 400.0f;
+static const float c_dragDamping = 40.0f;
 
 SBLattice::SBLattice()
 {
+	restState = std::make_shared<SoftBodyRest>();
 	numRigidBodies = 0;
 	coefficient = 0;
 	dampening = 0;
 
 	dimensionsX = dimensionsY = 0;
 	restHeight = restWidth = 0;
+	externalForce = glm::vec3(0);
+	dragTarget = glm::vec3(0);
+	dragStiffness = c_dragStiffness;
+	dragDamping = c_dragDamping;
+	simdLevel = SIMD_SCALAR;
+	springKernel = SpringKernel_Scalar<LinearSpring>;
+	integrator = INTEGRATOR_CONSTANT_ACCELERATION;
+	lastDt = 0;
+	springLaw = SPRING_LINEAR;
+	nonlinearity = 0;
+	integrateRange = &SBLattice::IntegrateRange<ConstantAccelerationIntegrator>;
+	accumulateRows = &SBLattice::AccumulateRows<LinearSpring>;
+	accumulateSpringRange = &SBLattice::AccumulateSpringRange<LinearSpring>;
+	shearScale = bendScale = 0;
+	stiffnessBound = dampingBound = minRestLength = 0;
+	solverMode = SOLVER_EXPLICIT;
+	constraintIterations = 4;
+	selfThickness = 0;
+	sleepEnergy = c_sleepEnergy;
+	sleepWindow = c_sleepWindow;
+	deterministic = false;
+	stateHash = c_stateHashSeed;
+}
+
+static std::shared_ptr<const SoftBodyRest> MakeGridRest(const std::vector<glm::vec3>& positions, float width, float height, int x, int y)
+{
+	std::shared_ptr<SoftBodyRest> rest = std::make_shared<SoftBodyRest>();
+	rest->BuildGrid(positions, width, height, x, y);
+	return rest;
+}
+
+static std::shared_ptr<const SoftBodyRest> MakeModelGridRest(vk::Model& m, float width, float height, int x, int y)
+{
+	std::shared_ptr<SoftBodyRest> rest = std::make_shared<SoftBodyRest>();
+	rest->BuildGrid(m, width, height, x, y);
+	return rest;
+}
+
+static std::shared_ptr<const SoftBodyRest> MakeMeshRest(const std::vector<glm::vec3>& positions, const SpringTopology& springs)
+{
+	std::shared_ptr<SoftBodyRest> rest = std::make_shared<SoftBodyRest>();
+	rest->BuildMesh(positions, springs);
+	return rest;
+}
+
+static std::shared_ptr<const SoftBodyRest> MakeModelMeshRest(vk::Model& m)
+{
+	std::shared_ptr<SoftBodyRest> rest = std::make_shared<SoftBodyRest>();
+	rest->BuildMesh(m);
+	return rest;
+}
+
+SBLattice::SBLattice(vk::Model& m, float width, float height, int x, int y, float k, float d)
+	: SBLattice(MakeModelGridRest(m, width, height, x, y), k, d)
+{
 }
 
-SBLattice::SBLattice(vk::Model m, float width, float height, int x, int y, float k, float d)
+SBLattice::SBLattice(const std::vector<glm::vec3>& rest, float width, float height, int x, int y, float k, float d)
+	: SBLattice(MakeGridRest(rest, width, height, x, y), k, d)
 {
-	mesh = m;
+}
 
-	dimensionsX = x;
-	dimensionsY = y;
+SBLattice::SBLattice(vk::Model& m, float k, float d)
+	: SBLattice(MakeModelMeshRest(m), k, d)
+{
+}
+
+SBLattice::SBLattice(const std::vector<glm::vec3>& rest, const SpringTopology& springs, float k, float d)
+	: SBLattice(MakeMeshRest(rest, springs), k, d)
+{
+}
+
+SBLattice::SBLattice(std::shared_ptr<const SoftBodyRest> rest, float k, float d)
+{
+	Initialise(rest, k, d);
+	if (!IsGrid())
+		SetSpringScales(0.5f, 0.1f);
+}
 
-	numRigidBodies = x * y;
+void SBLattice::Initialise(std::shared_ptr<const SoftBodyRest> rest, float k, float d)
+{
+	// Nodes are stored row major, node (i, j) lives at i * dimensionsX + j
+	restState = rest;
+	dimensionsX = rest->GetDimensionsX();
+	dimensionsY = rest->GetDimensionsY();
+	restHeight = rest->GetRestHeight();
+	restWidth = rest->GetRestWidth();
+
+	numRigidBodies = rest->GetNumNodes();
 	coefficient = k;
 	dampening = d;
 
-	restHeight = height;
-	restWidth = width;
+	externalForce = glm::vec3(0);
+	dragTarget = glm::vec3(0);
+	dragStiffness = c_dragStiffness;
+	dragDamping = c_dragDamping;
+	shearScale = bendScale = 0;
+	solverMode = SOLVER_EXPLICIT;
+	constraintIterations = 4;
+	selfThickness = 0;
+	sleepEnergy = c_sleepEnergy;
+	sleepWindow = c_sleepWindow;
+	deterministic = false;
+	stateHash = c_stateHashSeed;
+	springLaw = SPRING_LINEAR;
+	nonlinearity = 0;
+	accumulateRows = &SBLattice::AccumulateRows<LinearSpring>;
+	accumulateSpringRange = &SBLattice::AccumulateSpringRange<LinearSpring>;
+	SetIntegrator(INTEGRATOR_CONSTANT_ACCELERATION);
+
+	particles.Allocate(numRigidBodies);
+	for (uint32_t n = 0; n < numRigidBodies; ++n)
+	{
+		particles.SetPosition(n, rest->GetPositions()[n]);
+		particles.invMass[n] = 1.0f;
+	}
+	particles.SyncPreviousPositions();
+
+	// Mesh bounds follow once SetSpringScales has the per spring stiffness
+	stiffnessBound = dampingBound = minRestLength = 0;
+	if (IsGrid())
+		UpdateStepBounds();
+
+	SetSimdLevel(DetectSimdLevel());
+}
+
+void SBLattice::SetSpringScales(float shear, float bend)
+{
+	shearScale = shear;
+	bendScale = bend;
+
+	const SpringTopology& topology = restState->GetTopology();
+	const float scales[SPRING_TYPE_COUNT] = { 1.0f, shear, bend };
+	springStiffness.resize(topology.GetNumSprings());
+	for (uint32_t s = 0; s < topology.GetNumSprings(); ++s)
+	{
+		springStiffness[s] = coefficient * scales[topology.GetTypes()[s]];
+	}
+
+	UpdateStepBounds();
+	// The constraints carry the compliance of their springs
+	if (constraints.GetNumConstraints() > 0 || solverMode == SOLVER_XPBD)
+		BuildConstraints();
+}
+
+// The explicit step stays stable while dt * sqrt(stiffnessBound) and dt * dampingBound stay small
+void SBLattice::UpdateStepBounds()
+{
+	stiffnessBound = dampingBound = 0;
+
+	if (IsGrid())
+	{
+		float maxInvMass = 0;
+		for (uint32_t n = 0; n < numRigidBodies; ++n)
+			maxInvMass = std::max(maxInvMass, particles.invMass[n]);
+
+		// Interior nodes carry four springs
+		stiffnessBound = 4.0f * coefficient * maxInvMass;
+		dampingBound = 4.0f * dampening * maxInvMass;
+		minRestLength = std::min(restWidth, restHeight);
+		return;
+	}
+
+	const SpringTopology& topology = restState->GetTopology();
+	minRestLength = std::numeric_limits<float>::max();
+	for (uint32_t s = 0; s < topology.GetNumSprings(); ++s)
+		minRestLength = std::min(minRestLength, topology.GetRestLengths()[s]);
+
+	for (uint32_t n = 0; n < numRigidBodies; ++n)
+	{
+		float stiffness = 0;
+		for (uint32_t i = topology.GetNodeBegin(n); i < topology.GetNodeBegin(n + 1); ++i)
+			stiffness += springStiffness[topology.GetNodeSprings()[i]];
+
+		uint32_t springs = topology.GetNodeBegin(n + 1) - topology.GetNodeBegin(n);
+		stiffnessBound = std::max(stiffnessBound, stiffness * particles.invMass[n]);
+		dampingBound = std::max(dampingBound, springs * dampening * particles.invMass[n]);
+	}
+}
+
+void SBLattice::GetSpringSet(SpringTopology& springs, std::vector<float>& stiffness) const
+{
+	if (IsGrid())
+	{
+		springs.BuildGrid(dimensionsX, dimensionsY, restWidth, restHeight);
+		stiffness.assign(springs.GetNumSprings(), coefficient);
+	}
+	else
+	{
+		springs = restState->GetTopology();
+		stiffness = springStiffness;
+	}
+}
+
+int SBLattice::GetExternalForceCount(uint32_t n) const
+{
+	if (!IsGrid())
+		return 1;
+
+	int i = n / dimensionsX;
+	int j = n % dimensionsX;
+	return (i == 0) + (i == dimensionsY - 1) + (j == 0) + (j == dimensionsX - 1);
+}
+
+bool SBLattice::AreNeighbours(uint32_t a, uint32_t b) const
+{
+	if (!IsGrid())
+		return a == b || restState->GetTopology().AreConnected(a, b);
+
+	int di = static_cast<int>(b / dimensionsX) - static_cast<int>(a / dimensionsX);
+	int dj = static_cast<int>(b % dimensionsX) - static_cast<int>(a % dimensionsX);
+	return di >= -1 && di <= 1 && dj >= -1 && dj <= 1;
+}
+
+SBLattice::~SBLattice()
+{
+}
+
+void SBLattice::SetNetForce(glm::vec3 force)
+{
+	if (force != externalForce)
+		sleep.Wake();
+	externalForce = force;
+}
+
+void SBLattice::Grab(const std::vector<uint32_t>& nodes, glm::vec3 point, float radius)
+{
+	dragNodes.clear();
+	dragOffsets.clear();
+	dragWeights.clear();
+	for (uint32_t n : nodes)
+	{
+		glm::vec3 offset = particles.GetPosition(n) - point;
+		dragNodes.push_back(n);
+		dragOffsets.push_back(offset);
+		dragWeights.push_back(radius > 0 ? std::max(1.0f - glm::length(offset) / radius, 0.0f) : 1.0f);
+	}
+	dragTarget = point;
+	sleep.Wake();
+}
+
+void SBLattice::SetDragTarget(glm::vec3 target)
+{
+	if (target != dragTarget && IsDragging())
+		sleep.Wake();
+	dragTarget = target;
+}
+
+void SBLattice::ReleaseDrag()
+{
+	dragNodes.clear();
+	dragOffsets.clear();
+	dragWeights.clear();
+}
+
+void SBLattice::ApplyDrag()
+{
+	for (size_t d = 0; d < dragNodes.size(); ++d)
+	{
+		uint32_t n = dragNodes[d];
+		if (particles.invMass[n] <= 0.0f)
+			continue;
+		glm::vec3 pull = (dragTarget + dragOffsets[d] - particles.GetPosition(n)) * dragStiffness - particles.GetVelocity(n) * dragDamping;
+		particles.AddForce(n, pull * (dragWeights[d] / particles.invMass[n]));
+	}
+}
+
+void SBLattice::SetSimdLevel(SimdLevel level)
+{
+	simdLevel = level;
+	springKernel = SelectSpringKernel(level, springLaw);
+	assert(VerifySpringKernel(springKernel, springLaw, 1e-4f) && "vector spring kernel diverged from the scalar path");
+}
+
+void SBLattice::SetIntegrator(IntegratorType type)
+{
+	integrator = type;
+	// The accelerations on hand weren't left by this scheme, velocity Verlet starts over
+	lastDt = 0;
+	switch (type)
+	{
+	case INTEGRATOR_SYMPLECTIC_EULER:
+		integrateRange = &SBLattice::IntegrateRange<SymplecticEulerIntegrator>;
+		break;
+	case INTEGRATOR_VERLET:
+		integrateRange = &SBLattice::IntegrateRange<VerletIntegrator>;
+		break;
+	case INTEGRATOR_VELOCITY_VERLET:
+		integrateRange = &SBLattice::IntegrateRange<VelocityVerletIntegrator>;
+		break;
+	default:
+		integrateRange = &SBLattice::IntegrateRange<ConstantAccelerationIntegrator>;
+		break;
+	}
+}
+
+void SBLattice::SetSpringLaw(SpringLaw law, float c)
+{
+	springLaw = law;
+	nonlinearity = c;
+	if (law == SPRING_NONLINEAR)
+	{
+		accumulateRows = &SBLattice::AccumulateRows<NonlinearSpring>;
+		accumulateSpringRange = &SBLattice::AccumulateSpringRange<NonlinearSpring>;
+	}
+	else
+	{
+		accumulateRows = &SBLattice::AccumulateRows<LinearSpring>;
+		accumulateSpringRange = &SBLattice::AccumulateSpringRange<LinearSpring>;
+	}
+	SetSimdLevel(simdLevel);
+}
+
+SpringKernelParams SBLattice::GetKernelParams()
+{
+	SpringKernelParams params;
+	params.px = particles.px; params.py = particles.py; params.pz = particles.pz;
+	params.vx = particles.vx; params.vy = particles.vy; params.vz = particles.vz;
+	params.fx = particles.fx; params.fy = particles.fy; params.fz = particles.fz;
+	params.dimensionsX = dimensionsX;
+	params.coefficient = coefficient;
+	params.dampening = dampening;
+	params.restWidth = restWidth;
+	params.restHeight = restHeight;
+	params.nonlinearity = nonlinearity;
+	return params;
+}
+
+template<class Law>
+void SBLattice::AccumulateBorderNode(const SpringKernelParams& params, int i, int j)
+{
+	uint32_t node = i * dimensionsX + j;
 
-	bodies = new RigidBody*[y];
-	for (int i = 0; i < y; ++i)
+	if (i > 0)
+		AccumulateSpring<Law>(params, node, node - dimensionsX, restHeight);
+	else 
+		particles.AddForce(node, externalForce);
+	if (i < dimensionsY - 1)
+		AccumulateSpring<Law>(params, node, node + dimensionsX, restHeight);
+	else 
+		particles.AddForce(node, externalForce);
+	if (j > 0)
+		AccumulateSpring<Law>(params, node, node - 1, restWidth);
+	else 
+		particles.AddForce(node, externalForce);
+	if (j < dimensionsX - 1)
+		AccumulateSpring<Law>(params, node, node + 1, restWidth);
+	else 
+		particles.AddForce(node, externalForce);
+}
+
+template<class Law>
+void SBLattice::AccumulateRows(const SpringKernelParams& params, int rowBegin, int rowEnd)
+{
+	for (int i = rowBegin; i < rowEnd; ++i)
 	{
-		bodies[i] = new RigidBody[x];
-		for (int j = 0; j < x; ++j)
+		if (i == 0 || i == dimensionsY - 1)
 		{
-			bodies[i][j] = RigidBody(m.getVertices()[i*y + j].pos, glm::vec3(0), glm::vec3(0), 1.0f);
+			for (int j = 0; j < dimensionsX; ++j)
+				AccumulateBorderNode<Law>(params, i, j);
+			continue;
 		}
+
+		// Interior nodes have all four springs and run through the vector kernel
+		AccumulateBorderNode<Law>(params, i, 0);
+		springKernel(params, i, 1, dimensionsX - 1);
+		if (dimensionsX > 1)
+			AccumulateBorderNode<Law>(params, i, dimensionsX - 1);
 	}
 }
 
-SBLattice::~SBLattice()
+void SBLattice::Update(float dt, WorkerPool* pool)
+{
+	// A sleeping lattice costs nothing until it is woken
+	if (sleep.asleep)
+		return;
+
+	ApplyDrag();
+
+	float energy;
+	switch (solverMode)
+	{
+	case SOLVER_XPBD:
+		energy = StepXPBD(dt, pool);
+		break;
+	case SOLVER_IMPLICIT:
+		energy = StepImplicit(dt, pool);
+		break;
+	default:
+		energy = StepExplicit(dt, pool);
+		break;
+	}
+
+	if (selfThickness > 0)
+		ResolveSelfCollision(pool);
+
+	if (numRigidBodies > 0 && sleep.Update(energy / numRigidBodies, sleepEnergy, sleepWindow, dt))
+	{
+		// Settle exactly where it is, both position sets equal so interpolation holds still
+		memset(particles.vx, 0, sizeof(float) * particles.stride);
+		memset(particles.vy, 0, sizeof(float) * particles.stride);
+		memset(particles.vz, 0, sizeof(float) * particles.stride);
+		particles.SyncPreviousPositions();
+	}
+
+	if (deterministic)
+	{
+		const float* streams[6] = { particles.px, particles.py, particles.pz, particles.vx, particles.vy, particles.vz };
+		for (const float* stream : streams)
+			stateHash = HashBytes(stream, sizeof(float) * particles.count, stateHash);
+	}
+}
+
+void SBLattice::SetDeterministic(bool enabled)
+{
+	deterministic = enabled;
+	stateHash = c_stateHashSeed;
+}
+
+// Leads a lattice snapshot, padded so the particle streams after it stay cache line aligned
+struct LatticeSnapshotHeader
+{
+	glm::vec3  externalForce;
+	SleepState sleep;
+	uint64_t   stateHash;
+	float      lastDt;
+};
+
+size_t SBLattice::GetSnapshotSize() const
+{
+	return physics::PadBytes(sizeof(LatticeSnapshotHeader)) + particles.GetStateSize();
+}
+
+void SBLattice::SaveSnapshot(void* snapshot) const
+{
+	LatticeSnapshotHeader* header = static_cast<LatticeSnapshotHeader*>(snapshot);
+	header->externalForce = externalForce;
+	header->sleep = sleep;
+	header->stateHash = stateHash;
+	header->lastDt = lastDt;
+	particles.SaveState(static_cast<char*>(snapshot) + physics::PadBytes(sizeof(LatticeSnapshotHeader)));
+}
+
+void SBLattice::RestoreSnapshot(const void* snapshot)
+{
+	const LatticeSnapshotHeader* header = static_cast<const LatticeSnapshotHeader*>(snapshot);
+	externalForce = header->externalForce;
+	sleep = header->sleep;
+	stateHash = header->stateHash;
+	lastDt = header->lastDt;
+	particles.RestoreState(static_cast<const char*>(snapshot) + physics::PadBytes(sizeof(LatticeSnapshotHeader)));
+}
+
+float SBLattice::SumEnergy(WorkerPool* pool, uint32_t count, uint32_t chunkSize, const std::function<float(uint32_t begin, uint32_t end)>& job)
+{
+	if (deterministic)
+	{
+		// Fixed chunks keep their sums apart, added up in chunk order the total doesn't depend on who ran what
+		chunkEnergy.assign(WorkerPool::GetNumChunks(count, chunkSize), 0.0f);
+		auto chunkJob = [&](uint32_t chunk, uint32_t begin, uint32_t end) { chunkEnergy[chunk] = job(begin, end); };
+		if (pool)
+			pool->ParallelForChunks(count, chunkSize, chunkJob);
+		else
+		{
+			for (uint32_t chunk = 0; chunk < chunkEnergy.size(); ++chunk)
+				chunkJob(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+		}
+
+		float energy = 0.0f;
+		for (float e : chunkEnergy)
+			energy += e;
+		return energy;
+	}
+
+	float energy = 0.0f;
+	std::mutex energyMutex;
+	auto range = [&](uint32_t begin, uint32_t end)
+	{
+		float rangeEnergy = job(begin, end);
+
+		std::lock_guard<std::mutex> lock(energyMutex);
+		energy += rangeEnergy;
+	};
+
+	if (pool)
+		pool->ParallelFor(count, range);
+	else
+		range(0, count);
+	return energy;
+}
+
+float SBLattice::StepExplicit(float dt, WorkerPool* pool)
+{
+	if (!IsGrid())
+		return StepTopology(dt, pool);
+
+	SpringKernelParams params = GetKernelParams();
+
+	// Forces only read the current positions and integration only writes the back buffer,
+	// so each band integrates as soon as its own forces are in instead of waiting on a barrier
+	auto band = [&](uint32_t rowBegin, uint32_t rowEnd)
+	{
+		(this->*accumulateRows)(params, rowBegin, rowEnd);
+		return (this->*integrateRange)(dt, rowBegin * dimensionsX, rowEnd * dimensionsX);
+	};
+	uint32_t chunkRows = std::max(1u, c_chunkNodes / static_cast<uint32_t>(dimensionsX));
+	float energy = SumEnergy(pool, dimensionsY, chunkRows, band);
+
+	particles.SwapPositions();
+	lastDt = dt;
+	return energy;
+}
+
+float SBLattice::StepTopology(float dt, WorkerPool* pool)
+{
+	// Every spring is evaluated once and scattered to both ends, the colours keep the scatters of one pass apart
+	const SpringTopology& topology = restState->GetTopology();
+	for (uint32_t c = 0; c < topology.GetNumColors(); ++c)
+	{
+		uint32_t begin = topology.GetColorBegin(c);
+		uint32_t count = topology.GetColorEnd(c) - begin;
+		auto colorJob = [&](uint32_t b, uint32_t e) { (this->*accumulateSpringRange)(begin + b, begin + e); };
+		if (pool)
+			pool->ParallelFor(count, colorJob);
+		else
+			colorJob(0, count);
+	}
+
+	auto integrate = [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t n = begin; n < end; ++n)
+			particles.AddForce(n, externalForce);
+		return (this->*integrateRange)(dt, begin, end);
+	};
+	float energy = SumEnergy(pool, numRigidBodies, c_chunkNodes, integrate);
+
+	particles.SwapPositions();
+	lastDt = dt;
+	return energy;
+}
+
+template<class Law>
+void SBLattice::AccumulateSpringRange(uint32_t begin, uint32_t end)
 {
-	for (int i = 0; i < dimensionsY; ++i)
+	const SpringTopology& topology = restState->GetTopology();
+	const uint32_t* nodeA = topology.GetNodeA();
+	const uint32_t* nodeB = topology.GetNodeB();
+	const float* rest = topology.GetRestLengths();
+	const float* px = particles.px; const float* py = particles.py; const float* pz = particles.pz;
+	const float* vx = particles.vx; const float* vy = particles.vy; const float* vz = particles.vz;
+	float* fx = particles.fx; float* fy = particles.fy; float* fz = particles.fz;
+
+	for (uint32_t s = begin; s < end; ++s)
 	{
-		delete[] bodies[i];
+		uint32_t a = nodeA[s];
+		uint32_t b = nodeB[s];
+
+		float dx = px[b] - px[a];
+		float dy = py[b] - py[a];
+		float dz = pz[b] - pz[a];
+		float magnitude = sqrtf(dx * dx + dy * dy + dz * dz);
+		if (magnitude < 1e-9f)
+			continue;
+
+		// Positive scale pulls a towards b and b towards a
+		float scale = Law::Scale(springStiffness[s], nonlinearity, magnitude, rest[s]);
+
+		// Each spring damps both of its ends, as the grid path does
+		fx[a] += scale * dx - vx[a] * dampening;
+		fy[a] += scale * dy - vy[a] * dampening;
+		fz[a] += scale * dz - vz[a] * dampening;
+		fx[b] -= scale * dx + vx[b] * dampening;
+		fy[b] -= scale * dy + vy[b] * dampening;
+		fz[b] -= scale * dz + vz[b] * dampening;
 	}
-	delete[] bodies;
 }
 
-void SBLattice::Update(float dt)
+void SBLattice::SetSolverMode(SolverMode mode)
 {
-	glm::vec3 displacement;
-	glm::vec3 direction;
-	float magnitude;
+	if (mode == SOLVER_IMPLICIT && !IsGrid())
+	{
+		throw std::runtime_error("the implicit solver needs a grid lattice");
+	}
+
+	solverMode = mode;
+	lastDt = 0;
+	if (mode == SOLVER_XPBD && constraints.GetNumConstraints() == 0)
+		BuildConstraints();
+}
 
-	for (int i = 0; i < dimensionsY; ++i)
+void SBLattice::BuildConstraints()
+{
+	// One distance constraint per spring, the grid path counts each of them from both ends
+	// A spring without stiffness exerts nothing, so it gets no constraint, its compliance would be infinite
+	const SpringTopology& topology = restState->GetTopology();
+	std::vector<DistanceConstraint> springs;
+	for (uint32_t s = 0; s < topology.GetNumSprings(); ++s)
+	{
+		if (springStiffness[s] <= 0.0f)
+			continue;
+		DistanceConstraint c = { topology.GetNodeA()[s], topology.GetNodeB()[s], topology.GetRestLengths()[s], 1.0f / springStiffness[s] };
+		springs.push_back(c);
+	}
+	for (int i = 0; coefficient > 0.0f && i < dimensionsY; ++i)
 	{
 		for (int j = 0; j < dimensionsX; ++j)
 		{
-			if (i > 0)
+			uint32_t node = i * dimensionsX + j;
+			if (j < dimensionsX - 1)
 			{
-				displacement = bodies[i-1][j].position - bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				magnitude = glm::length(displacement);
-				bodies[i][j].netForce += coefficient * (magnitude - restHeight) * direction - bodies[i][j].velocity * dampening;
+				DistanceConstraint c = { node, node + 1, restWidth, 1.0f / coefficient };
+				springs.push_back(c);
 			}
-			else 
-				bodies[i][j].netForce += externalForce;
 			if (i < dimensionsY - 1)
 			{
-				displacement = bodies[i+1][j].position - bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				magnitude = glm::length(displacement);
-				bodies[i][j].netForce += coefficient * (magnitude - restHeight) * direction - bodies[i][j].velocity * dampening;
-			}
-			else 
-				bodies[i][j].netForce += externalForce;
-			if (j > 0)
-			{
-				displacement = bodies[i][j-1].position - bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				magnitude = glm::length(displacement);
-				bodies[i][j].netForce += coefficient * (magnitude - restWidth) * direction - bodies[i][j].velocity * dampening;
-			}
-			else 
-				bodies[i][j].netForce += externalForce;
-			if (j < dimensionsX - 1)
-			{
-				displacement = bodies[i][j+1].position - bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				magnitude = glm::length(displacement);
-				bodies[i][j].netForce += coefficient * (magnitude - restWidth) * direction - bodies[i][j].velocity * dampening;
+				DistanceConstraint c = { node, node + dimensionsX, restHeight, 1.0f / coefficient };
+				springs.push_back(c);
 			}
-			else 
-				bodies[i][j].netForce += externalForce;
 		}
 	}
 
-	for (int i = 0; i < dimensionsY; ++i)
+	constraints.Build(springs, numRigidBodies);
+	lambda.resize(constraints.GetNumConstraints());
+}
+
+float SBLattice::StepXPBD(float dt, WorkerPool* pool)
+{
+	// Predicted positions go into the back buffer, after the swap the back buffer holds where the step started
+	auto predict = [&](uint32_t begin, uint32_t end) { PredictRange(dt, begin, end); };
+	if (pool)
+		pool->ParallelFor(numRigidBodies, predict);
+	else
+		predict(0, numRigidBodies);
+	particles.SwapPositions();
+
+	std::fill(lambda.begin(), lambda.end(), 0.0f);
+	// Each constraint's compliance is scaled by the step so the stiffness doesn't depend on dt
+	float invDt2 = 1.0f / (dt * dt);
+
+	auto solve = [&](uint32_t begin, uint32_t end) { SolveConstraintRange(begin, end, invDt2); };
+	for (uint32_t iteration = 0; iteration < constraintIterations; ++iteration)
 	{
-		for (int j = 0; j < dimensionsX; ++j)
+		// Colours run in order, the constraints inside one colour never share a node
+		for (uint32_t c = 0; c < constraints.GetNumColors(); ++c)
+		{
+			uint32_t begin = constraints.GetColorBegin(c);
+			uint32_t count = constraints.GetColorEnd(c) - begin;
+			auto colorJob = [&](uint32_t b, uint32_t e) { solve(begin + b, begin + e); };
+			if (pool)
+				pool->ParallelFor(count, colorJob);
+			else
+				colorJob(0, count);
+		}
+	}
+
+	auto finish = [&](uint32_t begin, uint32_t end) { return UpdateVelocityRange(dt, begin, end); };
+	return SumEnergy(pool, numRigidBodies, c_chunkNodes, finish);
+}
+
+float SBLattice::StepImplicit(float dt, WorkerPool* pool)
+{
+	ImplicitStepParams params;
+	params.dimensionsX = dimensionsX;
+	params.dimensionsY = dimensionsY;
+	params.restWidth = restWidth;
+	params.restHeight = restHeight;
+	params.coefficient = coefficient;
+	params.dampening = dampening;
+	params.externalForce = externalForce;
+
+	float energy = implicitSolver.Step(particles, params, dt, pool);
+	particles.SwapPositions();
+	return energy;
+}
+
+void SBLattice::PredictRange(float dt, uint32_t begin, uint32_t end)
+{
+	for (uint32_t n = begin; n < end; ++n)
+	{
+		float external = static_cast<float>(GetExternalForceCount(n));
+		glm::vec3 f = glm::vec3(particles.fx[n], particles.fy[n], particles.fz[n]) + external * externalForce;
+		glm::vec3 v = particles.GetVelocity(n) + dt * particles.invMass[n] * f;
+
+		particles.prevX[n] = particles.px[n] + v.x * dt;
+		particles.prevY[n] = particles.py[n] + v.y * dt;
+		particles.prevZ[n] = particles.pz[n] + v.z * dt;
+
+		particles.fx[n] = particles.fy[n] = particles.fz[n] = 0.0f;
+	}
+}
+
+void SBLattice::SolveConstraintRange(uint32_t begin, uint32_t end, float invDt2)
+{
+	const DistanceConstraint* batch = constraints.GetConstraints();
+	float* px = particles.px; float* py = particles.py; float* pz = particles.pz;
+	const float* invMass = particles.invMass;
+
+	for (uint32_t c = begin; c < end; ++c)
+	{
+		uint32_t a = batch[c].a;
+		uint32_t b = batch[c].b;
+		float wSum = invMass[a] + invMass[b];
+		if (wSum <= 0.0f)
+			continue;
+
+		float dx = px[a] - px[b];
+		float dy = py[a] - py[b];
+		float dz = pz[a] - pz[b];
+		float length = sqrtf(dx * dx + dy * dy + dz * dz);
+		if (length < 1e-9f)
+			continue;
+
+		float C = length - batch[c].restLength;
+		float alphaTilde = batch[c].compliance * invDt2;
+		float deltaLambda = (-C - alphaTilde * lambda[c]) / (wSum + alphaTilde);
+		lambda[c] += deltaLambda;
+
+		float scale = deltaLambda / length;
+		px[a] += invMass[a] * scale * dx; py[a] += invMass[a] * scale * dy; pz[a] += invMass[a] * scale * dz;
+		px[b] -= invMass[b] * scale * dx; py[b] -= invMass[b] * scale * dy; pz[b] -= invMass[b] * scale * dz;
+	}
+}
+
+float SBLattice::UpdateVelocityRange(float dt, uint32_t begin, uint32_t end)
+{
+	float invDt = 1.0f / dt;
+	float energy = 0.0f;
+
+	for (uint32_t n = begin; n < end; ++n)
+	{
+		// Implicit drag standing in for the four spring dampers of the explicit path
+		float damping = 1.0f / (1.0f + 4.0f * dampening * particles.invMass[n] * dt);
+
+		particles.vx[n] = (particles.px[n] - particles.prevX[n]) * invDt * damping;
+		particles.vy[n] = (particles.py[n] - particles.prevY[n]) * invDt * damping;
+		particles.vz[n] = (particles.pz[n] - particles.prevZ[n]) * invDt * damping;
+
+		energy += 0.5f * (particles.vx[n] * particles.vx[n] + particles.vy[n] * particles.vy[n] + particles.vz[n] * particles.vz[n]);
+	}
+
+	return energy;
+}
+
+void SBLattice::ResolveSelfCollision(WorkerPool* pool)
+{
+	// Cells twice the thickness keep every query within a 2x2x2 block of buckets
+	selfGrid.Build(particles, 2.0f * selfThickness);
+
+	positionCorrection.resize(numRigidBodies);
+	velocityCorrection.resize(numRigidBodies);
+
+	// Jacobi style, every node only ever writes its own correction so both passes split freely across the pool
+	auto gather = [&](uint32_t begin, uint32_t end) { GatherSelfContacts(begin, end); };
+	auto apply = [&](uint32_t begin, uint32_t end) { ApplySelfCorrections(begin, end); };
+
+	if (pool)
+	{
+		pool->ParallelFor(selfGrid.GetNumEntries(), gather);
+		pool->ParallelFor(numRigidBodies, apply);
+	}
+	else
+	{
+		gather(0, selfGrid.GetNumEntries());
+		apply(0, numRigidBodies);
+	}
+}
+
+void SBLattice::GatherSelfContacts(uint32_t slotBegin, uint32_t slotEnd)
+{
+	const std::vector<SpatialHash::Entry>& entries = selfGrid.GetSortedEntries();
+
+	// Slots are walked in cell order so consecutive queries touch the same buckets
+	for (uint32_t slot = slotBegin; slot < slotEnd; ++slot)
+	{
+		uint32_t n = entries[slot].index;
+		glm::vec3 p = selfGrid.GetSortedPosition(slot);
+		glm::vec3 v = particles.GetVelocity(n);
+
+		glm::vec3 dp(0), dv(0);
+		uint32_t contacts = 0;
+
+		if (particles.invMass[n] > 0.0f)
 		{
-			int numVertex = i * dimensionsY + j;
-			bodies[i][j].ApplyForce(dt);
-			glm::vec3 rigidPos = bodies[i][j].position;
-			glm::vec3 meshPos = mesh.getVertices()[numVertex].pos;
-			deformVecs[numVertex] = rigidPos - meshPos;
+			selfGrid.QueryRadius(p, selfThickness, [&](uint32_t other)
+			{
+				uint32_t m = entries[other].index;
+				// Springs already keep a node and its ring of neighbours apart
+				if (AreNeighbours(n, m))
+					return;
+
+				glm::vec3 d = p - selfGrid.GetSortedPosition(other);
+				float dist = glm::length(d);
+				if (dist < 1e-6f)
+					return;
+				glm::vec3 normal = d / dist;
+
+				// Each side of the pair moves itself by its share of the penetration
+				float w = particles.invMass[n] / (particles.invMass[n] + particles.invMass[m]);
+				dp += w * (selfThickness - dist) * normal;
+
+				float vN = glm::dot(v - particles.GetVelocity(m), normal);
+				if (vN < 0)
+					dv -= w * vN * normal;
+
+				++contacts;
+			});
 		}
+
+		// Averaging keeps nodes caught in several contacts from overshooting
+		float scale = contacts > 0 ? 1.0f / contacts : 0.0f;
+		positionCorrection[n] = dp * scale;
+		velocityCorrection[n] = dv * scale;
+	}
+}
+
+void SBLattice::ApplySelfCorrections(uint32_t begin, uint32_t end)
+{
+	for (uint32_t n = begin; n < end; ++n)
+	{
+		particles.px[n] += positionCorrection[n].x;
+		particles.py[n] += positionCorrection[n].y;
+		particles.pz[n] += positionCorrection[n].z;
+
+		particles.vx[n] += velocityCorrection[n].x;
+		particles.vy[n] += velocityCorrection[n].y;
+		particles.vz[n] += velocityCorrection[n].z;
 	}
+}
+
+void SBLattice::WriteDeformation(glm::vec4* deformation)
+{
+	for (uint32_t n = 0; n < numRigidBodies; ++n)
+	{
+		deformation[n] = glm::vec4(particles.GetPosition(n) - GetRestPosition(n), 0.0f);
+	}
+}
+
+template<class Integrator>
+float SBLattice::IntegrateRange(float dt, uint32_t begin, uint32_t end)
+{
+	float energy = 0.0f;
+
+	const float* px = particles.px; const float* py = particles.py; const float* pz = particles.pz;
+	float* outX = particles.prevX; float* outY = particles.prevY; float* outZ = particles.prevZ;
+	float* vx = particles.vx; float* vy = particles.vy; float* vz = particles.vz;
+	float* fx = particles.fx; float* fy = particles.fy; float* fz = particles.fz;
+	float* lastAx = particles.lastAx; float* lastAy = particles.lastAy; float* lastAz = particles.lastAz;
+	const float* invMass = particles.invMass;
+	// Local copy so the stores below can't force a reload of the member
+	const float prevDt = lastDt;
+
+	// Straight streaming loop over the SoA arrays, one node per iteration
+	for (uint32_t n = begin; n < end; ++n)
+	{
+		float ax = invMass[n] * fx[n];
+		float ay = invMass[n] * fy[n];
+		float az = invMass[n] * fz[n];
+
+		Integrator::Step(px[n], ax, dt, prevDt, vx[n], lastAx[n], outX[n]);
+		Integrator::Step(py[n], ay, dt, prevDt, vy[n], lastAy[n], outY[n]);
+		Integrator::Step(pz[n], az, dt, prevDt, vz[n], lastAz[n], outZ[n]);
+
+		fx[n] = fy[n] = fz[n] = 0.0f;
+
+		energy += 0.5f * (vx[n] * vx[n] + vy[n] * vy[n] + vz[n] * vz[n]);
+	}
+
+	return energy;
 }
\ No newline at end of file
@@ -1,35 +1,202 @@
 #pragma once
 
 #include "../PrecompiledHeader.h"
-#include "../render/VulkanModel.h"
-#include "RigidBody.h"
+#include "ParticleStore.h"
+#include "SpringKernel.h"
+#include "Integrators.h"
+#include "WorkerPool.h"
+#include "SpatialHash.h"
+#include "SleepState.h"
+#include "ConstraintBatches.h"
+#include "ImplicitSolver.h"
+#include "SpringTopology.h"
+#include "SoftBodyRest.h"
+#include "StateHash.h"
+
+namespace vk
+{
+	class Model;
+}
+
+enum SolverMode
+{
+	// Springs as forces under the lattice's SpringLaw and IntegratorType, needs small steps as k grows
+	SOLVER_EXPLICIT,
+	// Springs as compliant distance constraints, stays stable at large steps
+	SOLVER_XPBD,
+	// Backward Euler on the linearised springs, stable at any stiffness
+	SOLVER_IMPLICIT
+};
 
 class SBLattice
 {
 public:
 	SBLattice();
-	SBLattice(vk::Model m, float width, float height, int x, int y, float k, float d);
+	SBLattice(vk::Model& m, float width, float height, int x, int y, float k, float d);
+	// Builds the lattice straight from row major rest positions, no mesh needed
+	SBLattice(const std::vector<glm::vec3>& rest, float width, float height, int x, int y, float k, float d);
+	// Soft body over any triangle mesh, springs from SpringTopology::BuildFromTriangles
+	SBLattice(vk::Model& m, float k, float d);
+	SBLattice(const std::vector<glm::vec3>& rest, const SpringTopology& springs, float k, float d);
+	// Another instance of a rest state, only the particles and the per instance settings are its own
+	SBLattice(std::shared_ptr<const SoftBodyRest> rest, float k, float d);
 	~SBLattice();
 
-	vk::Model mesh;
-	glm::vec3 deformVecs[121];
-
-	void Update(float dt);
-	void SetNetForce(glm::vec3 force) { externalForce = force; }
-	RigidBody** GetBodies() { return bodies; }
+	// Steps the lattice, split into row bands across the pool when one is given
+	void Update(float dt, WorkerPool* pool = nullptr);
+	// Writes the per vertex offset from the rest mesh, one vec4 per node, for the deformation upload
+	void WriteDeformation(glm::vec4* deformation);
+	// A changed force wakes the lattice up
+	void SetNetForce(glm::vec3 force);
+	// Pulls the given nodes along with a target that starts at point, each keeping its offset from point, with a
+	// weight falling off to 0 at radius. A critically damped spring per unit mass, so it only touches these nodes
+	void Grab(const std::vector<uint32_t>& nodes, glm::vec3 point, float radius);
+	// A moved target wakes the lattice up
+	void SetDragTarget(glm::vec3 target);
+	void ReleaseDrag();
+	bool IsDragging() const { return !dragNodes.empty(); }
+	void SetDragStiffness(float stiffness, float damping) { dragStiffness = stiffness; dragDamping = damping; }
+	// Keeps non adjacent nodes at least thickness apart, 0 turns self collision off
+	void SetSelfCollision(float thickness) { selfThickness = thickness; }
+	// Switching to XPBD builds the coloured constraint batches the first time, the implicit solver needs a grid
+	void SetSolverMode(SolverMode mode);
+	// Stiffness of the shear and bend springs of a mesh soft body relative to k
+	void SetSpringScales(float shear, float bend);
+	// Gauss-Seidel sweeps over the constraint colours per XPBD step
+	void SetConstraintIterations(uint32_t iterations) { constraintIterations = iterations; }
+	// Conjugate gradient budget of the implicit solver, fewer iterations trade accuracy for frame time
+	void SetImplicitIterations(uint32_t maxIterations, float tolerance) { implicitSolver.SetIterations(maxIterations, tolerance); }
+	const ImplicitSolver& GetImplicitSolver() const { return implicitSolver; }
+	// Forces the spring kernel down to a lower instruction set, SIMD_SCALAR for comparison runs
+	void SetSimdLevel(SimdLevel level);
+	// Integrator and spring law of the explicit solver, each picks an instance of the stepping loops up front
+	// The substep planner still sizes steps for the linear stiffness, a nonlinear lattice stretched far may need more
+	void SetIntegrator(IntegratorType type);
+	void SetSpringLaw(SpringLaw law, float nonlinearity = 0.0f);
+	IntegratorType GetIntegrator() const { return integrator; }
+	SpringLaw GetSpringLaw() const { return springLaw; }
+	// The lattice sleeps once its mean kinetic energy per node stayed below energy for window seconds, 0 keeps it awake
+	void SetSleepThresholds(float energy, float window) { sleepEnergy = energy; sleepWindow = window; }
+	// Splits every pass into fixed chunks and sums them in order, so a step gives bit identical results on any number
+	// of threads, and hashes the particle state after every step as the self check
+	void SetDeterministic(bool enabled);
+	bool IsDeterministic() const { return deterministic; }
+	// Chained hash of the positions and velocities after every deterministic step so far
+	uint64_t GetStateHash() const { return stateHash; }
+	// Everything a step changes, the particles, the external force, sleep and the state hash, as one flat copy
+	// A snapshot only restores into the lattice it was saved from
+	size_t GetSnapshotSize() const;
+	void SaveSnapshot(void* snapshot) const;
+	void RestoreSnapshot(const void* snapshot);
+	void Wake() { sleep.Wake(); }
+	bool IsAsleep() const { return sleep.asleep; }
+	SleepState* GetSleepState() { return &sleep; }
+	ParticleStore& GetParticles() { return particles; }
 	uint32_t GetNumBodies() { return numRigidBodies; }
+	glm::vec3 GetRestPosition(uint32_t n) { return restState->GetPositions()[n]; }
+	// Pass to the shared constructor for more lattices of the same soft body
+	const std::shared_ptr<const SoftBodyRest>& GetRestState() const { return restState; }
+	// False for mesh soft bodies, which carry a SpringTopology instead of grid dimensions
+	bool IsGrid() const { return dimensionsX > 0; }
+	const SpringTopology& GetTopology() const { return restState->GetTopology(); }
+	// Every spring as an edge list with its stiffness, grids included, for solvers that run outside the lattice
+	void GetSpringSet(SpringTopology& springs, std::vector<float>& stiffness) const;
+	// Times the external force acts on a node, once per missing neighbour on a grid and once on a mesh
+	int  GetExternalForceCount(uint32_t n) const;
+	glm::vec3 GetNetForce() const { return externalForce; }
+	float GetDampening() const { return dampening; }
+	SolverMode GetSolverMode() const { return solverMode; }
+	// Largest sum over any node of its spring stiffnesses, and of its spring dampers, times its inverse mass
+	float GetStiffnessBound() const { return stiffnessBound; }
+	float GetDampingBound() const { return dampingBound; }
+	float GetMinRestLength() const { return minRestLength; }
 
 private:
+	std::shared_ptr<const SoftBodyRest> restState;
+
+	// Copied out of the rest state, the stepping loops read them all the time
 	int dimensionsX, dimensionsY;
 
 	float restHeight, restWidth;
 
 	uint32_t numRigidBodies;
-	RigidBody** bodies;
-	glm::vec3** deformation;
+	ParticleStore particles;
 	
 	float coefficient;
 	float dampening;
 
 	glm::vec3 externalForce;
+
+	std::vector<uint32_t>  dragNodes;
+	std::vector<glm::vec3> dragOffsets;
+	std::vector<float>     dragWeights;
+	glm::vec3 dragTarget;
+	float dragStiffness, dragDamping;
+
+	SimdLevel      simdLevel;
+	SpringKernelFn springKernel;
+	IntegratorType integrator;
+	// Length of the last explicit step, 0 when there is none for velocity Verlet to finish
+	float          lastDt;
+	SpringLaw      springLaw;
+	float          nonlinearity;
+	// Instances of the templated loops below for the chosen integrator and law
+	float (SBLattice::*integrateRange)(float dt, uint32_t begin, uint32_t end);
+	void  (SBLattice::*accumulateRows)(const SpringKernelParams& params, int rowBegin, int rowEnd);
+	void  (SBLattice::*accumulateSpringRange)(uint32_t begin, uint32_t end);
+
+	// k of every topology spring, in the topology's colour order
+	std::vector<float> springStiffness;
+	float shearScale, bendScale;
+
+	// Cached for the substep planner, see UpdateStepBounds
+	float stiffnessBound, dampingBound, minRestLength;
+
+	SolverMode solverMode;
+	uint32_t constraintIterations;
+	ConstraintBatches constraints;
+	// Accumulated multiplier per constraint, in the coloured order, reset every step
+	std::vector<float> lambda;
+	ImplicitSolver implicitSolver;
+
+	SleepState sleep;
+	float sleepEnergy, sleepWindow;
+
+	bool     deterministic;
+	uint64_t stateHash;
+	// Energy of every chunk of the current pass, summed in chunk order
+	std::vector<float> chunkEnergy;
+
+	float selfThickness;
+	SpatialHash selfGrid;
+	// Per node corrections gathered by the self collision pass before any of them is applied
+	std::vector<glm::vec3> positionCorrection;
+	std::vector<glm::vec3> velocityCorrection;
+
+	void Initialise(std::shared_ptr<const SoftBodyRest> rest, float k, float d);
+	bool AreNeighbours(uint32_t a, uint32_t b) const;
+	void UpdateStepBounds();
+	// Adds the drag spring forces of the grabbed nodes, before the solver step reads the force streams
+	void ApplyDrag();
+
+	SpringKernelParams GetKernelParams();
+	template<class Law> void AccumulateBorderNode(const SpringKernelParams& params, int i, int j);
+	template<class Law> void AccumulateRows(const SpringKernelParams& params, int rowBegin, int rowEnd);
+	// Returns the summed kinetic energy per unit mass of the range after the step
+	template<class Integrator> float IntegrateRange(float dt, uint32_t begin, uint32_t end);
+	// Sum of job's energies over [0, count), from chunks of chunkSize in order when deterministic
+	float SumEnergy(WorkerPool* pool, uint32_t count, uint32_t chunkSize, const std::function<float(uint32_t begin, uint32_t end)>& job);
+	// Each step returns the summed kinetic energy per unit mass, for the sleep test
+	float StepExplicit(float dt, WorkerPool* pool);
+	float StepTopology(float dt, WorkerPool* pool);
+	template<class Law> void AccumulateSpringRange(uint32_t begin, uint32_t end);
+	float StepXPBD(float dt, WorkerPool* pool);
+	float StepImplicit(float dt, WorkerPool* pool);
+	void  BuildConstraints();
+	void  PredictRange(float dt, uint32_t begin, uint32_t end);
+	void  SolveConstraintRange(uint32_t begin, uint32_t end, float invDt2);
+	float UpdateVelocityRange(float dt, uint32_t begin, uint32_t end);
+	void ResolveSelfCollision(WorkerPool* pool);
+	void GatherSelfContacts(uint32_t slotBegin, uint32_t slotEnd);
+	void ApplySelfCorrections(uint32_t begin, uint32_t end);
 };
\ No newline at end of file
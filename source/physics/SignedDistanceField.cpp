@@ -0,0 +1,453 @@
+#include "SignedDistanceField.h"
+#include "StateHash.h"
+#include "../render/VulkanModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+// Taken by reference when filling the brick index
+const int32_t SignedDistanceField::c_outsideBrick;
+const int32_t SignedDistanceField::c_insideBrick;
+
+static const char     c_fieldMagic[8] = { 'F', 'N', 'X', 'S', 'D', 'F', '\0', '\0' };
+static const uint32_t c_fieldVersion = 1;
+// Triangles this close to equally near are told apart by how squarely they face the point, which settles the
+// sign at edges and corners where a face seen edge on would give the wrong one
+static const float c_tieTolerance = 1e-4f;
+// Below this area a triangle has no normal to take a sign from
+static const float c_degenerateArea = 1e-12f;
+
+struct FieldFileHeader
+{
+	char       magic[8];
+	uint32_t   version;
+	uint32_t   numBaked;
+	uint64_t   sourceHash;
+	glm::vec3  origin;
+	float      cellSize;
+	float      band;
+	glm::ivec3 bricks;
+};
+
+// Closest point of the triangle abc to p, by the Voronoi regions of its corners, edges and face
+static glm::vec3 ClosestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	glm::vec3 ab = b - a;
+	glm::vec3 ac = c - a;
+	glm::vec3 ap = p - a;
+	float d1 = glm::dot(ab, ap);
+	float d2 = glm::dot(ac, ap);
+	if (d1 <= 0 && d2 <= 0)
+		return a;
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp);
+	float d4 = glm::dot(ac, bp);
+	if (d3 >= 0 && d4 <= d3)
+		return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0)
+		return a + ab * (d1 / (d1 - d3));
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp);
+	float d6 = glm::dot(ac, cp);
+	if (d6 >= 0 && d5 <= d6)
+		return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0)
+		return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+static std::vector<glm::vec3> GetModelPositions(vk::Model& model)
+{
+	std::vector<glm::vec3> positions(model.getNumVertices());
+	for (size_t n = 0; n < positions.size(); ++n)
+		positions[n] = model.getVertices()[n].pos;
+	return positions;
+}
+
+SignedDistanceField::SignedDistanceField()
+{
+	origin = glm::vec3(0);
+	cellSize = invCellSize = 1.0f;
+	band = 0;
+	bricks = glm::ivec3(0);
+	sourceHash = 0;
+}
+
+uint64_t SignedDistanceField::HashSource(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices,
+	float size, float bandWidth)
+{
+	uint64_t hash = HashBytes(positions.data(), sizeof(glm::vec3) * positions.size(), c_stateHashSeed);
+	hash = HashBytes(indices, sizeof(uint32_t) * numIndices, hash);
+	hash = HashBytes(&size, sizeof(size), hash);
+	return HashBytes(&bandWidth, sizeof(bandWidth), hash);
+}
+
+void SignedDistanceField::Bake(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices, float size,
+	float bandWidth, WorkerPool* pool)
+{
+	brickIndex.clear();
+	samples.clear();
+	cellSize = size;
+	invCellSize = 1.0f / size;
+	band = bandWidth;
+	sourceHash = HashSource(positions, indices, numIndices, size, bandWidth);
+	if (positions.empty() || numIndices < 3)
+		return;
+
+	// A cell beyond the band on every side, so every sample within band of the surface lies on the grid
+	glm::vec3 lo(std::numeric_limits<float>::max());
+	glm::vec3 hi(-std::numeric_limits<float>::max());
+	for (glm::vec3 p : positions)
+	{
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+	float brickSize = cellSize * c_brickCells;
+	origin = lo - glm::vec3(band + cellSize);
+	bricks = glm::max(glm::ivec3(glm::ceil((hi - lo + glm::vec3(2.0f * (band + cellSize))) / brickSize)), glm::ivec3(1));
+	brickIndex.assign(bricks.x * bricks.y * bricks.z, c_outsideBrick);
+
+	// Samples inside the triangle's bounds grown by the band, the only ones it can be the nearest surface to within band
+	auto GetSampleRange = [&](glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::ivec3& first, glm::ivec3& last)
+	{
+		first = glm::ivec3(glm::ceil((glm::min(a, glm::min(b, c)) - glm::vec3(band) - origin) * invCellSize));
+		last = glm::ivec3(glm::floor((glm::max(a, glm::max(b, c)) + glm::vec3(band) - origin) * invCellSize));
+	};
+
+	// Face normals, and the triangles whose band box reaches each brick's samples
+	size_t numTriangles = numIndices / 3;
+	std::vector<glm::vec3> normals(numTriangles);
+	std::vector<std::vector<uint32_t>> brickTriangles(brickIndex.size());
+	for (size_t t = 0; t < numTriangles; ++t)
+	{
+		glm::vec3 a = positions[indices[t * 3 + 0]];
+		glm::vec3 b = positions[indices[t * 3 + 1]];
+		glm::vec3 c = positions[indices[t * 3 + 2]];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float area = glm::length(normal);
+		if (area < c_degenerateArea)
+			continue;
+		normals[t] = normal / area;
+
+		// Every brick holding a sample of the triangle's band box, samples on a brick's lower faces are shared with the brick below
+		glm::ivec3 first, last;
+		GetSampleRange(a, b, c, first, last);
+		first = glm::clamp((first + glm::ivec3(c_brickCells - 1)) / c_brickCells - glm::ivec3(1), glm::ivec3(0), bricks - glm::ivec3(1));
+		last = glm::clamp(last / c_brickCells, glm::ivec3(0), bricks - glm::ivec3(1));
+		for (int z = first.z; z <= last.z; ++z)
+		{
+			for (int y = first.y; y <= last.y; ++y)
+			{
+				for (int x = first.x; x <= last.x; ++x)
+					brickTriangles[(z * bricks.y + y) * bricks.x + x].push_back(static_cast<uint32_t>(t));
+			}
+		}
+	}
+
+	std::vector<uint32_t> baked;
+	for (uint32_t brick = 0; brick < brickTriangles.size(); ++brick)
+	{
+		if (!brickTriangles[brick].empty())
+		{
+			brickIndex[brick] = static_cast<int32_t>(baked.size());
+			baked.push_back(brick);
+		}
+	}
+	samples.assign(baked.size() * c_brickSamples, band);
+	std::vector<uint8_t> inBand(baked.size(), 0);
+
+	// Each triangle against the brick's samples in its band box, keeping per sample the nearest distance and the sign
+	// of the face it lies in front of
+	auto job = [&](uint32_t begin, uint32_t end)
+	{
+		float best2[c_brickSamples];
+		float facing[c_brickSamples];
+		float sign[c_brickSamples];
+		uint8_t settled[c_brickSamples];
+		int32_t queue[c_brickSamples];
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t brick = baked[i];
+			glm::ivec3 base = glm::ivec3(brick % bricks.x, (brick / bricks.x) % bricks.y, brick / (bricks.x * bricks.y)) * c_brickCells;
+			float* out = &samples[static_cast<size_t>(brickIndex[brick]) * c_brickSamples];
+			std::fill(best2, best2 + c_brickSamples, std::numeric_limits<float>::max());
+			std::fill(facing, facing + c_brickSamples, -1.0f);
+			std::fill(sign, sign + c_brickSamples, 1.0f);
+
+			for (uint32_t t : brickTriangles[brick])
+			{
+				glm::vec3 a = positions[indices[t * 3 + 0]];
+				glm::vec3 b = positions[indices[t * 3 + 1]];
+				glm::vec3 c = positions[indices[t * 3 + 2]];
+				glm::ivec3 first, last;
+				GetSampleRange(a, b, c, first, last);
+				first = glm::max(first - base, glm::ivec3(0));
+				last = glm::min(last - base, glm::ivec3(c_brickCells));
+				for (int z = first.z; z <= last.z; ++z)
+				{
+					for (int y = first.y; y <= last.y; ++y)
+					{
+						for (int x = first.x; x <= last.x; ++x)
+						{
+							int s = (z * c_brickSide + y) * c_brickSide + x;
+							glm::vec3 p = origin + glm::vec3(base + glm::ivec3(x, y, z)) * cellSize;
+							glm::vec3 d = p - ClosestPointOnTriangle(p, a, b, c);
+							float dist2 = glm::dot(d, d);
+							float tolerance = c_tieTolerance * (best2[s] == std::numeric_limits<float>::max() ? dist2 : std::max(dist2, best2[s]));
+							if (dist2 > best2[s] + tolerance)
+								continue;
+
+							float along = glm::dot(normals[t], d);
+							float squareness = dist2 > 0 ? fabsf(along) / sqrtf(dist2) : 1.0f;
+							if (dist2 < best2[s] - tolerance || squareness > facing[s])
+							{
+								facing[s] = squareness;
+								sign[s] = along < 0 ? -1.0f : 1.0f;
+							}
+							best2[s] = std::min(best2[s], dist2);
+						}
+					}
+				}
+			}
+
+			// Samples within band are settled. The rest take the sign of the nearest settled one through the brick, the band
+			// is thick enough that getting there never crosses the surface
+			int32_t head = 0;
+			int32_t tail = 0;
+			for (int32_t s = 0; s < c_brickSamples; ++s)
+			{
+				settled[s] = best2[s] <= band * band;
+				out[s] = sign[s] * std::min(sqrtf(best2[s]), band);
+				if (settled[s])
+					queue[tail++] = s;
+			}
+			inBand[i] = tail > 0;
+			while (head < tail)
+			{
+				int32_t s = queue[head++];
+				int x = s % c_brickSide;
+				int y = (s / c_brickSide) % c_brickSide;
+				int z = s / (c_brickSide * c_brickSide);
+				const int32_t neighbours[6] = { x > 0 ? s - 1 : -1, x < c_brickCells ? s + 1 : -1, y > 0 ? s - c_brickSide : -1,
+					y < c_brickCells ? s + c_brickSide : -1, z > 0 ? s - c_brickSide * c_brickSide : -1, z < c_brickCells ? s + c_brickSide * c_brickSide : -1 };
+				for (int32_t neighbour : neighbours)
+				{
+					if (neighbour >= 0 && !settled[neighbour])
+					{
+						settled[neighbour] = 1;
+						out[neighbour] = out[s] < 0 ? -band : band;
+						queue[tail++] = neighbour;
+					}
+				}
+			}
+		}
+	};
+	if (pool)
+		pool->ParallelFor(static_cast<uint32_t>(baked.size()), job);
+	else
+		job(0, static_cast<uint32_t>(baked.size()));
+
+	// A brick the band boxes reach with no sample actually in band doesn't touch the surface, it's left to the fill like any empty one
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < baked.size(); ++i)
+	{
+		if (!inBand[i])
+		{
+			brickIndex[baked[i]] = c_outsideBrick;
+			continue;
+		}
+		if (kept != i)
+			memcpy(&samples[static_cast<size_t>(kept) * c_brickSamples], &samples[static_cast<size_t>(i) * c_brickSamples], sizeof(float) * c_brickSamples);
+		brickIndex[baked[i]] = static_cast<int32_t>(kept++);
+	}
+	samples.resize(static_cast<size_t>(kept) * c_brickSamples);
+
+	// Empty bricks the grid's border reaches without crossing a baked one are outside, the rest enclosed by the surface
+	std::vector<uint8_t> reached(brickIndex.size(), 0);
+	std::vector<int32_t> stack;
+	for (int z = 0; z < bricks.z; ++z)
+	{
+		for (int y = 0; y < bricks.y; ++y)
+		{
+			for (int x = 0; x < bricks.x; ++x)
+			{
+				bool border = x == 0 || y == 0 || z == 0 || x == bricks.x - 1 || y == bricks.y - 1 || z == bricks.z - 1;
+				int32_t brick = (z * bricks.y + y) * bricks.x + x;
+				if (border && brickIndex[brick] == c_outsideBrick)
+				{
+					reached[brick] = 1;
+					stack.push_back(brick);
+				}
+			}
+		}
+	}
+	while (!stack.empty())
+	{
+		int32_t brick = stack.back();
+		stack.pop_back();
+		glm::ivec3 cell(brick % bricks.x, (brick / bricks.x) % bricks.y, brick / (bricks.x * bricks.y));
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int side = -1; side <= 1; side += 2)
+			{
+				glm::ivec3 next = cell;
+				next[axis] += side;
+				if (next[axis] < 0 || next[axis] >= bricks[axis])
+					continue;
+				int32_t neighbour = (next.z * bricks.y + next.y) * bricks.x + next.x;
+				if (!reached[neighbour] && brickIndex[neighbour] == c_outsideBrick)
+				{
+					reached[neighbour] = 1;
+					stack.push_back(neighbour);
+				}
+			}
+		}
+	}
+	for (size_t brick = 0; brick < brickIndex.size(); ++brick)
+	{
+		if (brickIndex[brick] == c_outsideBrick && !reached[brick])
+			brickIndex[brick] = c_insideBrick;
+	}
+}
+
+void SignedDistanceField::Bake(vk::Model& model, float size, float bandWidth, WorkerPool* pool)
+{
+	Bake(GetModelPositions(model), model.getIndices(), model.getNumIndices(), size, bandWidth, pool);
+}
+
+bool SignedDistanceField::BakeCached(const std::string& path, const std::vector<glm::vec3>& positions, const uint32_t* indices,
+	size_t numIndices, float size, float bandWidth, WorkerPool* pool)
+{
+	if (Load(path) && sourceHash == HashSource(positions, indices, numIndices, size, bandWidth))
+		return true;
+
+	Bake(positions, indices, numIndices, size, bandWidth, pool);
+	Save(path);
+	return false;
+}
+
+bool SignedDistanceField::BakeCached(const std::string& path, vk::Model& model, float size, float bandWidth, WorkerPool* pool)
+{
+	return BakeCached(path, GetModelPositions(model), model.getIndices(), model.getNumIndices(), size, bandWidth, pool);
+}
+
+bool SignedDistanceField::Save(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	// Every field is set and none of them leave padding, so the bytes written are all defined
+	FieldFileHeader header;
+	memcpy(header.magic, c_fieldMagic, sizeof(header.magic));
+	header.version = c_fieldVersion;
+	header.numBaked = GetNumBakedBricks();
+	header.sourceHash = sourceHash;
+	header.origin = origin;
+	header.cellSize = cellSize;
+	header.band = band;
+	header.bricks = bricks;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(brickIndex.data(), sizeof(int32_t), brickIndex.size(), file) == brickIndex.size()
+		&& fwrite(samples.data(), sizeof(float), samples.size(), file) == samples.size();
+	return fclose(file) == 0 && written;
+}
+
+bool SignedDistanceField::Load(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	FieldFileHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, c_fieldMagic, sizeof(header.magic)) == 0
+		&& header.version == c_fieldVersion && header.cellSize > 0 && glm::all(glm::greaterThan(header.bricks, glm::ivec3(0)));
+	if (valid)
+	{
+		brickIndex.resize(static_cast<size_t>(header.bricks.x) * header.bricks.y * header.bricks.z);
+		samples.resize(static_cast<size_t>(header.numBaked) * c_brickSamples);
+		valid = fread(brickIndex.data(), sizeof(int32_t), brickIndex.size(), file) == brickIndex.size()
+			&& fread(samples.data(), sizeof(float), samples.size(), file) == samples.size();
+	}
+	fclose(file);
+
+	for (size_t brick = 0; valid && brick < brickIndex.size(); ++brick)
+		valid = brickIndex[brick] >= c_insideBrick && brickIndex[brick] < static_cast<int32_t>(header.numBaked);
+	if (!valid)
+	{
+		brickIndex.clear();
+		samples.clear();
+		return false;
+	}
+
+	origin = header.origin;
+	cellSize = header.cellSize;
+	invCellSize = 1.0f / cellSize;
+	band = header.band;
+	bricks = header.bricks;
+	sourceHash = header.sourceHash;
+	return true;
+}
+
+float SignedDistanceField::Sample(glm::vec3 p, glm::vec3& gradient) const
+{
+	gradient = glm::vec3(0);
+	if (brickIndex.empty())
+		return band;
+
+	glm::vec3 local = (p - origin) * invCellSize;
+	glm::ivec3 cell = glm::ivec3(glm::floor(local));
+	if (glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, bricks * c_brickCells)))
+		return band;
+
+	glm::ivec3 brick = cell / c_brickCells;
+	int32_t index = brickIndex[(brick.z * bricks.y + brick.y) * bricks.x + brick.x];
+	if (index < 0)
+		return index == c_insideBrick ? -band : band;
+
+	// The eight samples around p, all inside the brick thanks to its shared faces
+	glm::ivec3 c = cell - brick * c_brickCells;
+	glm::vec3 f = local - glm::vec3(cell);
+	const int row = c_brickSide;
+	const int slice = c_brickSide * c_brickSide;
+	const float* s = &samples[static_cast<size_t>(index) * c_brickSamples + (c.z * c_brickSide + c.y) * c_brickSide + c.x];
+	float s000 = s[0], s100 = s[1], s010 = s[row], s110 = s[row + 1];
+	float s001 = s[slice], s101 = s[slice + 1], s011 = s[slice + row], s111 = s[slice + row + 1];
+
+	float x00 = s000 + (s100 - s000) * f.x;
+	float x10 = s010 + (s110 - s010) * f.x;
+	float x01 = s001 + (s101 - s001) * f.x;
+	float x11 = s011 + (s111 - s011) * f.x;
+	float y0 = x00 + (x10 - x00) * f.y;
+	float y1 = x01 + (x11 - x01) * f.y;
+
+	// Derivatives of the same interpolation along each axis
+	float dx0 = (s100 - s000) + ((s110 - s010) - (s100 - s000)) * f.y;
+	float dx1 = (s101 - s001) + ((s111 - s011) - (s101 - s001)) * f.y;
+	gradient.x = (dx0 + (dx1 - dx0) * f.z) * invCellSize;
+	gradient.y = ((x10 - x00) + ((x11 - x01) - (x10 - x00)) * f.z) * invCellSize;
+	gradient.z = (y1 - y0) * invCellSize;
+	return y0 + (y1 - y0) * f.z;
+}
+
+float SignedDistanceField::Sample(glm::vec3 p) const
+{
+	glm::vec3 gradient;
+	return Sample(p, gradient);
+}
\ No newline at end of file
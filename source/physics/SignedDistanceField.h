@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+
+#include "../PrecompiledHeader.h"
+#include "WorkerPool.h"
+
+namespace vk
+{
+	class Model;
+}
+
+// Sparse signed distance grid baked from a static triangle mesh, negative inside
+// The grid is split into bricks of c_brickCells cells a side. Only bricks within band of the surface hold samples,
+// with their own copy of the shared faces so a lookup never leaves its brick, every other brick only knows its sign
+class SignedDistanceField
+{
+public:
+	static const int c_brickCells = 8;
+
+	SignedDistanceField();
+
+	// Samples the exact distance to the triangles every cellSize out to band from the surface, the bricks spread
+	// across the pool when one is given. The sign comes from the face normals, so the mesh should be closed
+	void Bake(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices, float cellSize, float band,
+		WorkerPool* pool = nullptr);
+	void Bake(vk::Model& model, float cellSize, float band, WorkerPool* pool = nullptr);
+	// Loads the field from path if it was baked from the same mesh and settings, otherwise bakes it and writes it
+	// there. Returns true when the file was used
+	bool BakeCached(const std::string& path, const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices,
+		float cellSize, float band, WorkerPool* pool = nullptr);
+	bool BakeCached(const std::string& path, vk::Model& model, float cellSize, float band, WorkerPool* pool = nullptr);
+	bool Save(const std::string& path) const;
+	bool Load(const std::string& path);
+
+	// Trilinear distance and its gradient, which points away from the surface but isn't normalised
+	// Away from the baked bricks the distance is band with the brick's sign and the gradient is zero
+	float Sample(glm::vec3 p, glm::vec3& gradient) const;
+	float Sample(glm::vec3 p) const;
+
+	bool      IsBaked() const { return !brickIndex.empty(); }
+	glm::vec3 GetMin() const { return origin; }
+	glm::vec3 GetMax() const { return origin + glm::vec3(bricks * c_brickCells) * cellSize; }
+	float     GetCellSize() const { return cellSize; }
+	float     GetBand() const { return band; }
+	uint32_t  GetNumBakedBricks() const { return static_cast<uint32_t>(samples.size() / c_brickSamples); }
+	uint32_t  GetNumBricks() const { return static_cast<uint32_t>(brickIndex.size()); }
+
+private:
+	static const int c_brickSide = c_brickCells + 1;
+	static const int c_brickSamples = c_brickSide * c_brickSide * c_brickSide;
+	// Brick indices of the bricks without samples
+	static const int32_t c_outsideBrick = -1;
+	static const int32_t c_insideBrick = -2;
+
+	static uint64_t HashSource(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices, float cellSize, float band);
+
+	glm::vec3  origin;
+	float      cellSize, invCellSize;
+	float      band;
+	glm::ivec3 bricks;
+	// Per brick, x fastest, the index of its samples in units of c_brickSamples, or one of the empty codes
+	std::vector<int32_t> brickIndex;
+	std::vector<float>   samples;
+	// Hash of the mesh and settings the field was baked from, what the cache is checked against
+	uint64_t sourceHash;
+};
\ No newline at end of file
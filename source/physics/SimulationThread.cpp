@@ -0,0 +1,182 @@
+#include "SimulationThread.h"
+
+#include <algorithm>
+
+// Longest stretch of wall time simulated in one go, anything beyond is dropped rather than spiralling
+static const float c_maxFrameTime = 0.25f;
+
+SimulationThread::SimulationThread(SBLattice* l, float s, StepFn fn)
+{
+	lattice = l;
+	step = s;
+	stepFn = fn;
+
+	running = false;
+	stepCount = 0;
+
+	writeSlot = 0;
+	readySlot = 1;
+	readSlot = 2;
+	freshSnapshot = false;
+	publishedAsleep = false;
+	uploadedAsleep = false;
+
+	pendingForce = glm::vec3(0);
+	forceChanged = false;
+
+	for (auto& snapshot : snapshots)
+	{
+		snapshot.previous.resize(lattice->GetNumBodies());
+		snapshot.current.resize(lattice->GetNumBodies());
+	}
+
+	// Seed every slot with the rest state so the renderer has something before the first step
+	CaptureStepStart();
+	Publish();
+	for (auto& snapshot : snapshots)
+	{
+		snapshot = snapshots[readySlot];
+	}
+}
+
+SimulationThread::~SimulationThread()
+{
+	Stop();
+}
+
+void SimulationThread::Start()
+{
+	if (running)
+		return;
+
+	running = true;
+	thread = std::thread(&SimulationThread::Loop, this);
+}
+
+void SimulationThread::Stop()
+{
+	running = false;
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+void SimulationThread::SetNetForce(glm::vec3 force)
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+	pendingForce = force;
+	forceChanged = true;
+}
+
+void SimulationThread::Post(InputFn fn)
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+	pendingInput.push_back(fn);
+}
+
+void SimulationThread::Loop()
+{
+	Clock::time_point previousTime = Clock::now();
+	float accumulator = 0.0f;
+
+	while (running)
+	{
+		Clock::time_point currentTime = Clock::now();
+		float frameTime = std::chrono::duration<float>(currentTime - previousTime).count();
+		previousTime = currentTime;
+
+		accumulator += std::min(frameTime, c_maxFrameTime);
+
+		std::vector<InputFn> input;
+		{
+			std::lock_guard<std::mutex> lock(inputMutex);
+			if (forceChanged)
+			{
+				lattice->SetNetForce(pendingForce);
+				forceChanged = false;
+			}
+			input.swap(pendingInput);
+		}
+		for (InputFn& fn : input)
+			fn();
+
+		while (accumulator >= step)
+		{
+			CaptureStepStart();
+			stepFn(step);
+			accumulator -= step;
+			++stepCount;
+			Publish();
+		}
+
+		// Nothing to do until the next step is due
+		std::this_thread::sleep_for(std::chrono::duration<float>(step - accumulator));
+	}
+}
+
+// The lattice's back buffer only holds the start of its last substep, so the start of the whole
+// fixed step is copied before it runs. Only this thread moves writeSlot, the slot is safe to fill early
+void SimulationThread::CaptureStepStart()
+{
+	Snapshot& snapshot = snapshots[writeSlot];
+	ParticleStore& particles = lattice->GetParticles();
+
+	for (uint32_t n = 0; n < particles.count; ++n)
+	{
+		snapshot.previous[n] = particles.GetPosition(n);
+	}
+}
+
+void SimulationThread::Publish()
+{
+	if (lattice->IsAsleep() && publishedAsleep)
+		return;
+	publishedAsleep = lattice->IsAsleep();
+
+	Snapshot& snapshot = snapshots[writeSlot];
+	ParticleStore& particles = lattice->GetParticles();
+
+	for (uint32_t n = 0; n < particles.count; ++n)
+	{
+		snapshot.current[n] = particles.GetPosition(n);
+	}
+	snapshot.stamp = Clock::now();
+	snapshot.asleep = publishedAsleep;
+
+	std::lock_guard<std::mutex> lock(snapshotMutex);
+	std::swap(writeSlot, readySlot);
+	freshSnapshot = true;
+}
+
+bool SimulationThread::NeedsUpload()
+{
+	std::lock_guard<std::mutex> lock(snapshotMutex);
+	return freshSnapshot || !uploadedAsleep;
+}
+
+void SimulationThread::Interpolate(glm::vec4* deformation)
+{
+	{
+		std::lock_guard<std::mutex> lock(snapshotMutex);
+		if (freshSnapshot)
+		{
+			std::swap(readSlot, readySlot);
+			freshSnapshot = false;
+		}
+	}
+
+	const Snapshot& snapshot = snapshots[readSlot];
+
+	// Render one step behind the simulation, blending from the previous towards the current state
+	float elapsed = std::chrono::duration<float>(Clock::now() - snapshot.stamp).count();
+	float alpha = glm::clamp(elapsed / step, 0.0f, 1.0f);
+	uploadedAsleep = snapshot.asleep && alpha >= 1.0f;
+
+	uint32_t count = static_cast<uint32_t>(snapshot.current.size());
+	for (uint32_t n = 0; n < count; ++n)
+	{
+		glm::vec3 position = glm::mix(snapshot.previous[n], snapshot.current[n], alpha);
+		deformation[n] = glm::vec4(position - lattice->GetRestPosition(n), 0.0f);
+	}
+}
\ No newline at end of file
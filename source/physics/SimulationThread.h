@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "../PrecompiledHeader.h"
+#include "SBLattice.h"
+
+// Steps a soft body at a fixed rate on its own thread
+// Every step publishes the previous and current particle positions, the render thread blends between the two
+class SimulationThread
+{
+public:
+	typedef std::function<void(float)> StepFn;
+	typedef std::function<void()> InputFn;
+	typedef std::chrono::steady_clock Clock;
+
+	// stepFn advances the simulation by exactly one fixed step, it only ever runs on the simulation thread
+	SimulationThread(SBLattice* lattice, float step, StepFn stepFn);
+	~SimulationThread();
+
+	void Start();
+	void Stop();
+
+	// Input handed over to the simulation thread, applied before the next step
+	void SetNetForce(glm::vec3 force);
+	// Runs fn on the simulation thread before the next step, for input that has to read the lattice's state
+	void Post(InputFn fn);
+
+	// Render thread side, writes one deformation vec4 per node interpolated to the current time
+	void Interpolate(glm::vec4* deformation);
+	// False once the lattice sleeps and its resting state has been written out, the last upload can be reused
+	bool NeedsUpload();
+
+	uint64_t GetStepCount() const { return stepCount.load(); }
+
+private:
+	struct Snapshot
+	{
+		std::vector<glm::vec3> previous;
+		std::vector<glm::vec3> current;
+		Clock::time_point      stamp;
+		bool                   asleep;
+	};
+
+	void Loop();
+	// Copies the positions a fixed step starts from into the write slot, before stepFn moves them
+	void CaptureStepStart();
+	void Publish();
+
+	SBLattice* lattice;
+	float      step;
+	StepFn     stepFn;
+
+	std::thread           thread;
+	std::atomic<bool>     running;
+	std::atomic<uint64_t> stepCount;
+
+	// Triple buffered so neither side ever waits on the other for longer than an index swap
+	Snapshot   snapshots[3];
+	int        writeSlot, readySlot, readSlot;
+	bool       freshSnapshot;
+	std::mutex snapshotMutex;
+	// Simulation thread side, the resting state of a sleeping lattice is published once
+	bool       publishedAsleep;
+	// Render thread side, the resting state has been fully blended in
+	bool       uploadedAsleep;
+
+	glm::vec3  pendingForce;
+	bool       forceChanged;
+	std::vector<InputFn> pendingInput;
+	std::mutex inputMutex;
+};
\ No newline at end of file
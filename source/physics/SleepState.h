@@ -0,0 +1,30 @@
+#pragma once
+
+// Kinetic energy below which a body counts as resting, per unit of mass
+const float c_sleepEnergy = 1e-4f;
+// Seconds a body has to stay below the threshold before it is put to sleep
+const float c_sleepWindow = 0.5f;
+
+// Tracks how long a body or lattice island has been at rest
+struct SleepState
+{
+	bool  asleep = false;
+	float restTime = 0.0f;
+
+	// Returns true on the step the island falls asleep, a threshold of 0 never sleeps
+	bool Update(float energy, float threshold, float window, float dt)
+	{
+		if (asleep || threshold <= 0.0f)
+			return false;
+
+		restTime = energy < threshold ? restTime + dt : 0.0f;
+		asleep = restTime >= window;
+		return asleep;
+	}
+
+	void Wake()
+	{
+		asleep = false;
+		restTime = 0.0f;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "SnapshotRing.h"
+#include "PhysicsMemory.h"
+
+#include <cstring>
+
+SnapshotRing::SnapshotRing()
+{
+	block = nullptr;
+	frameSize = 0;
+	capacity = count = head = 0;
+	latest = 0;
+}
+
+SnapshotRing::~SnapshotRing()
+{
+	Free();
+}
+
+void SnapshotRing::Allocate(uint32_t frames, size_t size)
+{
+	Free();
+	if (frames == 0)
+		return;
+
+	frameSize = physics::PadBytes(size);
+	capacity = frames;
+	block = physics::AlignedMalloc(frameSize * capacity);
+	// Touch every page now, so the first lap around the ring doesn't pay for faulting them in
+	memset(block, 0, frameSize * capacity);
+}
+
+void SnapshotRing::Free()
+{
+	if (block)
+	{
+		physics::AlignedFree(block);
+	}
+
+	block = nullptr;
+	frameSize = 0;
+	capacity = count = head = 0;
+}
+
+void SnapshotRing::Clear()
+{
+	count = head = 0;
+}
+
+uint32_t SnapshotRing::Push(uint64_t& id)
+{
+	if (capacity == 0)
+		return c_noSlot;
+
+	uint32_t slot = head;
+	head = (head + 1) % capacity;
+	if (count < capacity)
+		++count;
+	id = ++latest;
+	return slot;
+}
+
+uint32_t SnapshotRing::Find(uint64_t id) const
+{
+	if (count == 0 || id == 0 || id > latest || latest - id >= count)
+		return c_noSlot;
+
+	// The newest frame sits just behind the head
+	uint32_t back = static_cast<uint32_t>(latest - id);
+	return (head + capacity - 1 - back) % capacity;
+}
\ No newline at end of file
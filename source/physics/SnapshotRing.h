@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+
+// Fixed number of equally sized frames in one cache line aligned allocation, the newest frame overwrites the oldest
+// Frames get consecutive ids starting at 1, so the id alone tells whether a frame is still held
+class SnapshotRing
+{
+public:
+	static const uint32_t c_noSlot = 0xffffffff;
+
+	SnapshotRing();
+	~SnapshotRing();
+
+	// Drops every frame held and makes room for frames of frameSize bytes each, padded to whole cache lines
+	void Allocate(uint32_t frames, size_t frameSize);
+	void Free();
+	// Drops every frame held but keeps the memory, ids carry on from where they were
+	void Clear();
+
+	// Claims the slot of the next frame, the oldest one's once the ring is full, and hands out its id
+	uint32_t Push(uint64_t& id);
+	// Slot of the frame with the given id, c_noSlot once it has been overwritten or was never saved
+	uint32_t Find(uint64_t id) const;
+	void* GetFrame(uint32_t slot) { return static_cast<char*>(block) + slot * frameSize; }
+
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetCount() const { return count; }
+	size_t   GetFrameSize() const { return frameSize; }
+	// Id of the newest frame, 0 while the ring is empty
+	uint64_t GetLatest() const { return count > 0 ? latest : 0; }
+
+private:
+	SnapshotRing(const SnapshotRing&) = delete;
+	SnapshotRing& operator=(const SnapshotRing&) = delete;
+
+	void*    block;
+	size_t   frameSize;
+	uint32_t capacity;
+	uint32_t count;
+	// Slot the next frame goes into
+	uint32_t head;
+	uint64_t latest;
+};
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "SoftBodyRest.h"
+#include "../render/VulkanModel.h"
+
+#include <stdexcept>
+
+// Rest positions of a mesh whose vertices are laid out as the soft body nodes
+static std::vector<glm::vec3> GetVertexPositions(vk::Model& m)
+{
+	std::vector<glm::vec3> positions(m.getNumVertices());
+	for (size_t n = 0; n < positions.size(); ++n)
+	{
+		positions[n] = m.getVertices()[n].pos;
+	}
+	return positions;
+}
+
+SoftBodyRest::SoftBodyRest()
+{
+	dimensionsX = dimensionsY = 0;
+	restWidth = restHeight = 0;
+}
+
+void SoftBodyRest::BuildGrid(const std::vector<glm::vec3>& rest, float width, float height, int x, int y)
+{
+	// The stencil indexes rows of x nodes, any other count reads past the positions or leaves nodes unsprung
+	if (x <= 0 || y <= 0 || rest.size() != static_cast<size_t>(x) * static_cast<size_t>(y))
+		throw std::runtime_error("grid rest positions don't match the x by y dimensions");
+
+	positions = rest;
+	dimensionsX = x;
+	dimensionsY = y;
+	restWidth = width;
+	restHeight = height;
+	topology = SpringTopology();
+}
+
+void SoftBodyRest::BuildGrid(vk::Model& model, float width, float height, int x, int y)
+{
+	BuildGrid(GetVertexPositions(model), width, height, x, y);
+}
+
+void SoftBodyRest::BuildMesh(const std::vector<glm::vec3>& rest, const SpringTopology& springs)
+{
+	positions = rest;
+	dimensionsX = dimensionsY = 0;
+	restWidth = restHeight = 0;
+	topology = springs;
+}
+
+void SoftBodyRest::BuildMesh(vk::Model& model)
+{
+	positions = GetVertexPositions(model);
+	dimensionsX = dimensionsY = 0;
+	restWidth = restHeight = 0;
+	topology.BuildFromTriangles(positions, model.getIndices(), model.getNumIndices());
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "../PrecompiledHeader.h"
+#include "SpringTopology.h"
+
+namespace vk
+{
+	class Model;
+}
+
+// The part of a soft body that never changes once built, the rest pose and the springs between the nodes
+// Lattices hold it through a shared pointer to const, so any number of identical soft bodies keep a single copy
+class SoftBodyRest
+{
+public:
+	SoftBodyRest();
+
+	// Row major x by y grid, node (i, j) at i * x + j, springs implied by the four neighbour stencil,
+	// throws when the number of positions isn't x * y
+	void BuildGrid(const std::vector<glm::vec3>& positions, float width, float height, int x, int y);
+	void BuildGrid(vk::Model& model, float width, float height, int x, int y);
+	// Any triangle mesh, springs from SpringTopology::BuildFromTriangles unless given
+	void BuildMesh(const std::vector<glm::vec3>& positions, const SpringTopology& springs);
+	void BuildMesh(vk::Model& model);
+
+	uint32_t GetNumNodes() const { return static_cast<uint32_t>(positions.size()); }
+	const std::vector<glm::vec3>& GetPositions() const { return positions; }
+	// 0 for mesh soft bodies, which carry a topology instead of grid dimensions
+	int   GetDimensionsX() const { return dimensionsX; }
+	int   GetDimensionsY() const { return dimensionsY; }
+	float GetRestWidth() const { return restWidth; }
+	float GetRestHeight() const { return restHeight; }
+	const SpringTopology& GetTopology() const { return topology; }
+
+private:
+	std::vector<glm::vec3> positions;
+	int   dimensionsX, dimensionsY;
+	float restWidth, restHeight;
+	SpringTopology topology;
+};
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "SpatialHash.h"
+
+#include <cmath>
+#include <limits>
+
+// A particle reaching into a cell along the ray sits at most this many cells from the ray's entry into it
+static const float c_neighbourReach = 3.5f;
+
+SpatialHash::SpatialHash()
+{
+	cellSize = 1.0f;
+	invCellSize = 1.0f;
+	tableMask = 0;
+	boundsMin = boundsMax = glm::vec3(0);
+}
+
+void SpatialHash::Build(const ParticleStore& store, float size)
+{
+	std::vector<const ParticleStore*> stores(1, &store);
+	Build(stores, size);
+}
+
+void SpatialHash::Build(const std::vector<const ParticleStore*>& stores, float size)
+{
+	cellSize = size;
+	invCellSize = 1.0f / size;
+
+	uint32_t count = 0;
+	for (auto store : stores)
+		count += store->count;
+
+	// Twice as many buckets as particles keeps collisions between occupied cells rare
+	uint32_t tableSize = 1;
+	while (tableSize < count * 2)
+		tableSize <<= 1;
+	tableMask = tableSize - 1;
+
+	bucketStart.assign(tableSize + 1, 0);
+	bucketOf.resize(count);
+	entries.resize(count);
+	sortedX.resize(count);
+	sortedY.resize(count);
+	sortedZ.resize(count);
+
+	// Count
+	boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+	uint32_t id = 0;
+	for (auto store : stores)
+	{
+		for (uint32_t i = 0; i < store->count; ++i, ++id)
+		{
+			boundsMin = glm::min(boundsMin, glm::vec3(store->px[i], store->py[i], store->pz[i]));
+			boundsMax = glm::max(boundsMax, glm::vec3(store->px[i], store->py[i], store->pz[i]));
+			uint32_t bucket = Hash(CellOf(store->px[i], store->py[i], store->pz[i]));
+			bucketOf[id] = bucket;
+			++bucketStart[bucket + 1];
+		}
+	}
+
+	// Prefix sum, bucketStart[b] becomes the first slot of bucket b
+	for (uint32_t b = 0; b < tableSize; ++b)
+		bucketStart[b + 1] += bucketStart[b];
+
+	// Scatter, using the following bucket's start as a running cursor
+	std::vector<uint32_t> cursor(bucketStart.begin(), bucketStart.end() - 1);
+	id = 0;
+	for (uint32_t body = 0; body < stores.size(); ++body)
+	{
+		const ParticleStore* store = stores[body];
+		for (uint32_t i = 0; i < store->count; ++i, ++id)
+		{
+			uint32_t slot = cursor[bucketOf[id]]++;
+			entries[slot].body = body;
+			entries[slot].index = i;
+			sortedX[slot] = store->px[i];
+			sortedY[slot] = store->py[i];
+			sortedZ[slot] = store->pz[i];
+		}
+	}
+}
+
+bool SpatialHash::Raycast(glm::vec3 origin, glm::vec3 dir, float radius, float maxT, uint32_t& hitSlot, float& hitT) const
+{
+	if (entries.empty())
+		return false;
+
+	// Only the stretch of the ray inside the particle bounds grown by the radius can hit anything
+	glm::vec3 invDir = 1.0f / dir;
+	glm::vec3 t0 = (boundsMin - glm::vec3(radius) - origin) * invDir;
+	glm::vec3 t1 = (boundsMax + glm::vec3(radius) - origin) * invDir;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+	if (enter > exit)
+		return false;
+
+	// Cell by cell from the entry point, t of the next boundary and the t between boundaries per axis
+	glm::vec3 start = origin + dir * enter;
+	glm::ivec3 cell = CellOf(start.x, start.y, start.z);
+	glm::ivec3 step;
+	glm::vec3 tNext, tDelta;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (dir[axis] > 0)
+		{
+			step[axis] = 1;
+			tNext[axis] = enter + ((cell[axis] + 1) * cellSize - start[axis]) * invDir[axis];
+			tDelta[axis] = cellSize * invDir[axis];
+		}
+		else if (dir[axis] < 0)
+		{
+			step[axis] = -1;
+			tNext[axis] = enter + (cell[axis] * cellSize - start[axis]) * invDir[axis];
+			tDelta[axis] = -cellSize * invDir[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			tNext[axis] = tDelta[axis] = std::numeric_limits<float>::max();
+		}
+	}
+
+	float radius2 = radius * radius;
+	float reach = c_neighbourReach * cellSize + radius;
+	bool found = false;
+	hitT = maxT;
+	for (float tCell = enter; tCell <= exit && tCell - reach <= hitT;)
+	{
+		// Particles of the neighbouring cells can reach into this one, distinct cells can share a bucket
+		uint32_t visited[27];
+		uint32_t numVisited = 0;
+		for (int z = -1; z <= 1; ++z)
+		{
+			for (int y = -1; y <= 1; ++y)
+			{
+				for (int x = -1; x <= 1; ++x)
+				{
+					uint32_t bucket = Hash(cell + glm::ivec3(x, y, z));
+					bool seen = false;
+					for (uint32_t v = 0; v < numVisited; ++v)
+						seen |= visited[v] == bucket;
+					if (seen)
+						continue;
+					visited[numVisited++] = bucket;
+
+					for (uint32_t slot = bucketStart[bucket]; slot < bucketStart[bucket + 1]; ++slot)
+					{
+						// |m - t dir|^2 = r^2, the smaller root is the entry, a ray starting inside hits at 0
+						glm::vec3 m = GetSortedPosition(slot) - origin;
+						float b = glm::dot(m, dir);
+						float disc = b * b - glm::dot(m, m) + radius2;
+						if (disc < 0)
+							continue;
+						float t = std::max(b - sqrtf(disc), 0.0f);
+						if (t < hitT && b + sqrtf(disc) >= 0)
+						{
+							hitT = t;
+							hitSlot = slot;
+							found = true;
+						}
+					}
+				}
+			}
+		}
+
+		int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+		cell[axis] += step[axis];
+		tCell = tNext[axis];
+		tNext[axis] += tDelta[axis];
+	}
+	return found;
+}
\ No newline at end of file
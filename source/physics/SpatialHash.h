@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "../PrecompiledHeader.h"
+#include "ParticleStore.h"
+
+// Uniform grid broadphase for particles
+// Cells are hashed into a power of two bucket table that is rebuilt every step with a counting sort,
+// which leaves the particles in cell sorted order so neighbouring candidates sit next to each other in memory
+class SpatialHash
+{
+public:
+	// A particle reference across every store the hash was built from
+	struct Entry
+	{
+		uint32_t body;
+		uint32_t index;
+	};
+
+	SpatialHash();
+
+	void Build(const std::vector<const ParticleStore*>& stores, float cellSize);
+	void Build(const ParticleStore& store, float cellSize);
+
+	uint32_t GetNumEntries() const { return static_cast<uint32_t>(entries.size()); }
+	float    GetCellSize() const { return cellSize; }
+	// Entries in cell sorted order
+	const std::vector<Entry>& GetSortedEntries() const { return entries; }
+
+	// Calls fn(slot) for every sorted slot whose particle is within radius of point
+	// The radius is meant to be around a cell, at most 64 distinct buckets are de-duplicated
+	template <typename Fn> void QueryRadius(glm::vec3 point, float radius, Fn fn) const;
+	// Calls fn(slot) for every sorted slot in a cell the box touches, the particle itself may lie outside the box
+	template <typename Fn> void QueryAABB(glm::vec3 min, glm::vec3 max, Fn fn) const;
+	// Calls fn(slotA, slotB) once for every pair of particles closer than radius
+	template <typename Fn> void FindPairs(float radius, Fn fn) const;
+
+	// Nearest particle whose sphere of radius the ray origin + t * dir, t in [0, maxT], passes through, dir normalised
+	// Walks the cells along the ray and stops once no later cell can beat the hit, radius should stay within a cell
+	bool Raycast(glm::vec3 origin, glm::vec3 dir, float radius, float maxT, uint32_t& slot, float& t) const;
+
+	glm::vec3 GetSortedPosition(uint32_t slot) const { return glm::vec3(sortedX[slot], sortedY[slot], sortedZ[slot]); }
+
+private:
+	glm::ivec3 CellOf(float x, float y, float z) const
+	{
+		return glm::ivec3(static_cast<int>(floorf(x * invCellSize)),
+			static_cast<int>(floorf(y * invCellSize)),
+			static_cast<int>(floorf(z * invCellSize)));
+	}
+	uint32_t Hash(glm::ivec3 cell) const
+	{
+		return ((static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u)) & tableMask;
+	}
+
+	float    cellSize, invCellSize;
+	uint32_t tableMask;
+	// Bounds of every particle, where a ray starts and stops walking cells
+	glm::vec3 boundsMin, boundsMax;
+
+	// Bucket b owns the sorted slots [bucketStart[b], bucketStart[b + 1])
+	std::vector<uint32_t> bucketStart;
+	std::vector<uint32_t> bucketOf;
+	std::vector<Entry>    entries;
+	std::vector<float>    sortedX, sortedY, sortedZ;
+};
+
+template <typename Fn>
+void SpatialHash::QueryRadius(glm::vec3 point, float radius, Fn fn) const
+{
+	if (entries.empty())
+		return;
+
+	glm::ivec3 lo = CellOf(point.x - radius, point.y - radius, point.z - radius);
+	glm::ivec3 hi = CellOf(point.x + radius, point.y + radius, point.z + radius);
+	float radius2 = radius * radius;
+
+	// Distinct cells can share a bucket, each bucket is only walked once
+	uint32_t visited[64];
+	uint32_t numVisited = 0;
+
+	for (int z = lo.z; z <= hi.z; ++z)
+	{
+		for (int y = lo.y; y <= hi.y; ++y)
+		{
+			for (int x = lo.x; x <= hi.x; ++x)
+			{
+				uint32_t bucket = Hash(glm::ivec3(x, y, z));
+				bool seen = false;
+				for (uint32_t v = 0; v < numVisited; ++v)
+					seen |= visited[v] == bucket;
+				if (seen)
+					continue;
+				if (numVisited < 64)
+					visited[numVisited++] = bucket;
+
+				for (uint32_t slot = bucketStart[bucket]; slot < bucketStart[bucket + 1]; ++slot)
+				{
+					float dx = sortedX[slot] - point.x;
+					float dy = sortedY[slot] - point.y;
+					float dz = sortedZ[slot] - point.z;
+					if (dx * dx + dy * dy + dz * dz <= radius2)
+						fn(slot);
+				}
+			}
+		}
+	}
+}
+
+template <typename Fn>
+void SpatialHash::QueryAABB(glm::vec3 min, glm::vec3 max, Fn fn) const
+{
+	if (entries.empty())
+		return;
+
+	glm::ivec3 lo = CellOf(min.x, min.y, min.z);
+	glm::ivec3 hi = CellOf(max.x, max.y, max.z);
+	glm::ivec3 extent = hi - lo + glm::ivec3(1);
+
+	// A box spanning more cells than there are buckets touches every bucket anyway
+	uint64_t numCells = static_cast<uint64_t>(extent.x) * extent.y * extent.z;
+	if (numCells > tableMask + 1)
+	{
+		for (uint32_t slot = 0; slot < entries.size(); ++slot)
+		{
+			if (sortedX[slot] >= min.x && sortedX[slot] <= max.x &&
+				sortedY[slot] >= min.y && sortedY[slot] <= max.y &&
+				sortedZ[slot] >= min.z && sortedZ[slot] <= max.z)
+				fn(slot);
+		}
+		return;
+	}
+
+	// Distinct cells can share a bucket, each bucket is only walked once
+	std::vector<uint32_t> buckets;
+	buckets.reserve(static_cast<size_t>(numCells));
+	for (int z = lo.z; z <= hi.z; ++z)
+	{
+		for (int y = lo.y; y <= hi.y; ++y)
+		{
+			for (int x = lo.x; x <= hi.x; ++x)
+				buckets.push_back(Hash(glm::ivec3(x, y, z)));
+		}
+	}
+	std::sort(buckets.begin(), buckets.end());
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+	for (uint32_t bucket : buckets)
+	{
+		for (uint32_t slot = bucketStart[bucket]; slot < bucketStart[bucket + 1]; ++slot)
+			fn(slot);
+	}
+}
+
+template <typename Fn>
+void SpatialHash::FindPairs(float radius, Fn fn) const
+{
+	// Walking the sorted slots keeps each query next to the previous one in memory
+	for (uint32_t slot = 0; slot < entries.size(); ++slot)
+	{
+		QueryRadius(GetSortedPosition(slot), radius, [&](uint32_t other)
+		{
+			if (other > slot)
+				fn(slot, other);
+		});
+	}
+}
\ No newline at end of file
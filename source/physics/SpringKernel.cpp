@@ -0,0 +1,229 @@
+#include "SpringKernel.h"
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <random>
+
+#ifdef FORNAX_SIMD_X86
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+template<class Law>
+void SpringKernel_Scalar(const SpringKernelParams& p, int row, int colBegin, int colEnd)
+{
+	for (int j = colBegin; j < colEnd; ++j)
+	{
+		uint32_t node = row * p.dimensionsX + j;
+		AccumulateSpring<Law>(p, node, node - p.dimensionsX, p.restHeight);
+		AccumulateSpring<Law>(p, node, node + p.dimensionsX, p.restHeight);
+		AccumulateSpring<Law>(p, node, node - 1, p.restWidth);
+		AccumulateSpring<Law>(p, node, node + 1, p.restWidth);
+	}
+}
+
+template void SpringKernel_Scalar<LinearSpring>(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+template void SpringKernel_Scalar<NonlinearSpring>(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+
+#ifdef FORNAX_SIMD_X86
+
+// LinearSpring::Scale and NonlinearSpring::Scale four springs at a time
+template<class Law> static inline __m128 SpringScaleSSE(__m128 k, __m128 c, __m128 magnitude, __m128 rest);
+
+template<> inline __m128 SpringScaleSSE<LinearSpring>(__m128 k, __m128, __m128 magnitude, __m128 rest)
+{
+	return _mm_div_ps(_mm_mul_ps(k, _mm_sub_ps(magnitude, rest)), magnitude);
+}
+
+template<> inline __m128 SpringScaleSSE<NonlinearSpring>(__m128 k, __m128 c, __m128 magnitude, __m128 rest)
+{
+	__m128 stretch = _mm_sub_ps(magnitude, rest);
+	__m128 strain = _mm_div_ps(stretch, rest);
+	__m128 stiffening = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_mul_ps(c, strain), strain));
+	return _mm_div_ps(_mm_mul_ps(_mm_mul_ps(k, stretch), stiffening), magnitude);
+}
+
+template<class Law>
+static inline void SpringSSE(__m128 x, __m128 y, __m128 z, const float* nx, const float* ny, const float* nz,
+	__m128 k, __m128 c, __m128 rest, __m128& fx, __m128& fy, __m128& fz)
+{
+	__m128 dx = _mm_sub_ps(_mm_loadu_ps(nx), x);
+	__m128 dy = _mm_sub_ps(_mm_loadu_ps(ny), y);
+	__m128 dz = _mm_sub_ps(_mm_loadu_ps(nz), z);
+
+	__m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+	__m128 scale = SpringScaleSSE<Law>(k, c, magnitude, rest);
+
+	fx = _mm_add_ps(fx, _mm_mul_ps(scale, dx));
+	fy = _mm_add_ps(fy, _mm_mul_ps(scale, dy));
+	fz = _mm_add_ps(fz, _mm_mul_ps(scale, dz));
+}
+
+template<class Law>
+void SpringKernel_SSE(const SpringKernelParams& p, int row, int colBegin, int colEnd)
+{
+	const int stride = p.dimensionsX;
+	const __m128 k = _mm_set1_ps(p.coefficient);
+	const __m128 c = _mm_set1_ps(p.nonlinearity);
+	const __m128 restW = _mm_set1_ps(p.restWidth);
+	const __m128 restH = _mm_set1_ps(p.restHeight);
+	// Every interior node has four springs, each adding -v * d
+	const __m128 damp = _mm_set1_ps(4.0f * p.dampening);
+
+	int j = colBegin;
+	for (; j + 4 <= colEnd; j += 4)
+	{
+		int n = row * stride + j;
+		__m128 x = _mm_loadu_ps(p.px + n);
+		__m128 y = _mm_loadu_ps(p.py + n);
+		__m128 z = _mm_loadu_ps(p.pz + n);
+		__m128 fx = _mm_setzero_ps();
+		__m128 fy = _mm_setzero_ps();
+		__m128 fz = _mm_setzero_ps();
+
+		SpringSSE<Law>(x, y, z, p.px + n - stride, p.py + n - stride, p.pz + n - stride, k, c, restH, fx, fy, fz);
+		SpringSSE<Law>(x, y, z, p.px + n + stride, p.py + n + stride, p.pz + n + stride, k, c, restH, fx, fy, fz);
+		SpringSSE<Law>(x, y, z, p.px + n - 1, p.py + n - 1, p.pz + n - 1, k, c, restW, fx, fy, fz);
+		SpringSSE<Law>(x, y, z, p.px + n + 1, p.py + n + 1, p.pz + n + 1, k, c, restW, fx, fy, fz);
+
+		fx = _mm_sub_ps(fx, _mm_mul_ps(_mm_loadu_ps(p.vx + n), damp));
+		fy = _mm_sub_ps(fy, _mm_mul_ps(_mm_loadu_ps(p.vy + n), damp));
+		fz = _mm_sub_ps(fz, _mm_mul_ps(_mm_loadu_ps(p.vz + n), damp));
+
+		_mm_storeu_ps(p.fx + n, _mm_add_ps(_mm_loadu_ps(p.fx + n), fx));
+		_mm_storeu_ps(p.fy + n, _mm_add_ps(_mm_loadu_ps(p.fy + n), fy));
+		_mm_storeu_ps(p.fz + n, _mm_add_ps(_mm_loadu_ps(p.fz + n), fz));
+	}
+
+	SpringKernel_Scalar<Law>(p, row, j, colEnd);
+}
+
+template void SpringKernel_SSE<LinearSpring>(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+template void SpringKernel_SSE<NonlinearSpring>(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+
+static bool CpuSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// The OS has to save the ymm registers as well
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef FORNAX_SIMD_X86
+	static const SimdLevel level = CpuSupportsAVX2() ? SIMD_AVX2 : SIMD_SSE;
+	return level;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+template<class Law>
+static SpringKernelFn SelectLawKernel(SimdLevel level)
+{
+	switch (level)
+	{
+#ifdef FORNAX_SIMD_X86
+	case SIMD_AVX2:
+		return SpringKernel_AVX2<Law>;
+	case SIMD_SSE:
+		return SpringKernel_SSE<Law>;
+#endif
+	default:
+		return SpringKernel_Scalar<Law>;
+	}
+}
+
+SpringKernelFn SelectSpringKernel(SimdLevel level, SpringLaw law)
+{
+	if (level > DetectSimdLevel())
+		level = DetectSimdLevel();
+
+	if (law == SPRING_NONLINEAR)
+		return SelectLawKernel<NonlinearSpring>(level);
+	return SelectLawKernel<LinearSpring>(level);
+}
+
+bool VerifySpringKernel(SpringKernelFn kernel, SpringLaw law, float tolerance)
+{
+	// Odd width so both the vector body and the scalar tail are exercised
+	const int dimX = 23, dimY = 5;
+	const int count = dimX * dimY;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+
+	std::vector<float> streams[9];
+	for (auto& stream : streams)
+		stream.resize(count);
+	std::vector<float> reference[3];
+	for (auto& stream : reference)
+		stream.assign(count, 0.0f);
+
+	for (int i = 0; i < dimY; ++i)
+	{
+		for (int j = 0; j < dimX; ++j)
+		{
+			int n = i * dimX + j;
+			streams[0][n] = j * 0.1f + jitter(rng);
+			streams[1][n] = i * 0.1f + jitter(rng);
+			streams[2][n] = jitter(rng);
+			streams[3][n] = jitter(rng);
+			streams[4][n] = jitter(rng);
+			streams[5][n] = jitter(rng);
+		}
+	}
+
+	SpringKernelParams p;
+	p.px = streams[0].data(); p.py = streams[1].data(); p.pz = streams[2].data();
+	p.vx = streams[3].data(); p.vy = streams[4].data(); p.vz = streams[5].data();
+	p.dimensionsX = dimX;
+	p.coefficient = 25.0f;
+	p.dampening = 0.75f;
+	p.restWidth = 0.1f;
+	p.restHeight = 0.1f;
+	// Large enough that the jittered strains make the nonlinear term count
+	p.nonlinearity = 4.0f;
+
+	SpringKernelFn scalar = SelectSpringKernel(SIMD_SCALAR, law);
+	p.fx = reference[0].data(); p.fy = reference[1].data(); p.fz = reference[2].data();
+	for (int i = 1; i < dimY - 1; ++i)
+		scalar(p, i, 1, dimX - 1);
+
+	p.fx = streams[6].data(); p.fy = streams[7].data(); p.fz = streams[8].data();
+	for (int i = 1; i < dimY - 1; ++i)
+		kernel(p, i, 1, dimX - 1);
+
+	for (int n = 0; n < count; ++n)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			float expected = reference[c][n];
+			float error = fabsf(streams[6 + c][n] - expected);
+			if (error > tolerance * std::max(1.0f, fabsf(expected)))
+				return false;
+		}
+	}
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FORNAX_SIMD_X86 1
+#endif
+
+enum SimdLevel
+{
+	SIMD_SCALAR,
+	SIMD_SSE,
+	SIMD_AVX2
+};
+
+enum SpringLaw
+{
+	// Hooke's law, k (|d| - rest)
+	SPRING_LINEAR,
+	// Stiffens as it stretches or compresses, k (|d| - rest) (1 + c e^2) with strain e = (|d| - rest) / rest
+	SPRING_NONLINEAR
+};
+
+// Everything a spring kernel touches, laid out over the lattice SoA streams
+struct SpringKernelParams
+{
+	const float *px, *py, *pz;
+	const float *vx, *vy, *vz;
+	float *fx, *fy, *fz;
+
+	int dimensionsX;
+	float coefficient;
+	float dampening;
+	float restWidth;
+	float restHeight;
+	// c of the nonlinear law, unused by the linear one
+	float nonlinearity;
+};
+
+// Spring law policies, the kernels are instantiated per law so the choice costs nothing per spring
+// Scale is the force along d divided by |d|, what d gets multiplied by
+struct LinearSpring
+{
+	static float Scale(float k, float, float magnitude, float restLength)
+	{
+		// k * (|d| - rest) * d / |d|
+		return k * (magnitude - restLength) / magnitude;
+	}
+};
+
+struct NonlinearSpring
+{
+	static float Scale(float k, float nonlinearity, float magnitude, float restLength)
+	{
+		float stretch = magnitude - restLength;
+		float strain = stretch / restLength;
+		return k * stretch * (1.0f + nonlinearity * strain * strain) / magnitude;
+	}
+};
+
+// Accumulates the four neighbour springs of the interior nodes [colBegin, colEnd) of a row
+// Interior means every node in the range has all four neighbours, border nodes take the scalar path
+typedef void (*SpringKernelFn)(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+
+// Instantiated in SpringKernel.cpp and SpringKernelAVX2.cpp for LinearSpring and NonlinearSpring
+template<class Law> void SpringKernel_Scalar(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+#ifdef FORNAX_SIMD_X86
+template<class Law> void SpringKernel_SSE(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+template<class Law> void SpringKernel_AVX2(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+#endif
+
+// Highest instruction set the running CPU supports
+SimdLevel DetectSimdLevel();
+// Kernel for the law at the requested level, the level clamped to what the CPU supports
+SpringKernelFn SelectSpringKernel(SimdLevel level, SpringLaw law = SPRING_LINEAR);
+// Runs a kernel against the scalar kernel of its law on a randomised lattice, true if every force is within tolerance
+bool VerifySpringKernel(SpringKernelFn kernel, SpringLaw law, float tolerance);
+
+// One spring from node to neighbour, shared by the scalar kernel and the border path
+template<class Law>
+inline void AccumulateSpring(const SpringKernelParams& p, uint32_t node, uint32_t neighbour, float restLength)
+{
+	float dx = p.px[neighbour] - p.px[node];
+	float dy = p.py[neighbour] - p.py[node];
+	float dz = p.pz[neighbour] - p.pz[node];
+
+	float magnitude = sqrtf(dx * dx + dy * dy + dz * dz);
+	float scale = Law::Scale(p.coefficient, p.nonlinearity, magnitude, restLength);
+
+	p.fx[node] += scale * dx - p.vx[node] * p.dampening;
+	p.fy[node] += scale * dy - p.vy[node] * p.dampening;
+	p.fz[node] += scale * dz - p.vz[node] * p.dampening;
+}
\ No newline at end of file
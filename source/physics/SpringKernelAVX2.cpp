@@ -0,0 +1,81 @@
+// Compiled with AVX2 code generation enabled, only ever called after DetectSimdLevel reports support
+#include "SpringKernel.h"
+
+#ifdef FORNAX_SIMD_X86
+#include <immintrin.h>
+
+// LinearSpring::Scale and NonlinearSpring::Scale eight springs at a time
+template<class Law> static inline __m256 SpringScaleAVX2(__m256 k, __m256 c, __m256 magnitude, __m256 rest);
+
+template<> inline __m256 SpringScaleAVX2<LinearSpring>(__m256 k, __m256, __m256 magnitude, __m256 rest)
+{
+	return _mm256_div_ps(_mm256_mul_ps(k, _mm256_sub_ps(magnitude, rest)), magnitude);
+}
+
+template<> inline __m256 SpringScaleAVX2<NonlinearSpring>(__m256 k, __m256 c, __m256 magnitude, __m256 rest)
+{
+	__m256 stretch = _mm256_sub_ps(magnitude, rest);
+	__m256 strain = _mm256_div_ps(stretch, rest);
+	__m256 stiffening = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_mul_ps(c, strain), strain));
+	return _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(k, stretch), stiffening), magnitude);
+}
+
+template<class Law>
+static inline void SpringAVX2(__m256 x, __m256 y, __m256 z, const float* nx, const float* ny, const float* nz,
+	__m256 k, __m256 c, __m256 rest, __m256& fx, __m256& fy, __m256& fz)
+{
+	__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(nx), x);
+	__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ny), y);
+	__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(nz), z);
+
+	__m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+	__m256 scale = SpringScaleAVX2<Law>(k, c, magnitude, rest);
+
+	fx = _mm256_add_ps(fx, _mm256_mul_ps(scale, dx));
+	fy = _mm256_add_ps(fy, _mm256_mul_ps(scale, dy));
+	fz = _mm256_add_ps(fz, _mm256_mul_ps(scale, dz));
+}
+
+template<class Law>
+void SpringKernel_AVX2(const SpringKernelParams& p, int row, int colBegin, int colEnd)
+{
+	const int stride = p.dimensionsX;
+	const __m256 k = _mm256_set1_ps(p.coefficient);
+	const __m256 c = _mm256_set1_ps(p.nonlinearity);
+	const __m256 restW = _mm256_set1_ps(p.restWidth);
+	const __m256 restH = _mm256_set1_ps(p.restHeight);
+	const __m256 damp = _mm256_set1_ps(4.0f * p.dampening);
+
+	int j = colBegin;
+	for (; j + 8 <= colEnd; j += 8)
+	{
+		int n = row * stride + j;
+		__m256 x = _mm256_loadu_ps(p.px + n);
+		__m256 y = _mm256_loadu_ps(p.py + n);
+		__m256 z = _mm256_loadu_ps(p.pz + n);
+		__m256 fx = _mm256_setzero_ps();
+		__m256 fy = _mm256_setzero_ps();
+		__m256 fz = _mm256_setzero_ps();
+
+		SpringAVX2<Law>(x, y, z, p.px + n - stride, p.py + n - stride, p.pz + n - stride, k, c, restH, fx, fy, fz);
+		SpringAVX2<Law>(x, y, z, p.px + n + stride, p.py + n + stride, p.pz + n + stride, k, c, restH, fx, fy, fz);
+		SpringAVX2<Law>(x, y, z, p.px + n - 1, p.py + n - 1, p.pz + n - 1, k, c, restW, fx, fy, fz);
+		SpringAVX2<Law>(x, y, z, p.px + n + 1, p.py + n + 1, p.pz + n + 1, k, c, restW, fx, fy, fz);
+
+		fx = _mm256_sub_ps(fx, _mm256_mul_ps(_mm256_loadu_ps(p.vx + n), damp));
+		fy = _mm256_sub_ps(fy, _mm256_mul_ps(_mm256_loadu_ps(p.vy + n), damp));
+		fz = _mm256_sub_ps(fz, _mm256_mul_ps(_mm256_loadu_ps(p.vz + n), damp));
+
+		_mm256_storeu_ps(p.fx + n, _mm256_add_ps(_mm256_loadu_ps(p.fx + n), fx));
+		_mm256_storeu_ps(p.fy + n, _mm256_add_ps(_mm256_loadu_ps(p.fy + n), fy));
+		_mm256_storeu_ps(p.fz + n, _mm256_add_ps(_mm256_loadu_ps(p.fz + n), fz));
+	}
+
+	// Fewer than eight nodes left, finish them four wide
+	SpringKernel_SSE<Law>(p, row, j, colEnd);
+}
+
+template void SpringKernel_AVX2<LinearSpring>(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+template void SpringKernel_AVX2<NonlinearSpring>(const SpringKernelParams& p, int row, int colBegin, int colEnd);
+
+#endif
\ No newline at end of file
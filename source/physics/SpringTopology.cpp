@@ -0,0 +1,204 @@
+#include "SpringTopology.h"
+#include "ConstraintBatches.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+// Cosine below which two springs leaving a node count as one straight line for bending
+static const float c_bendStraightness = -0.95f;
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+	return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+SpringTopology::SpringTopology()
+{
+	Clear(0);
+}
+
+void SpringTopology::Clear(uint32_t nodes)
+{
+	numNodes = nodes;
+	for (uint32_t t = 0; t < SPRING_TYPE_COUNT; ++t)
+		typeCount[t] = 0;
+
+	springA.clear();
+	springB.clear();
+	restLength.clear();
+	type.clear();
+	colorStart.assign(1, 0);
+	nodeOffsets.assign(nodes + 1, 0);
+	nodeSprings.clear();
+}
+
+void SpringTopology::AddSpring(uint32_t a, uint32_t b, float rest, SpringType springType)
+{
+	springA.push_back(a);
+	springB.push_back(b);
+	restLength.push_back(rest);
+	type.push_back(static_cast<uint8_t>(springType));
+	++typeCount[springType];
+}
+
+void SpringTopology::BuildGrid(int x, int y, float restWidth, float restHeight)
+{
+	Clear(x * y);
+
+	for (int i = 0; i < y; ++i)
+	{
+		for (int j = 0; j < x; ++j)
+		{
+			uint32_t node = i * x + j;
+			if (j < x - 1)
+				AddSpring(node, node + 1, restWidth, SPRING_STRUCTURAL);
+			if (i < y - 1)
+				AddSpring(node, node + x, restHeight, SPRING_STRUCTURAL);
+		}
+	}
+
+	Finalize();
+}
+
+void SpringTopology::BuildFromTriangles(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices)
+{
+	Clear(static_cast<uint32_t>(positions.size()));
+
+	// Every distinct triangle edge in first seen order, with the corners opposite it
+	struct Edge
+	{
+		uint32_t a, b;
+		uint32_t opposite[2];
+		uint32_t numTriangles;
+	};
+	std::vector<Edge> edges;
+	std::unordered_map<uint64_t, uint32_t> edgeIndex;
+
+	for (size_t t = 0; t + 2 < numIndices; t += 3)
+	{
+		const uint32_t corners[3] = { indices[t], indices[t + 1], indices[t + 2] };
+		for (int e = 0; e < 3; ++e)
+		{
+			uint32_t a = corners[e];
+			uint32_t b = corners[(e + 1) % 3];
+			uint32_t c = corners[(e + 2) % 3];
+			if (a == b)
+				continue;
+
+			auto found = edgeIndex.find(EdgeKey(a, b));
+			if (found == edgeIndex.end())
+			{
+				Edge edge = { a, b, { c, c }, 1 };
+				edgeIndex[EdgeKey(a, b)] = static_cast<uint32_t>(edges.size());
+				edges.push_back(edge);
+			}
+			else if (edges[found->second].numTriangles == 1)
+			{
+				edges[found->second].opposite[1] = c;
+				edges[found->second].numTriangles = 2;
+			}
+		}
+	}
+
+	std::unordered_set<uint64_t> springs;
+	std::vector<std::vector<uint32_t>> structuralNeighbours(numNodes);
+
+	for (const Edge& edge : edges)
+	{
+		springs.insert(EdgeKey(edge.a, edge.b));
+		AddSpring(edge.a, edge.b, glm::distance(positions[edge.a], positions[edge.b]), SPRING_STRUCTURAL);
+		structuralNeighbours[edge.a].push_back(edge.b);
+		structuralNeighbours[edge.b].push_back(edge.a);
+	}
+
+	// The longest edge of a triangulated quad is its diagonal, the far corners make up the other one
+	auto isLongestEdge = [&](const Edge& edge, uint32_t opposite)
+	{
+		float length = glm::distance(positions[edge.a], positions[edge.b]);
+		return length >= glm::distance(positions[edge.a], positions[opposite]) &&
+			length >= glm::distance(positions[edge.b], positions[opposite]);
+	};
+	for (const Edge& edge : edges)
+	{
+		if (edge.numTriangles != 2 || edge.opposite[0] == edge.opposite[1])
+			continue;
+		if (!isLongestEdge(edge, edge.opposite[0]) || !isLongestEdge(edge, edge.opposite[1]))
+			continue;
+		if (!springs.insert(EdgeKey(edge.opposite[0], edge.opposite[1])).second)
+			continue;
+
+		AddSpring(edge.opposite[0], edge.opposite[1], glm::distance(positions[edge.opposite[0]], positions[edge.opposite[1]]), SPRING_SHEAR);
+	}
+
+	for (uint32_t node = 0; node < numNodes; ++node)
+	{
+		const std::vector<uint32_t>& neighbours = structuralNeighbours[node];
+		for (size_t p = 0; p < neighbours.size(); ++p)
+		{
+			for (size_t q = p + 1; q < neighbours.size(); ++q)
+			{
+				glm::vec3 toP = positions[neighbours[p]] - positions[node];
+				glm::vec3 toQ = positions[neighbours[q]] - positions[node];
+				float lengths = glm::length(toP) * glm::length(toQ);
+				if (lengths <= 0.0f || glm::dot(toP, toQ) > c_bendStraightness * lengths)
+					continue;
+				if (!springs.insert(EdgeKey(neighbours[p], neighbours[q])).second)
+					continue;
+
+				AddSpring(neighbours[p], neighbours[q], glm::distance(positions[neighbours[p]], positions[neighbours[q]]), SPRING_BEND);
+			}
+		}
+	}
+
+	Finalize();
+}
+
+void SpringTopology::Finalize()
+{
+	std::vector<uint32_t> order;
+	ColorEdges(springA.data(), springB.data(), springA.size(), numNodes, order, colorStart);
+
+	std::vector<uint32_t> a(order.size()), b(order.size());
+	std::vector<float>    rest(order.size());
+	std::vector<uint8_t>  types(order.size());
+	for (size_t s = 0; s < order.size(); ++s)
+	{
+		a[s] = springA[order[s]];
+		b[s] = springB[order[s]];
+		rest[s] = restLength[order[s]];
+		types[s] = type[order[s]];
+	}
+	springA.swap(a);
+	springB.swap(b);
+	restLength.swap(rest);
+	type.swap(types);
+
+	// Counting sort of the spring ends into the adjacency
+	nodeOffsets.assign(numNodes + 1, 0);
+	for (size_t s = 0; s < springA.size(); ++s)
+	{
+		++nodeOffsets[springA[s] + 1];
+		++nodeOffsets[springB[s] + 1];
+	}
+	for (uint32_t n = 0; n < numNodes; ++n)
+		nodeOffsets[n + 1] += nodeOffsets[n];
+
+	std::vector<uint32_t> cursor(nodeOffsets.begin(), nodeOffsets.end() - 1);
+	nodeSprings.resize(2 * springA.size());
+	for (size_t s = 0; s < springA.size(); ++s)
+	{
+		nodeSprings[cursor[springA[s]]++] = static_cast<uint32_t>(s);
+		nodeSprings[cursor[springB[s]]++] = static_cast<uint32_t>(s);
+	}
+}
+
+bool SpringTopology::AreConnected(uint32_t a, uint32_t b) const
+{
+	for (uint32_t i = nodeOffsets[a]; i < nodeOffsets[a + 1]; ++i)
+	{
+		uint32_t s = nodeSprings[i];
+		if (springA[s] == b || springB[s] == b)
+			return true;
+	}
+	return false;
+}
\ No newline at end of file
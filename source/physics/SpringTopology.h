@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "../PrecompiledHeader.h"
+
+enum SpringType
+{
+	SPRING_STRUCTURAL,
+	SPRING_SHEAR,
+	SPRING_BEND,
+	SPRING_TYPE_COUNT
+};
+
+// Springs of a soft body as an edge list, every spring stored once
+// Springs are grouped by colour so no two springs of one colour share a node and a colour can scatter to both ends in parallel,
+// the CSR adjacency lists the springs touching every node
+class SpringTopology
+{
+public:
+	SpringTopology();
+
+	// Every triangle edge is a structural spring, the far corners of two triangles sharing their longest edge get a shear spring
+	// and nodes two structural springs apart along a near straight line get a bend spring
+	void BuildFromTriangles(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t numIndices);
+	// The row major four neighbour grid of SBLattice, structural springs only
+	void BuildGrid(int x, int y, float restWidth, float restHeight);
+
+	uint32_t GetNumNodes() const { return numNodes; }
+	uint32_t GetNumSprings() const { return static_cast<uint32_t>(springA.size()); }
+	uint32_t GetNumSprings(SpringType type) const { return typeCount[type]; }
+
+	uint32_t GetNumColors() const { return static_cast<uint32_t>(colorStart.size()) - 1; }
+	uint32_t GetColorBegin(uint32_t c) const { return colorStart[c]; }
+	uint32_t GetColorEnd(uint32_t c) const { return colorStart[c + 1]; }
+
+	// Spring arrays, in colour order
+	const uint32_t* GetNodeA() const { return springA.data(); }
+	const uint32_t* GetNodeB() const { return springB.data(); }
+	const float*    GetRestLengths() const { return restLength.data(); }
+	const uint8_t*  GetTypes() const { return type.data(); }
+
+	// Springs touching node n are GetNodeSprings()[GetNodeBegin(n) .. GetNodeBegin(n + 1))
+	uint32_t        GetNodeBegin(uint32_t n) const { return nodeOffsets[n]; }
+	const uint32_t* GetNodeSprings() const { return nodeSprings.data(); }
+	bool            AreConnected(uint32_t a, uint32_t b) const;
+
+private:
+	void Clear(uint32_t nodes);
+	void AddSpring(uint32_t a, uint32_t b, float rest, SpringType springType);
+	// Colours the springs and builds the adjacency
+	void Finalize();
+
+	uint32_t numNodes;
+	uint32_t typeCount[SPRING_TYPE_COUNT];
+
+	std::vector<uint32_t> springA, springB;
+	std::vector<float>    restLength;
+	std::vector<uint8_t>  type;
+	std::vector<uint32_t> colorStart;
+
+	std::vector<uint32_t> nodeOffsets;
+	std::vector<uint32_t> nodeSprings;
+};
\ No newline at end of file
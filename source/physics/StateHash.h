@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// FNV-1a offset basis, the hash of no bytes at all
+const uint64_t c_stateHashSeed = 14695981039346656037ull;
+
+// FNV-1a taking eight bytes at a time, cheap enough to run over the whole state every step. Feeding every step's
+// state into the last step's hash leaves one value that two runs only share if they matched bit for bit on every step
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	size_t b = 0;
+	for (; b + sizeof(uint64_t) <= size; b += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, bytes + b, sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+	for (; b < size; ++b)
+	{
+		hash ^= bytes[b];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
\ No newline at end of file
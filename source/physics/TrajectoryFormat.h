@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../PrecompiledHeader.h"
+
+// Binary trajectory of a lattice, one frame per recorded step
+// Header, rest positions, then the frames in chunks of framesPerChunk, then the index with the file offset of every
+// frame. Every section and every frame starts on a cache line, so a mapped file can be read in place
+enum TrajectoryEncoding
+{
+	// Offsets from the rest pose as vec4s with w = 0, the exact layout of the deformation upload
+	TRAJECTORY_RAW,
+	// Offsets from the rest pose as four 16 bit multiples of the quantum, half the size of raw
+	TRAJECTORY_QUANTIZED,
+	// The first frame of every chunk raw, the others as 16 bit multiples of the quantum away from it, so the
+	// quantum only has to cover the motion within a chunk rather than the whole offset
+	TRAJECTORY_DELTA
+};
+
+const char     c_trajectoryMagic[8] = { 'F', 'N', 'X', 'T', 'R', 'A', 'J', '\0' };
+const uint32_t c_trajectoryVersion = 1;
+
+struct TrajectoryHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t encoding;
+	uint32_t numNodes;
+	uint32_t framesPerChunk;
+	// Simulated time between frames, and the size of one 16 bit step of the encoded offsets
+	float    step;
+	float    quantum;
+	// Both 0 until the recorder is closed, a file without an index is an interrupted recording
+	uint64_t numFrames;
+	uint64_t indexOffset;
+	uint64_t restOffset;
+};
+
+// Bytes of one frame, before padding it to a cache line
+inline size_t GetTrajectoryFrameSize(TrajectoryEncoding encoding, uint32_t numNodes, bool keyframe)
+{
+	if (encoding == TRAJECTORY_RAW || (encoding == TRAJECTORY_DELTA && keyframe))
+		return sizeof(glm::vec4) * numNodes;
+	return sizeof(int16_t) * 4 * numNodes;
+}
\ No newline at end of file
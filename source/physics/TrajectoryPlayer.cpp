@@ -0,0 +1,160 @@
+#include "TrajectoryPlayer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TrajectoryPlayer::TrajectoryPlayer()
+{
+	data = nullptr;
+	size = 0;
+	header = nullptr;
+	rest = nullptr;
+	index = nullptr;
+#ifdef _WIN32
+	fileHandle = mappingHandle = nullptr;
+#endif
+}
+
+TrajectoryPlayer::~TrajectoryPlayer()
+{
+	Close();
+}
+
+void TrajectoryPlayer::Open(const std::string& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE fileH = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileH == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("failed to open trajectory file " + path);
+	fileHandle = fileH;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileH, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		throw std::runtime_error("failed to map trajectory file " + path);
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+
+	mappingHandle = CreateFileMappingA(fileH, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle)
+		data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr)
+	{
+		Close();
+		throw std::runtime_error("failed to map trajectory file " + path);
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("failed to open trajectory file " + path);
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		throw std::runtime_error("failed to map trajectory file " + path);
+	}
+	size = static_cast<size_t>(info.st_size);
+
+	// The mapping keeps the file alive on its own
+	void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		size = 0;
+		throw std::runtime_error("failed to map trajectory file " + path);
+	}
+	data = static_cast<const char*>(mapped);
+#endif
+
+	// Only the layout is checked, the frames are used as they are
+	header = reinterpret_cast<const TrajectoryHeader*>(data);
+	bool valid = size >= sizeof(TrajectoryHeader) && memcmp(header->magic, c_trajectoryMagic, sizeof(header->magic)) == 0
+		&& header->version == c_trajectoryVersion && header->encoding <= TRAJECTORY_DELTA && header->framesPerChunk > 0;
+	if (valid && header->indexOffset == 0)
+	{
+		Close();
+		throw std::runtime_error("trajectory file " + path + " was never closed");
+	}
+	valid = valid && header->restOffset + sizeof(glm::vec3) * header->numNodes <= size
+		&& header->indexOffset + sizeof(uint64_t) * header->numFrames <= size;
+	if (valid)
+	{
+		rest = reinterpret_cast<const glm::vec3*>(data + header->restOffset);
+		index = reinterpret_cast<const uint64_t*>(data + header->indexOffset);
+		for (uint64_t f = 0; f < header->numFrames && valid; ++f)
+			valid = index[f] + GetTrajectoryFrameSize(GetEncoding(), header->numNodes, IsKeyframe(f)) <= header->indexOffset;
+	}
+	if (!valid)
+	{
+		Close();
+		throw std::runtime_error("not a valid trajectory file " + path);
+	}
+}
+
+void TrajectoryPlayer::Close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+	fileHandle = mappingHandle = nullptr;
+#else
+	if (data)
+		munmap(const_cast<char*>(data), size);
+#endif
+
+	data = nullptr;
+	size = 0;
+	header = nullptr;
+	rest = nullptr;
+	index = nullptr;
+}
+
+const glm::vec4* TrajectoryPlayer::GetFrame(uint64_t frame) const
+{
+	if (frame >= GetFrameCount() || (GetEncoding() != TRAJECTORY_RAW && !IsKeyframe(frame)))
+		return nullptr;
+	return reinterpret_cast<const glm::vec4*>(GetFrameData(frame));
+}
+
+void TrajectoryPlayer::WriteDeformation(uint64_t frame, glm::vec4* deformation) const
+{
+	if (frame >= GetFrameCount())
+		return;
+
+	uint32_t numNodes = header->numNodes;
+	const glm::vec4* stored = GetFrame(frame);
+	if (stored)
+	{
+		memcpy(deformation, stored, sizeof(glm::vec4) * numNodes);
+		return;
+	}
+
+	// Quantized frames step from the rest pose, delta frames from their chunk's keyframe
+	const int16_t* steps = reinterpret_cast<const int16_t*>(GetFrameData(frame));
+	const glm::vec4* base = GetEncoding() == TRAJECTORY_DELTA ? GetFrame(frame - frame % header->framesPerChunk) : nullptr;
+	float quantum = header->quantum;
+	for (uint32_t n = 0; n < numNodes; ++n)
+	{
+		glm::vec4 offset(steps[n * 4 + 0] * quantum, steps[n * 4 + 1] * quantum, steps[n * 4 + 2] * quantum, 0.0f);
+		deformation[n] = base ? base[n] + offset : offset;
+	}
+}
\ No newline at end of file
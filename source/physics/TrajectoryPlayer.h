@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+#include "../PrecompiledHeader.h"
+#include "TrajectoryFormat.h"
+
+// Plays a recorded trajectory back straight out of the memory mapped file
+// Nothing is read up front, the header is checked and every frame is found through the file's own index
+class TrajectoryPlayer
+{
+public:
+	TrajectoryPlayer();
+	~TrajectoryPlayer();
+
+	// Maps the file, throws if it isn't a finished trajectory
+	void Open(const std::string& path);
+	void Close();
+
+	bool     IsOpen() const { return data != nullptr; }
+	uint64_t GetFrameCount() const { return header ? header->numFrames : 0; }
+	uint32_t GetNumNodes() const { return header ? header->numNodes : 0; }
+	float    GetStep() const { return header ? header->step : 0.0f; }
+	TrajectoryEncoding GetEncoding() const { return static_cast<TrajectoryEncoding>(header->encoding); }
+	const glm::vec3* GetRestPositions() const { return rest; }
+
+	// The frame as the deformation upload reads it, pointing into the mapping, nullptr for frames stored encoded
+	const glm::vec4* GetFrame(uint64_t frame) const;
+	// One vec4 per node into deformation, a copy for raw frames and a decode for the others
+	void WriteDeformation(uint64_t frame, glm::vec4* deformation) const;
+
+private:
+	TrajectoryPlayer(const TrajectoryPlayer&) = delete;
+	TrajectoryPlayer& operator=(const TrajectoryPlayer&) = delete;
+
+	bool IsKeyframe(uint64_t frame) const { return GetEncoding() == TRAJECTORY_DELTA && frame % header->framesPerChunk == 0; }
+	const char* GetFrameData(uint64_t frame) const { return data + index[frame]; }
+
+	const char*             data;
+	size_t                  size;
+	const TrajectoryHeader* header;
+	const glm::vec3*        rest;
+	const uint64_t*         index;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
\ No newline at end of file
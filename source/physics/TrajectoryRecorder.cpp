@@ -0,0 +1,249 @@
+#include "TrajectoryRecorder.h"
+#include "PhysicsMemory.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// Nearest 16 bit step, offsets past the range stick at its ends
+static int16_t Quantize(float steps)
+{
+	float rounded = roundf(steps);
+	return static_cast<int16_t>(rounded > 32767.0f ? 32767.0f : (rounded < -32767.0f ? -32767.0f : rounded));
+}
+
+TrajectoryRecorder::TrajectoryRecorder()
+{
+	file = nullptr;
+	memset(&header, 0, sizeof(header));
+	numFrames = stalls = 0;
+	closing = false;
+	offset = 0;
+	chunkFrames = 0;
+	failed = false;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	Close();
+}
+
+void TrajectoryRecorder::Open(const std::string& path, SBLattice& lattice, float step, TrajectoryEncoding encoding,
+	float quantum, uint32_t framesPerChunk)
+{
+	Close();
+
+	file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		throw std::runtime_error("failed to open trajectory file " + path);
+
+	uint32_t numNodes = lattice.GetNumBodies();
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, c_trajectoryMagic, sizeof(header.magic));
+	header.version = c_trajectoryVersion;
+	header.encoding = encoding;
+	header.numNodes = numNodes;
+	header.framesPerChunk = framesPerChunk > 0 ? framesPerChunk : 1;
+	header.step = step;
+	header.quantum = quantum;
+	header.restOffset = physics::PadBytes(sizeof(header));
+
+	rest.resize(numNodes * 3);
+	for (uint32_t n = 0; n < numNodes; ++n)
+	{
+		glm::vec3 p = lattice.GetRestPosition(n);
+		rest[n * 3 + 0] = p.x;
+		rest[n * 3 + 1] = p.y;
+		rest[n * 3 + 2] = p.z;
+	}
+
+	// The header is written again with the frame count and index offset on Close
+	failed = false;
+	std::vector<char> padding(physics::c_cacheLine, 0);
+	Write(&header, sizeof(header));
+	Write(padding.data(), header.restOffset - sizeof(header));
+	Write(rest.data(), sizeof(float) * rest.size());
+	size_t restSize = sizeof(float) * rest.size();
+	Write(padding.data(), physics::PadBytes(restSize) - restSize);
+	offset = header.restOffset + physics::PadBytes(restSize);
+
+	numFrames = stalls = 0;
+	buffers.assign(c_maxQueued, std::vector<float>(numNodes * 3));
+	queued.clear();
+	idle.clear();
+	for (uint32_t b = 0; b < c_maxQueued; ++b)
+		idle.push_back(b);
+
+	chunk.clear();
+	chunk.reserve(header.framesPerChunk * physics::PadBytes(GetTrajectoryFrameSize(encoding, numNodes, true)));
+	index.clear();
+	keyframe.assign(numNodes * 3, 0.0f);
+	chunkFrames = 0;
+
+	closing = false;
+	writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+}
+
+void TrajectoryRecorder::Record(SBLattice& lattice)
+{
+	if (file == nullptr)
+		throw std::runtime_error("trajectory recorder is not open");
+
+	uint32_t slot;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (idle.empty())
+		{
+			++stalls;
+			bufferFreed.wait(lock, [this]() { return !idle.empty(); });
+		}
+		slot = idle.front();
+		idle.pop_front();
+	}
+
+	// Three stream copies, the encoding is left to the writer
+	const ParticleStore& particles = lattice.GetParticles();
+	uint32_t numNodes = header.numNodes;
+	float* positions = buffers[slot].data();
+	memcpy(positions, particles.px, sizeof(float) * numNodes);
+	memcpy(positions + numNodes, particles.py, sizeof(float) * numNodes);
+	memcpy(positions + numNodes * 2, particles.pz, sizeof(float) * numNodes);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(slot);
+	}
+	frameQueued.notify_one();
+	++numFrames;
+}
+
+bool TrajectoryRecorder::Close()
+{
+	if (file == nullptr)
+		return true;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	frameQueued.notify_one();
+	writer.join();
+
+	FlushChunk();
+	header.numFrames = index.size();
+	header.indexOffset = offset;
+	Write(index.data(), sizeof(uint64_t) * index.size());
+	if (fseek(file, 0, SEEK_SET) != 0)
+		failed = true;
+	Write(&header, sizeof(header));
+	if (fclose(file) != 0)
+		failed = true;
+	file = nullptr;
+
+	buffers.clear();
+	queued.clear();
+	idle.clear();
+	return !failed;
+}
+
+void TrajectoryRecorder::WriterLoop()
+{
+	for (;;)
+	{
+		uint32_t slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frameQueued.wait(lock, [this]() { return closing || !queued.empty(); });
+			// Closing only ends the loop once everything queued has been encoded
+			if (queued.empty())
+				return;
+			slot = queued.front();
+			queued.pop_front();
+		}
+
+		EncodeFrame(buffers[slot].data());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			idle.push_back(slot);
+		}
+		bufferFreed.notify_one();
+
+		if (chunkFrames == header.framesPerChunk)
+			FlushChunk();
+	}
+}
+
+void TrajectoryRecorder::EncodeFrame(const float* positions)
+{
+	TrajectoryEncoding encoding = static_cast<TrajectoryEncoding>(header.encoding);
+	uint32_t numNodes = header.numNodes;
+	bool isKeyframe = chunkFrames == 0;
+
+	size_t at = chunk.size();
+	index.push_back(offset + at);
+	chunk.resize(at + physics::PadBytes(GetTrajectoryFrameSize(encoding, numNodes, isKeyframe)), 0);
+
+	const float* x = positions;
+	const float* y = positions + numNodes;
+	const float* z = positions + numNodes * 2;
+	if (encoding == TRAJECTORY_RAW || (encoding == TRAJECTORY_DELTA && isKeyframe))
+	{
+		glm::vec4* out = reinterpret_cast<glm::vec4*>(&chunk[at]);
+		for (uint32_t n = 0; n < numNodes; ++n)
+			out[n] = glm::vec4(x[n] - rest[n * 3 + 0], y[n] - rest[n * 3 + 1], z[n] - rest[n * 3 + 2], 0.0f);
+
+		if (encoding == TRAJECTORY_DELTA)
+		{
+			for (uint32_t n = 0; n < numNodes; ++n)
+			{
+				keyframe[n * 3 + 0] = out[n].x;
+				keyframe[n * 3 + 1] = out[n].y;
+				keyframe[n * 3 + 2] = out[n].z;
+			}
+		}
+	}
+	else
+	{
+		// Quantized frames step from the rest pose, delta frames from the chunk's keyframe
+		const float* base = encoding == TRAJECTORY_DELTA ? keyframe.data() : nullptr;
+		float invQuantum = 1.0f / header.quantum;
+		int16_t* out = reinterpret_cast<int16_t*>(&chunk[at]);
+		for (uint32_t n = 0; n < numNodes; ++n)
+		{
+			float dx = x[n] - rest[n * 3 + 0];
+			float dy = y[n] - rest[n * 3 + 1];
+			float dz = z[n] - rest[n * 3 + 2];
+			if (base)
+			{
+				dx -= base[n * 3 + 0];
+				dy -= base[n * 3 + 1];
+				dz -= base[n * 3 + 2];
+			}
+			out[n * 4 + 0] = Quantize(dx * invQuantum);
+			out[n * 4 + 1] = Quantize(dy * invQuantum);
+			out[n * 4 + 2] = Quantize(dz * invQuantum);
+			out[n * 4 + 3] = 0;
+		}
+	}
+	++chunkFrames;
+}
+
+void TrajectoryRecorder::FlushChunk()
+{
+	if (chunk.empty())
+		return;
+
+	Write(chunk.data(), chunk.size());
+	offset += chunk.size();
+	chunk.clear();
+	chunkFrames = 0;
+}
+
+bool TrajectoryRecorder::Write(const void* data, size_t size)
+{
+	if (failed || size == 0)
+		return !failed;
+	if (fwrite(data, 1, size, file) != size)
+		failed = true;
+	return !failed;
+}
\ No newline at end of file
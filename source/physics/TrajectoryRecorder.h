@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../PrecompiledHeader.h"
+#include "SBLattice.h"
+#include "TrajectoryFormat.h"
+
+// Streams the particle positions of a lattice into a trajectory file
+// Record only copies the positions into a free frame buffer, the writer thread encodes them and writes whole chunks
+class TrajectoryRecorder
+{
+public:
+	TrajectoryRecorder();
+	~TrajectoryRecorder();
+
+	// Creates the file, writes the header and the lattice's rest pose and starts the writer thread
+	// quantum is the size of one 16 bit step for the encodings that use them
+	void Open(const std::string& path, SBLattice& lattice, float step, TrajectoryEncoding encoding = TRAJECTORY_RAW,
+		float quantum = 1e-4f, uint32_t framesPerChunk = 32);
+	// Queues the lattice's current positions as the next frame, waits only while the writer is c_maxQueued frames behind
+	void Record(SBLattice& lattice);
+	// Writes what is still queued, the index and the final header. False if any write failed
+	bool Close();
+
+	bool     IsOpen() const { return file != nullptr; }
+	uint64_t GetFrameCount() const { return numFrames; }
+	// Number of Record calls that had to wait for the writer
+	uint64_t GetStalls() const { return stalls; }
+
+private:
+	static const uint32_t c_maxQueued = 8;
+
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	void WriterLoop();
+	// Appends the frame to the chunk in the file's encoding, the frame's positions are x, y, z streams of numNodes
+	void EncodeFrame(const float* positions);
+	void FlushChunk();
+	bool Write(const void* data, size_t size);
+
+	FILE*              file;
+	TrajectoryHeader   header;
+	std::vector<float> rest;
+	uint64_t           numFrames;
+	uint64_t           stalls;
+
+	// Positions waiting for the writer, and the buffers free to take the next ones
+	std::vector<std::vector<float>> buffers;
+	std::deque<uint32_t>            queued;
+	std::deque<uint32_t>            idle;
+
+	std::thread             writer;
+	std::mutex              mutex;
+	std::condition_variable frameQueued;
+	std::condition_variable bufferFreed;
+	bool                    closing;
+
+	// Writer thread side
+	std::vector<char>     chunk;
+	std::vector<uint64_t> index;
+	uint64_t              offset;
+	// Offsets of the current chunk's keyframe, for delta frames
+	std::vector<float>    keyframe;
+	uint32_t              chunkFrames;
+	bool                  failed;
+};
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t threads)
+{
+	numThreads = threads > 0 ? threads : std::thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+
+	generation = 0;
+	pending = 0;
+	quit = false;
+	job = nullptr;
+	jobCount = 0;
+
+	// Slice 0 belongs to the calling thread
+	for (uint32_t i = 1; i < numThreads; ++i)
+	{
+		workers.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void WorkerPool::ParallelFor(uint32_t count, const RangeJob& range)
+{
+	if (count == 0)
+		return;
+
+	if (numThreads == 1 || count == 1)
+	{
+		range(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &range;
+		jobCount = count;
+		pending = numThreads - 1;
+		++generation;
+	}
+	wake.notify_all();
+
+	RunSlice(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return pending == 0; });
+	job = nullptr;
+}
+
+void WorkerPool::ParallelForChunks(uint32_t count, uint32_t chunkSize, const ChunkJob& job)
+{
+	ParallelFor(GetNumChunks(count, chunkSize), [&](uint32_t first, uint32_t last)
+	{
+		for (uint32_t chunk = first; chunk < last; ++chunk)
+			job(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+	});
+}
+
+void WorkerPool::RunSlice(uint32_t index)
+{
+	uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(jobCount) * index / numThreads);
+	uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(jobCount) * (index + 1) / numThreads);
+	if (begin < end)
+		(*job)(begin, end);
+}
+
+void WorkerPool::WorkerLoop(uint32_t index)
+{
+	uint64_t seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seenGeneration; });
+			if (quit)
+				return;
+			seenGeneration = generation;
+		}
+
+		RunSlice(index);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = --pending == 0;
+		}
+		if (last)
+			done.notify_one();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads for the data parallel physics passes
+// The calling thread always takes part, so a pool of one thread runs everything inline
+class WorkerPool
+{
+public:
+	typedef std::function<void(uint32_t begin, uint32_t end)> RangeJob;
+	typedef std::function<void(uint32_t chunk, uint32_t begin, uint32_t end)> ChunkJob;
+
+	WorkerPool(uint32_t numThreads = 0);
+	~WorkerPool();
+
+	uint32_t GetNumThreads() const { return numThreads; }
+
+	// Splits [0, count) into one contiguous range per thread and blocks until every range is done
+	void ParallelFor(uint32_t count, const RangeJob& job);
+	// Splits [0, count) into chunks of chunkSize numbered in order. Unlike ParallelFor the split doesn't depend on the
+	// number of threads, so per chunk partial results summed in chunk order come out bit identical on any pool
+	void ParallelForChunks(uint32_t count, uint32_t chunkSize, const ChunkJob& job);
+	static uint32_t GetNumChunks(uint32_t count, uint32_t chunkSize) { return (count + chunkSize - 1) / chunkSize; }
+
+private:
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	void WorkerLoop(uint32_t index);
+	void RunSlice(uint32_t index);
+
+	uint32_t numThreads;
+	std::vector<std::thread> workers;
+
+	std::mutex              mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	uint64_t                generation;
+	uint32_t                pending;
+	bool                    quit;
+
+	const RangeJob* job;
+	uint32_t        jobCount;
+};
\ No newline at end of file
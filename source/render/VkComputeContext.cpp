@@ -0,0 +1,50 @@
+#include "VkComputeContext.h"
+
+VkComputeContext::VkComputeContext()
+{
+	VkApplicationInfo appInfo = {};
+	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	appInfo.pApplicationName = "Fornax Compute";
+	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+	appInfo.pEngineName = "Fornax";
+	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+	appInfo.apiVersion = VK_API_VERSION_1_0;
+
+	VkInstanceCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	createInfo.pApplicationInfo = &appInfo;
+
+	if (vkCreateInstance(&createInfo, nullptr, &m_instance) != VK_SUCCESS)
+	{
+		throw std::runtime_error("could not create vulkan instance");
+	}
+
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
+	if (deviceCount == 0)
+	{
+		vkDestroyInstance(m_instance, nullptr);
+		throw std::runtime_error("failed to find a device with vulkan support");
+	}
+
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
+
+	// No surface, so no presentation queue or swapchain extension is asked for
+	m_device = new vk::Device(devices, VK_NULL_HANDLE, std::vector<const char*>());
+
+	VkPhysicalDeviceFeatures enabledFeatures = {};
+	if (m_device->CreateLogicalDevice(enabledFeatures, std::vector<const char*>(), std::vector<const char*>()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create logical device");
+	}
+
+	vkGetDeviceQueue(m_device->logicalDevice, m_device->queueFamilyIndices.graphics, 0, &m_queue);
+}
+
+VkComputeContext::~VkComputeContext()
+{
+	vkDeviceWaitIdle(m_device->logicalDevice);
+	delete m_device;
+	vkDestroyInstance(m_instance, nullptr);
+}
\ No newline at end of file
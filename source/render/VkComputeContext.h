@@ -0,0 +1,27 @@
+#pragma once
+
+#include "VulkanHeader.h"
+#include "VulkanInitializers.h"
+#include "VulkanDevice.h"
+
+// Instance, device and queue without a window or a swapchain
+// Picks a discrete GPU when there is one and otherwise any device with a graphics and compute queue,
+// software devices such as lavapipe included, so compute work runs on machines without a display
+class VkComputeContext
+{
+public:
+	VkComputeContext();
+	~VkComputeContext();
+
+	vk::Device* GetDevice() { return m_device; }
+	VkQueue GetQueue() { return m_queue; }
+	const char* GetDeviceName() const { return m_device->deviceProperties.deviceName; }
+
+private:
+	VkComputeContext(const VkComputeContext&) = delete;
+	VkComputeContext& operator=(const VkComputeContext&) = delete;
+
+	VkInstance  m_instance;
+	vk::Device* m_device;
+	VkQueue     m_queue;
+};
\ No newline at end of file
@@ -18,6 +18,9 @@
 
 #pragma endregion
 
+// Enough for a 512x512 cloth
+static const uint32_t c_defaultDeformVertices = 512 * 512;
+
 void VkRenderBackend::Init(GLFWwindow* window)
 {
 	VkRenderBase::Init(window);
@@ -35,6 +38,7 @@ void VkRenderBackend::Init(GLFWwindow* window)
 
 	PrepareOffscreenFramebuffers();
 	PrepareUniformBuffers();
+	PrepareDeformationBuffer(c_defaultDeformVertices);
 	SetupLayoutsAndDescriptors();
 	PreparePipelines();
 	BuildCommandBuffers();
@@ -53,6 +57,13 @@ void VkRenderBackend::Cleanup()
 	m_uniformBuffers.blur.destroy();
 	m_uniformBuffers.scene.destroy();
 	m_uniformBuffers.lights.destroy();
+	m_uniformBuffers.softbody.destroy();
+
+	m_deformRing.buffer.unmap();
+	m_deformRing.buffer.destroy();
+
+	m_softBodyMesh.vertices.destroy();
+	m_softBodyMesh.indices.destroy();
 
 	/*vkDestroyImageView(m_device->logicalDevice, m_textureImageView, nullptr);
 	vkDestroyImage(m_device->logicalDevice, m_textureImage, nullptr);
@@ -379,6 +390,14 @@ void VkRenderBackend::BuildDeferredCommandBuffer()
 }
 
 void VkRenderBackend::BuildCommandBuffers()
+{
+	for (uint32_t i = 0; i < m_commandBuffers.size(); ++i)
+	{
+		RecordCommandBuffer(i);
+	}
+}
+
+void VkRenderBackend::RecordCommandBuffer(uint32_t i)
 {
 	VkCommandBufferBeginInfo cmdBufInfo = vk::initializers::CommandBufferBeginInfo();
 
@@ -395,52 +414,61 @@ void VkRenderBackend::BuildCommandBuffers()
 	renderPassBeginInfo.clearValueCount = 2;
 	renderPassBeginInfo.pClearValues = clearValues;
 
-	for (int32_t i = 0; i < m_commandBuffers.size(); ++i)
-	{
-		// Set target frame buffer
-		renderPassBeginInfo.framebuffer = m_swapchainFramebuffers[i];
+	// Set target frame buffer
+	renderPassBeginInfo.framebuffer = m_swapchainFramebuffers[i];
 
-		vkBeginCommandBuffer(m_commandBuffers[i], &cmdBufInfo);
+	vkBeginCommandBuffer(m_commandBuffers[i], &cmdBufInfo);
 
-		vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		VkViewport viewport = vk::initializers::Viewport((float)m_window->width, (float)m_window->height, 0.0f, 1.0f);
-		vkCmdSetViewport(m_commandBuffers[i], 0, 1, &viewport);
+	VkViewport viewport = vk::initializers::Viewport((float)m_window->width, (float)m_window->height, 0.0f, 1.0f);
+	vkCmdSetViewport(m_commandBuffers[i], 0, 1, &viewport);
 
-		VkRect2D scissor = vk::initializers::Rect2D(m_window->width, m_window->height, 0, 0);
-		vkCmdSetScissor(m_commandBuffers[i], 0, 1, &scissor);
+	VkRect2D scissor = vk::initializers::Rect2D(m_window->width, m_window->height, 0, 0);
+	vkCmdSetScissor(m_commandBuffers[i], 0, 1, &scissor);
 
-		VkDeviceSize offsets[1] = { 0 };
+	VkDeviceSize offsets[1] = { 0 };
 
-		// 3D scene
-		/*vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelineLayouts->get("scene"), 0, 1, m_resources.descriptorSets->getPtr("scene"), 0, NULL);
-		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelines->get("scene"));*/
+	// 3D scene
+	/*vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelineLayouts->get("scene"), 0, 1, m_resources.descriptorSets->getPtr("scene"), 0, NULL);
+	vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelines->get("scene"));*/
 
-		// Fullscreen triangle (clipped to a quad) with radial blur
-		vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelineLayouts->get("blur"), 0, 1, m_resources.descriptorSets->getPtr("blur"), 0, NULL);
-		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelines->get("blur"));
-		vkCmdDraw(m_commandBuffers[i], 3, 1, 0, 0);
+	// Fullscreen triangle (clipped to a quad) with radial blur
+	vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelineLayouts->get("blur"), 0, 1, m_resources.descriptorSets->getPtr("blur"), 0, NULL);
+	vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelines->get("blur"));
+	vkCmdDraw(m_commandBuffers[i], 3, 1, 0, 0);
 
-		vkCmdEndRenderPass(m_commandBuffers[i]);
-
-		vkEndCommandBuffer(m_commandBuffers[i]);
+	// Soft body, binding 1 reads this frame's deformation slice
+	if (m_softBodyMesh.numIndices > 0)
+	{
+		uint32_t deformOffset = GetDeformationOffset();
+		vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelineLayouts->get("softbody"), 0, 1, m_resources.descriptorSets->getPtr("softbody"), 1, &deformOffset);
+		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_resources.pipelines->get("softbody"));
+		vkCmdBindVertexBuffers(m_commandBuffers[i], 0, 1, &m_softBodyMesh.vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(m_commandBuffers[i], m_softBodyMesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(m_commandBuffers[i], m_softBodyMesh.numIndices, 1, 0, 0, 0);
 	}
+
+	vkCmdEndRenderPass(m_commandBuffers[i]);
+
+	vkEndCommandBuffer(m_commandBuffers[i]);
 }
 
 void VkRenderBackend::SetupDescriptorPool()
 {
-	// Example uses three ubos and one image sampler
+	// Example uses four ubos, image samplers and the dynamic deformation storage buffer
 	std::vector<VkDescriptorPoolSize> poolSizes =
 	{
-		vk::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4),
-		vk::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10)
+		vk::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5),
+		vk::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10),
+		vk::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1)
 	};
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo =
 		vk::initializers::DescriptorPoolCreateInfo(
 			poolSizes.size(),
 			poolSizes.data(),
-			4);
+			5);
 
 	vkCreateDescriptorPool(m_device->logicalDevice, &descriptorPoolInfo, nullptr, &m_descriptorPool);
 }
@@ -520,6 +548,25 @@ void VkRenderBackend::SetupLayoutsAndDescriptors()
 	};
 
 	vkUpdateDescriptorSets(m_device->logicalDevice, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+
+	// Soft body, deformation is read per vertex from the current slice of the ring
+	setLayoutBindings =
+	{
+		vk::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),				// Binding 0 : Vertex shader uniform buffer
+		vk::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 1)		// Binding 1 : Deformation storage buffer
+	};
+	descriptorSetLayout = vk::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+	m_resources.descriptorSetLayouts->add("softbody", descriptorSetLayout);
+	pipelineLayoutCreateInfo = vk::initializers::PipelineLayoutCreateInfo(m_resources.descriptorSetLayouts->getPtr("softbody"), 1);
+	m_resources.pipelineLayouts->add("softbody", pipelineLayoutCreateInfo);
+	descriptorSetAllocInfo = vk::initializers::DescriptorSetAllocateInfo(m_descriptorPool, m_resources.descriptorSetLayouts->getPtr("softbody"), 1);
+	targetDescriptorSet = m_resources.descriptorSets->add("softbody", descriptorSetAllocInfo);
+	writeDescriptorSets =
+	{
+		vk::initializers::WriteDescriptorSet(targetDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_uniformBuffers.softbody.descriptor),				// Binding 0 : Vertex shader uniform buffer
+		vk::initializers::WriteDescriptorSet(targetDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, &m_deformRing.buffer.descriptor)		// Binding 1 : Deformation storage buffer
+	};
+	vkUpdateDescriptorSets(m_device->logicalDevice, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 }
 
 void VkRenderBackend::PreparePipelines()
@@ -632,6 +679,24 @@ void VkRenderBackend::PreparePipelines()
 	blendAttachmentState.colorWriteMask = 0xF;
 	blendAttachmentState.blendEnable = VK_TRUE;
 	m_resources.pipelines->add("blur", pipelineCreateInfo, m_pipelineCache);
+
+	// Soft body pipeline, vertices come from the model and are displaced in the vertex shader
+	vertexInput.bindingDescriptions = { vk::Vertex::GetBindingDescription() };
+	vertexInput.attributeDescriptions = vk::Vertex::GetAttributeDescriptions();
+	vertexInput.inputState = vk::initializers::PipelineVertexInputStateCreateInfo();
+	vertexInput.inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInput.bindingDescriptions.size());
+	vertexInput.inputState.pVertexBindingDescriptions = vertexInput.bindingDescriptions.data();
+	vertexInput.inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInput.attributeDescriptions.size());
+	vertexInput.inputState.pVertexAttributeDescriptions = vertexInput.attributeDescriptions.data();
+
+	shaderStages[0] = VkRenderBase::LoadShader("shaders/softbody.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	shaderStages[1] = VkRenderBase::LoadShader("shaders/softbody.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	pipelineCreateInfo.pVertexInputState = &vertexInput.inputState;
+	pipelineCreateInfo.layout = m_resources.pipelineLayouts->get("softbody");
+	// Cloth is seen from both sides, opaque
+	rasterizationState.cullMode = VK_CULL_MODE_NONE;
+	blendAttachmentState.blendEnable = VK_FALSE;
+	m_resources.pipelines->add("softbody", pipelineCreateInfo, m_pipelineCache);
 }
 
 // Prepare and initialize uniform buffer containing shader uniforms
@@ -661,10 +726,111 @@ void VkRenderBackend::PrepareUniformBuffers()
 		&m_uniformBuffers.lights,
 		&uboLights);
 
+	// Soft body vertex shader matrices
+	m_device->CreateBuffer(
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		sizeof(uboSoftBody),
+		&m_uniformBuffers.softbody,
+		&uboSoftBody);
+
 	// Map persistent
 	m_uniformBuffers.scene.map();
 	m_uniformBuffers.blur.map();
 	m_uniformBuffers.lights.map();
+	m_uniformBuffers.softbody.map();
+}
+
+// Host visible storage buffer split into one slice per swapchain image
+// It stays mapped for its whole lifetime, the physics side writes deformation straight into it
+void VkRenderBackend::PrepareDeformationBuffer(uint32_t maxVertices)
+{
+	VkDeviceSize alignment = std::max<VkDeviceSize>(m_device->deviceProperties.limits.minStorageBufferOffsetAlignment, 16);
+	VkDeviceSize sliceSize = sizeof(glm::vec4) * maxVertices;
+	sliceSize = (sliceSize + alignment - 1) / alignment * alignment;
+
+	m_deformRing.sliceSize = sliceSize;
+	m_deformRing.numSlices = static_cast<uint32_t>(m_commandBuffers.size());
+	m_deformRing.currentSlice = 0;
+	m_deformRing.maxVertices = maxVertices;
+
+	m_device->CreateBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		sliceSize * m_deformRing.numSlices,
+		&m_deformRing.buffer);
+
+	// Dynamic descriptor covers one slice, the offset picks which
+	m_deformRing.buffer.setupDescriptor(sliceSize);
+	m_deformRing.buffer.map();
+	memset(m_deformRing.buffer.mapped, 0, static_cast<size_t>(sliceSize * m_deformRing.numSlices));
+}
+
+glm::vec4* VkRenderBackend::BeginDeformationUpload(uint32_t numVertices)
+{
+	if (numVertices > m_deformRing.maxVertices)
+	{
+		throw std::runtime_error("soft body exceeds the deformation buffer capacity");
+	}
+
+	// Frames never overlap (RequestFrameRender waits on the queue), cycling slices keeps a
+	// frame's deformation intact while the next one is written
+	m_deformRing.currentSlice = (m_deformRing.currentSlice + 1) % m_deformRing.numSlices;
+
+	char* base = static_cast<char*>(m_deformRing.buffer.mapped);
+	return reinterpret_cast<glm::vec4*>(base + m_deformRing.currentSlice * m_deformRing.sliceSize);
+}
+
+VkSoftBodyCompute* VkRenderBackend::CreateSoftBodyCompute()
+{
+	return new VkSoftBodyCompute(m_device, m_context.graphicsQueue);
+}
+
+// Points binding 1 of the soft body set at a device buffer, the GPU solver's deformation output
+// The ring's offset no longer applies, a null buffer goes back to the ring
+void VkRenderBackend::SetDeformationSource(vk::Buffer* buffer, uint32_t numVertices)
+{
+	VkDescriptorBufferInfo descriptor = m_deformRing.buffer.descriptor;
+	m_deformRing.external = buffer != nullptr;
+	if (buffer)
+	{
+		descriptor = buffer->descriptor;
+		descriptor.offset = 0;
+		descriptor.range = sizeof(glm::vec4) * numVertices;
+	}
+
+	VkWriteDescriptorSet writeDescriptorSet = vk::initializers::WriteDescriptorSet(m_resources.descriptorSets->get("softbody"), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, &descriptor);
+	vkUpdateDescriptorSets(m_device->logicalDevice, 1, &writeDescriptorSet, 0, NULL);
+}
+
+// Host visible vertex and index buffers, small enough that staging them is not worth it
+void VkRenderBackend::SetSoftBodyModel(vk::Model& model)
+{
+	if (model.getNumVertices() > m_deformRing.maxVertices)
+	{
+		throw std::runtime_error("soft body model exceeds the deformation buffer capacity");
+	}
+
+	// The previous mesh may still be in flight
+	WaitForDrawToFinish();
+	m_softBodyMesh.vertices.destroy();
+	m_softBodyMesh.indices.destroy();
+
+	m_device->CreateBuffer(
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		sizeof(vk::Vertex) * model.getNumVertices(),
+		&m_softBodyMesh.vertices,
+		model.getVertices());
+
+	m_device->CreateBuffer(
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		sizeof(uint32_t) * model.getNumIndices(),
+		&m_softBodyMesh.indices,
+		model.getIndices());
+
+	m_softBodyMesh.numIndices = static_cast<uint32_t>(model.getNumIndices());
 }
 
 void VkRenderBackend::RequestFrameRender()
@@ -674,7 +840,7 @@ void VkRenderBackend::RequestFrameRender()
 	Draw();
 }
 
-void VkRenderBackend::UpdateUniformBuffers(Camera camera, glm::vec3* deformVecs, float dt)
+void VkRenderBackend::UpdateUniformBuffers(Camera camera, float dt)
 {
 	// Scene rendering
 	uboScene.view = camera.getView();
@@ -699,6 +865,13 @@ void VkRenderBackend::UpdateUniformBuffers(Camera camera, glm::vec3* deformVecs,
 
 	m_uniformBuffers.lights.copyTo(&uboScene, sizeof(UBOScene));
 	m_uniformBuffers.lights.unmap();
+
+	// Soft body matrices, the deformation itself goes through the ring
+	uboSoftBody.model = glm::mat4();
+	uboSoftBody.view = camera.getView();
+	uboSoftBody.proj = camera.getProj();
+
+	m_uniformBuffers.softbody.copyTo(&uboSoftBody, sizeof(UBOSoftBody));
 }
 
 #pragma region Vulkan Functions
@@ -833,6 +1006,9 @@ void VkRenderBackend::Draw()
 
 	// Scene rendering
 
+	// Re-recorded every frame, the soft body's dynamic offset follows the slice written for this frame
+	RecordCommandBuffer(m_currentBuffer);
+
 	// Wait for offscreen semaphore
 	m_submitInfo.pWaitSemaphores = &m_offscreenSemaphore;
 	// Signal ready with render complete semaphpre
@@ -5,6 +5,7 @@
 #include "VkRenderBase.h"
 #include "VulkanBuffer.h"
 #include "VulkanModel.h"
+#include "VkSoftBodyCompute.h"
 #include "../core/Camera.h"
 
 class VkRenderBackend : public VkRenderBase
@@ -16,7 +17,19 @@ public:
 
 	virtual void RequestFrameRender();
 
-	void UpdateUniformBuffers(Camera camera, glm::vec3* deformVecs, float dt);
+	void UpdateUniformBuffers(Camera camera, float dt);
+
+	// Moves on to the next slice and returns its mapped memory, room for numVertices deformation vectors
+	glm::vec4* BeginDeformationUpload(uint32_t numVertices);
+	// Dynamic offset of the slice last handed out, for binding 1 of the "softbody" descriptor set
+	uint32_t GetDeformationOffset() { return m_deformRing.external ? 0 : static_cast<uint32_t>(m_deformRing.currentSlice * m_deformRing.sliceSize); }
+
+	// GPU soft body solver on the device and queue the soft body is drawn with
+	VkSoftBodyCompute* CreateSoftBodyCompute();
+	// Draws the soft body straight from a device buffer of numVertices deformation vectors instead of the ring
+	void SetDeformationSource(vk::Buffer* buffer, uint32_t numVertices);
+	// Mesh drawn with the "softbody" pipeline, vertex n is displaced by deformation vector n
+	void SetSoftBodyModel(vk::Model& model);
 
 	//std::vector<vk::Model> GetModelList() { return m_models; }
 
@@ -45,6 +58,13 @@ private:
 		float dt;
 	} uboScene;
 
+	struct UBOSoftBody
+	{
+		glm::mat4 model;
+		glm::mat4 view;
+		glm::mat4 proj;
+	} uboSoftBody;
+
 	struct UBOBlur
 	{
 		float radialBlurScale = 0.35f;
@@ -72,8 +92,24 @@ private:
 		vk::Buffer blur;
 		vk::Buffer scene;
 		vk::Buffer lights;
+		vk::Buffer softbody;
 	} m_uniformBuffers;
 
+	struct {
+		vk::Buffer   buffer;
+		VkDeviceSize sliceSize = 0;
+		uint32_t     numSlices = 0;
+		uint32_t     currentSlice = 0;
+		uint32_t     maxVertices = 0;
+		bool         external = false;
+	} m_deformRing;
+
+	struct {
+		vk::Buffer vertices;
+		vk::Buffer indices;
+		uint32_t   numIndices = 0;
+	} m_softBodyMesh;
+
 	struct FrameBufferAttachment {
 		VkImage image;
 		VkDeviceMemory memory;
@@ -121,11 +157,16 @@ private:
 	void PrepareOffscreenFramebuffers();
 	void BuildDeferredCommandBuffer();
 	virtual void BuildCommandBuffers();
+	// Records the swapchain pass for one image, the soft body is bound at the deformation slice current at record time
+	void RecordCommandBuffer(uint32_t i);
 	//void RebuildCommandBuffers();
 	void SetupDescriptorPool();
 	void SetupLayoutsAndDescriptors();
 	void PreparePipelines();
 	void PrepareUniformBuffers();
+	// Soft body deformation ring, one persistently mapped slice per swapchain image
+	// Only called from Init, before the "softbody" descriptor set that points at it is written
+	void PrepareDeformationBuffer(uint32_t maxVertices);
 	void SetupLights();
 
 	void Draw();
@@ -290,7 +290,8 @@ void VkRenderBase::CreateCommandPool()
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = m_device->queueFamilyIndices.graphics;
-	poolInfo.flags = 0;
+	// Lets the backend re-record a frame's command buffer
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	if (vkCreateCommandPool(m_device->logicalDevice, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
 	{
@@ -0,0 +1,344 @@
+#include "VkSoftBodyCompute.h"
+#include "../physics/SBLattice.h"
+
+#include <fstream>
+
+static const uint32_t c_groupSize = 64;
+static const uint32_t c_numBindings = 7;
+
+static std::vector<char> ReadShaderFile(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open " + filename);
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	std::vector<char> buffer(fileSize);
+
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+
+	return buffer;
+}
+
+VkSoftBodyCompute::VkSoftBodyCompute(vk::Device* device, VkQueue queue)
+{
+	this->device = device;
+	this->queue = queue;
+
+	numNodes = 0;
+	dampening = 0;
+	externalForce = glm::vec3(0);
+	current = 0;
+
+	descriptorPool = VK_NULL_HANDLE;
+	descriptorSetLayout = VK_NULL_HANDLE;
+	descriptorSets[0] = descriptorSets[1] = VK_NULL_HANDLE;
+	pipelineLayout = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+	shaderModule = VK_NULL_HANDLE;
+
+	commandPool = VK_NULL_HANDLE;
+	commandBuffer = VK_NULL_HANDLE;
+	fence = VK_NULL_HANDLE;
+	submitted = false;
+}
+
+VkSoftBodyCompute::~VkSoftBodyCompute()
+{
+	Destroy();
+}
+
+void VkSoftBodyCompute::Prepare(SBLattice& lattice, const std::string& shaderFile)
+{
+	Destroy();
+
+	if (lattice.GetNumBodies() == 0)
+	{
+		throw std::runtime_error("cannot prepare an empty soft body");
+	}
+	if (lattice.GetSolverMode() != SOLVER_EXPLICIT || lattice.GetIntegrator() != INTEGRATOR_CONSTANT_ACCELERATION || lattice.GetSpringLaw() != SPRING_LINEAR)
+	{
+		throw std::runtime_error("the GPU soft body solver only supports the explicit solver with constant acceleration and linear springs");
+	}
+
+	numNodes = lattice.GetNumBodies();
+	dampening = lattice.GetDampening();
+	externalForce = lattice.GetNetForce();
+	current = 0;
+
+	ParticleStore& particles = lattice.GetParticles();
+	std::vector<glm::vec4> positionData(numNodes), velocityData(numNodes), nodeData(numNodes);
+	for (uint32_t n = 0; n < numNodes; ++n)
+	{
+		positionData[n] = glm::vec4(particles.GetPosition(n), particles.invMass[n]);
+		velocityData[n] = glm::vec4(particles.GetVelocity(n), 0.0f);
+		nodeData[n] = glm::vec4(lattice.GetRestPosition(n), static_cast<float>(lattice.GetExternalForceCount(n)));
+	}
+
+	// Both ends of a spring see it, so every node can gather its forces without atomics
+	SpringTopology springs;
+	std::vector<float> stiffness;
+	lattice.GetSpringSet(springs, stiffness);
+
+	std::vector<uint32_t> offsetData(numNodes + 1);
+	std::vector<Link> linkData;
+	for (uint32_t n = 0; n < numNodes; ++n)
+	{
+		offsetData[n] = static_cast<uint32_t>(linkData.size());
+		for (uint32_t i = springs.GetNodeBegin(n); i < springs.GetNodeBegin(n + 1); ++i)
+		{
+			uint32_t s = springs.GetNodeSprings()[i];
+			Link link;
+			link.other = springs.GetNodeA()[s] == n ? springs.GetNodeB()[s] : springs.GetNodeA()[s];
+			link.restLength = springs.GetRestLengths()[s];
+			link.stiffness = stiffness[s];
+			link._padding = 0.0f;
+			linkData.push_back(link);
+		}
+	}
+	offsetData[numNodes] = static_cast<uint32_t>(linkData.size());
+	// Storage buffers can't be empty
+	if (linkData.empty())
+	{
+		linkData.resize(1, Link());
+	}
+
+	VkDeviceSize nodeBytes = sizeof(glm::vec4) * numNodes;
+	CreateStorageBuffer(&positions[0], positionData.data(), nodeBytes);
+	CreateStorageBuffer(&positions[1], positionData.data(), nodeBytes);
+	CreateStorageBuffer(&velocities, velocityData.data(), nodeBytes);
+	CreateStorageBuffer(&nodes, nodeData.data(), nodeBytes);
+	CreateStorageBuffer(&linkOffsets, offsetData.data(), sizeof(uint32_t) * offsetData.size());
+	CreateStorageBuffer(&links, linkData.data(), sizeof(Link) * linkData.size());
+
+	std::vector<glm::vec4> deformationData(numNodes);
+	for (uint32_t n = 0; n < numNodes; ++n)
+	{
+		deformationData[n] = glm::vec4(glm::vec3(positionData[n]) - glm::vec3(nodeData[n]), 0.0f);
+	}
+	CreateStorageBuffer(&deformation, deformationData.data(), nodeBytes);
+
+	CreatePipeline(shaderFile);
+
+	VkCommandPoolCreateInfo poolInfo = vk::initializers::CommandPoolCreateInfo();
+	poolInfo.queueFamilyIndex = device->queueFamilyIndices.graphics;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	if (vkCreateCommandPool(device->logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body command pool");
+	}
+
+	VkCommandBufferAllocateInfo allocateInfo = vk::initializers::CommandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+	if (vkAllocateCommandBuffers(device->logicalDevice, &allocateInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate the soft body command buffer");
+	}
+
+	VkFenceCreateInfo fenceInfo = vk::initializers::FenceCreateInfo(0);
+	if (vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body fence");
+	}
+	submitted = false;
+}
+
+void VkSoftBodyCompute::Destroy()
+{
+	if (device == nullptr || numNodes == 0)
+		return;
+
+	Wait();
+
+	vkDestroyFence(device->logicalDevice, fence, nullptr);
+	vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+
+	vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+	vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+	vkDestroyShaderModule(device->logicalDevice, shaderModule, nullptr);
+	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+
+	vk::Buffer* buffers[] = { &positions[0], &positions[1], &velocities, &nodes, &linkOffsets, &links, &deformation };
+	for (vk::Buffer* buffer : buffers)
+	{
+		buffer->destroy();
+		*buffer = vk::Buffer();
+	}
+
+	numNodes = 0;
+}
+
+void VkSoftBodyCompute::Step(float dt, uint32_t steps)
+{
+	if (steps == 0 || numNodes == 0)
+		return;
+
+	Wait();
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo = vk::initializers::CommandBufferBeginInfo();
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// The previous submission and the draws still reading the deformation have to be done with the buffers
+	VkMemoryBarrier barrier = vk::initializers::MemoryBarrier();
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	PushConstants constants;
+	constants.externalForce = glm::vec4(externalForce, 0.0f);
+	constants.dt = dt;
+	constants.dampening = dampening;
+	constants.numNodes = numNodes;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &constants);
+
+	// Every step waits for the whole previous one, the last barrier also covers the vertex shader and readbacks
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	for (uint32_t s = 0; s < steps; ++s)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[current], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (numNodes + c_groupSize - 1) / c_groupSize, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+		current ^= 1;
+	}
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo = vk::initializers::SubmitInfo();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit the soft body step");
+	}
+	submitted = true;
+}
+
+void VkSoftBodyCompute::Wait()
+{
+	if (!submitted)
+		return;
+
+	vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	vkResetFences(device->logicalDevice, 1, &fence);
+	submitted = false;
+}
+
+void VkSoftBodyCompute::ReadPositions(std::vector<glm::vec4>& out)
+{
+	Wait();
+
+	VkDeviceSize size = sizeof(glm::vec4) * numNodes;
+	vk::Buffer staging;
+	if (device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, &staging) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body readback buffer");
+	}
+	device->CopyBuffer(positions[current].buffer, staging.buffer, size, queue);
+
+	out.resize(numNodes);
+	staging.map(size);
+	memcpy(out.data(), staging.mapped, static_cast<size_t>(size));
+	staging.unmap();
+	staging.destroy();
+}
+
+// Device local buffer filled through a host visible staging copy
+void VkSoftBodyCompute::CreateStorageBuffer(vk::Buffer* buffer, const void* data, VkDeviceSize size)
+{
+	vk::Buffer staging;
+	if (device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		size, &staging, const_cast<void*>(data)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create a soft body staging buffer");
+	}
+
+	if (device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create a soft body storage buffer");
+	}
+	buffer->setupDescriptor(size);
+
+	device->CopyBuffer(staging.buffer, buffer->buffer, size, queue);
+	staging.destroy();
+}
+
+void VkSoftBodyCompute::CreatePipeline(const std::string& shaderFile)
+{
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+	for (uint32_t b = 0; b < c_numBindings; ++b)
+	{
+		setLayoutBindings.push_back(vk::initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, b));
+	}
+	VkDescriptorSetLayoutCreateInfo layoutInfo = vk::initializers::DescriptorSetLayoutCreateInfo(setLayoutBindings.data(), c_numBindings);
+	if (vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body descriptor set layout");
+	}
+
+	VkPushConstantRange pushConstantRange = vk::initializers::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = vk::initializers::PipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	if (vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body pipeline layout");
+	}
+
+	// One set per ping pong direction
+	VkDescriptorPoolSize poolSize = vk::initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * c_numBindings);
+	VkDescriptorPoolCreateInfo poolInfo = vk::initializers::DescriptorPoolCreateInfo(1, &poolSize, 2);
+	if (vkCreateDescriptorPool(device->logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body descriptor pool");
+	}
+
+	VkDescriptorSetLayout setLayouts[2] = { descriptorSetLayout, descriptorSetLayout };
+	VkDescriptorSetAllocateInfo allocateInfo = vk::initializers::DescriptorSetAllocateInfo(descriptorPool, setLayouts, 2);
+	if (vkAllocateDescriptorSets(device->logicalDevice, &allocateInfo, descriptorSets) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate the soft body descriptor sets");
+	}
+
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		vk::Buffer* bound[c_numBindings] = { &positions[i], &positions[i ^ 1], &velocities, &nodes, &linkOffsets, &links, &deformation };
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+		for (uint32_t b = 0; b < c_numBindings; ++b)
+		{
+			writeDescriptorSets.push_back(vk::initializers::WriteDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, b, &bound[b]->descriptor));
+		}
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	std::vector<char> code = ReadShaderFile(shaderFile);
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = code.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	if (vkCreateShaderModule(device->logicalDevice, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body shader module");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = vk::initializers::ComputePipelineCreateInfo(pipelineLayout, 0);
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	if (vkCreateComputePipelines(device->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create the soft body pipeline");
+	}
+}
\ No newline at end of file
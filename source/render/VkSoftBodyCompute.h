@@ -0,0 +1,85 @@
+#pragma once
+
+#include "VulkanHeader.h"
+#include "VulkanInitializers.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+class SBLattice;
+
+// Explicit soft body solver running in a compute shader
+// Particle state lives in device local storage buffers for the whole run, each step reads one position buffer and
+// writes the other along with the deformation buffer the soft body vertex shader reads, nothing comes back to the host
+class VkSoftBodyCompute
+{
+public:
+	// Records onto the given queue, which also has to be the queue the soft body is drawn on
+	VkSoftBodyCompute(vk::Device* device, VkQueue queue);
+	~VkSoftBodyCompute();
+
+	// Copies the lattice state, springs and rest shape onto the device and builds the pipeline
+	// The shader only runs the explicit solver with constant acceleration and linear springs, other settings throw
+	void Prepare(SBLattice& lattice, const std::string& shaderFile = "shaders/softbody.comp.spv");
+	void Destroy();
+
+	void SetNetForce(glm::vec3 force) { externalForce = force; }
+	// Records steps dispatches of dt into one submission, waits for the previous submission first
+	void Step(float dt, uint32_t steps);
+	// Blocks until the last submission finished
+	void Wait();
+
+	// Copies the current positions back, only meant for tests and comparison runs
+	void ReadPositions(std::vector<glm::vec4>& positions);
+
+	vk::Buffer* GetDeformationBuffer() { return &deformation; }
+	uint32_t GetNumNodes() const { return numNodes; }
+
+private:
+	struct Link
+	{
+		uint32_t other;
+		float    restLength;
+		float    stiffness;
+		float    _padding;
+	};
+
+	struct PushConstants
+	{
+		glm::vec4 externalForce;
+		float     dt;
+		float     dampening;
+		uint32_t  numNodes;
+	};
+
+	void CreateStorageBuffer(vk::Buffer* buffer, const void* data, VkDeviceSize size);
+	void CreatePipeline(const std::string& shaderFile);
+
+	vk::Device* device;
+	VkQueue     queue;
+
+	uint32_t  numNodes;
+	float     dampening;
+	glm::vec3 externalForce;
+
+	// Ping pong position buffers, current holds the latest step
+	vk::Buffer positions[2];
+	uint32_t   current;
+	vk::Buffer velocities;
+	vk::Buffer nodes;
+	vk::Buffer linkOffsets;
+	vk::Buffer links;
+	vk::Buffer deformation;
+
+	VkDescriptorPool      descriptorPool;
+	VkDescriptorSetLayout descriptorSetLayout;
+	// Set i reads positions[i] and writes the other one
+	VkDescriptorSet       descriptorSets[2];
+	VkPipelineLayout      pipelineLayout;
+	VkPipeline            pipeline;
+	VkShaderModule        shaderModule;
+
+	VkCommandPool   commandPool;
+	VkCommandBuffer commandBuffer;
+	VkFence         fence;
+	bool            submitted;
+};
\ No newline at end of file
@@ -26,14 +26,19 @@ namespace vk
 		
 		bool enableDebug = false;
 
+		// A null surface selects a headless compute device, no presentation needed
 		Device(std::vector<VkPhysicalDevice> physicalDevices, VkSurfaceKHR surface, std::vector<const char*> deviceExtensions)
 		{
-			for (const auto& device : physicalDevices)
+			// Discrete GPUs first, then anything else that fits so integrated and software devices such as lavapipe still run
+			for (int pass = 0; pass < 2 && physicalDevice == VK_NULL_HANDLE; ++pass)
 			{
-				if (IsDeviceSuitable(device, surface, deviceExtensions))
+				for (const auto& device : physicalDevices)
 				{
-					physicalDevice = device;
-					break;
+					if (IsDeviceSuitable(device, surface, deviceExtensions, pass == 0))
+					{
+						physicalDevice = device;
+						break;
+					}
 				}
 			}
 			if (physicalDevice == VK_NULL_HANDLE)
@@ -69,7 +74,7 @@ namespace vk
 		}
 
 	private:
-		bool IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, std::vector<const char*> deviceExtensions)
+		bool IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, std::vector<const char*> deviceExtensions, bool requireDiscrete)
 		{
 			vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
 			vkGetPhysicalDeviceProperties(device, &deviceProperties);
@@ -95,9 +100,13 @@ namespace vk
 			for (const auto& queueFamily : queueFamilyProperties)
 			{
 				VkBool32 presentSupport = false;
-				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+				if (surface != VK_NULL_HANDLE)
+				{
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+				}
 
-				if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				// The soft body compute work shares the graphics queue
+				if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
 				{
 					queueFamilyIndices.graphics = i;
 				}
@@ -105,20 +114,26 @@ namespace vk
 				{
 					queueFamilyIndices.present = i;
 				}
-				if (queueFamilyIndices.graphics != unassignedQueueValue && queueFamilyIndices.present != unassignedQueueValue)
+				if (queueFamilyIndices.graphics != unassignedQueueValue && (queueFamilyIndices.present != unassignedQueueValue || surface == VK_NULL_HANDLE))
 				{
 					break;
 				}
 
 				++i;
 			}
+			if (surface == VK_NULL_HANDLE)
+			{
+				queueFamilyIndices.present = queueFamilyIndices.graphics;
+			}
 
 			bool queueFamiliesFound = (queueFamilyIndices.graphics != unassignedQueueValue) && (queueFamilyIndices.present != unassignedQueueValue);
 
 			// Check if all required device extensions are supported
 			bool extensionsSupported = CheckDeviceExtensionsSupported(device, deviceExtensions);
 
-			return isDiscrete && queueFamiliesFound && extensionsSupported && deviceFeatures.samplerAnisotropy;
+			bool featuresSupported = surface == VK_NULL_HANDLE || deviceFeatures.samplerAnisotropy;
+
+			return (isDiscrete || !requireDiscrete) && queueFamiliesFound && extensionsSupported && featuresSupported;
 		}
 
 		bool CheckDeviceExtensionsSupported(VkPhysicalDevice device, std::vector<const char*> deviceExtensions)
@@ -242,7 +257,7 @@ namespace vk
 				queueCreateInfoVec.push_back(presentQueueCreateInfo);
 			}
 
-			enabledFeatures.samplerAnisotropy = VK_TRUE;
+			enabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 
 			VkDeviceCreateInfo createInfo = {};
 			createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
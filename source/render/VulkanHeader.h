@@ -2,6 +2,8 @@
 
 #include <unordered_map>
 #include <vector>
+#include <string>
+#include <stdexcept>
 #include <limits>
 #include <algorithm>
 #include <assert.h>